@@ -0,0 +1,347 @@
+#include <ctype.h>
+#include <limits.h>
+#include <algorithm>
+#include "align.hh"
+
+namespace align {
+
+  /** Cost of cells outside the band. */
+  static const unsigned int infinite_cost = UINT_MAX / 2;
+
+  /** Sets a cell to be outside the band. */
+  static inline void
+  set_infinite(Cell &cell)
+  {
+    cell.cost = infinite_cost;
+    cell.substitution = cell.deletion = cell.insertion = 0;
+  }
+
+  /** Aligns the sequences in a band of diagonals. Diagonal d has the cells
+   * where d more hypothesis than reference tokens have been consumed.
+   * \param low Lowest diagonal of the band.
+   * \param high Highest diagonal of the band.
+   * \param operations If not NULL, the last operation of the best path to
+   *                   each cell of the band is stored here, row by row.
+   * \return The best path inside the band. */
+  static Cell
+  align_band(const std::vector<int> &reference,
+             const std::vector<int> &hypothesis,
+             long low,
+             long high,
+             std::vector<unsigned char> *operations)
+  {
+    long n = reference.size();
+    long m = hypothesis.size();
+    long width = high - low + 1;
+    std::vector<Cell> previous(m + 2);
+    std::vector<Cell> current(m + 2);
+
+    if (operations)
+      operations->assign((n + 1) * width, INSERTION);
+
+    // The first row has only insertions.
+    for (long j = 0; j <= m + 1; j++) {
+      if (j <= high && j <= m) {
+        previous[j].cost = j * INSERTION_COST;
+        previous[j].substitution = previous[j].deletion = 0;
+        previous[j].insertion = j;
+      }
+      else {
+        set_infinite(previous[j]);
+      }
+    }
+
+    for (long i = 1; i <= n; i++) {
+      long first = i + low > 0 ? i + low : 0;
+      long last = i + high < m ? i + high : m;
+      unsigned char *row = operations ? &(*operations)[i * width - i - low] : NULL;
+
+      // Cells just outside the band are read by the neighbours.
+      if (first > 0)
+        set_infinite(current[first - 1]);
+      set_infinite(current[last + 1]);
+
+      for (long j = first; j <= last; j++) {
+        Cell &cell = current[j];
+        unsigned char operation = DELETION;
+
+        // Deletion of a reference token.
+        cell = previous[j];
+        cell.cost += DELETION_COST;
+        cell.deletion++;
+
+        if (j > 0) {
+          // Match or substitution.
+          const Cell &diagonal = previous[j - 1];
+          bool match = reference[i - 1] == hypothesis[j - 1];
+          unsigned int cost = diagonal.cost + (match ? 0 : SUBSTITUTION_COST);
+          if (cost <= cell.cost) {
+            cell = diagonal;
+            cell.cost = cost;
+            operation = CORRECT;
+            if (!match) {
+              cell.substitution++;
+              operation = SUBSTITUTION;
+            }
+          }
+
+          // Insertion of a hypothesis token.
+          const Cell &left = current[j - 1];
+          if (left.cost + INSERTION_COST < cell.cost) {
+            cell = left;
+            cell.cost += INSERTION_COST;
+            cell.insertion++;
+            operation = INSERTION;
+          }
+        }
+        if (row)
+          row[j] = operation;
+      }
+      previous.swap(current);
+    }
+
+    return previous[m];
+  }
+
+  Result
+  align_tokens(const std::vector<int> &reference,
+               const std::vector<int> &hypothesis,
+               std::vector<Operation> *operations)
+  {
+    long n = reference.size();
+    long m = hypothesis.size();
+    long difference = m - n;
+    long width = 8;
+    long low, high;
+    std::vector<unsigned char> band;
+    Cell best;
+
+    while (true) {
+      low = (difference < 0 ? difference : 0) - width;
+      high = (difference > 0 ? difference : 0) + width;
+      best = align_band(reference, hypothesis, low, high,
+                        operations ? &band : NULL);
+
+      // A path leaving the band has at least this many insertions and
+      // deletions, so the best path in the band is the best of all if it
+      // costs no more.
+      long indels = (difference < 0 ? -difference : difference) + 2 * width + 2;
+      unsigned long bound = indels * (INSERTION_COST < DELETION_COST ?
+                                      INSERTION_COST : DELETION_COST);
+      if (best.cost <= bound || (low <= -n && high >= m))
+        break;
+      width *= 2;
+    }
+
+    if (operations) {
+      // Trace the path back from the end.
+      long band_width = high - low + 1;
+      long i = n, j = m;
+      operations->clear();
+      while (i > 0 || j > 0) {
+        Operation operation = (Operation)band[i * band_width + j - i - low];
+        operations->push_back(operation);
+        if (operation != INSERTION)
+          i--;
+        if (operation != DELETION)
+          j--;
+      }
+      std::reverse(operations->begin(), operations->end());
+    }
+
+    Result result;
+    result.substitution = best.substitution;
+    result.deletion = best.deletion;
+    result.insertion = best.insertion;
+    result.correct = n - best.substitution - best.deletion;
+    return result;
+  }
+
+  void
+  clean(std::string &text, char space)
+  {
+    std::string result;
+    bool word_break = false;
+
+    result.reserve(text.size());
+    for (std::string::size_type pos = 0; pos < text.size(); pos++) {
+      unsigned char ch = text[pos];
+      if (isspace(ch)) {
+        // Only whitespace between words is kept.
+        word_break = !result.empty();
+        continue;
+      }
+      // Latin-1 a and o with diaeresis are letters too.
+      if (!isalpha(ch) && ch != 0xe4 && ch != 0xc4 && ch != 0xf6 &&
+          ch != 0xd6)
+        continue;
+      if (word_break) {
+        result += space;
+        word_break = false;
+      }
+      result += ch;
+    }
+    text.swap(result);
+  }
+
+  void
+  number_words(const std::string &text,
+               std::map<std::string, int> &words,
+               std::vector<int> &ids)
+  {
+    std::string::size_type pos = 0;
+
+    while (true) {
+      while (pos < text.size() && isspace((unsigned char)text[pos]))
+        pos++;
+      if (pos == text.size())
+        break;
+
+      std::string::size_type end = pos;
+      while (end < text.size() && !isspace((unsigned char)text[end]))
+        end++;
+
+      std::map<std::string, int>::iterator it =
+        words.insert(std::make_pair(text.substr(pos, end - pos),
+                                    (int)words.size())).first;
+      ids.push_back(it->second);
+      pos = end;
+    }
+  }
+
+  Result
+  align_words(const std::string &reference,
+              const std::string &hypothesis)
+  {
+    std::map<std::string, int> words;
+    std::vector<int> reference_ids;
+    std::vector<int> hypothesis_ids;
+
+    number_words(reference, words, reference_ids);
+    number_words(hypothesis, words, hypothesis_ids);
+    return align_tokens(reference_ids, hypothesis_ids);
+  }
+
+  Result
+  align_chars(const std::string &reference,
+              const std::string &hypothesis)
+  {
+    std::vector<int> reference_ids(reference.begin(), reference.end());
+    std::vector<int> hypothesis_ids(hypothesis.begin(), hypothesis.end());
+    return align_tokens(reference_ids, hypothesis_ids);
+  }
+
+  Incremental::Incremental()
+  {
+    this->set_reference(std::vector<int>());
+  }
+
+  void
+  Incremental::set_reference(const std::vector<int> &reference)
+  {
+    m_reference = reference;
+    m_hypothesis.clear();
+
+    // Without hypothesis the reference prefix is deleted.
+    Column column(reference.size() + 1);
+    for (unsigned long i = 0; i < column.size(); i++) {
+      column[i].cost = i * DELETION_COST;
+      column[i].substitution = column[i].insertion = 0;
+      column[i].deletion = i;
+    }
+    m_columns.clear();
+    m_columns.push_back(column);
+    m_first_column = 0;
+  }
+
+  void
+  Incremental::resize(unsigned long size)
+  {
+    if (size >= m_hypothesis.size())
+      return;
+
+    if (size >= m_first_column) {
+      m_columns.resize(size - m_first_column + 1);
+      m_hypothesis.resize(size);
+      return;
+    }
+
+    // The column isn't kept any more, align again from the start.
+    std::vector<int> hypothesis(m_hypothesis.begin(),
+                                m_hypothesis.begin() + size);
+    this->set_reference(std::vector<int>(m_reference));
+    for (unsigned long j = 0; j < hypothesis.size(); j++)
+      this->push_back(hypothesis[j]);
+  }
+
+  void
+  Incremental::push_back(int token)
+  {
+    m_hypothesis.push_back(token);
+    this->add_column(token);
+    if (m_columns.size() > kept_columns) {
+      m_columns.pop_front();
+      m_first_column++;
+    }
+  }
+
+  void
+  Incremental::add_column(int token)
+  {
+    m_columns.push_back(Column(m_reference.size() + 1));
+    const Column &previous = m_columns[m_columns.size() - 2];
+    Column &current = m_columns.back();
+
+    // Only insertions before the first reference token.
+    current[0] = previous[0];
+    current[0].cost += INSERTION_COST;
+    current[0].insertion++;
+
+    for (unsigned long i = 1; i < current.size(); i++) {
+      Cell &cell = current[i];
+
+      // Match or substitution.
+      bool match = m_reference[i - 1] == token;
+      cell = previous[i - 1];
+      if (!match) {
+        cell.cost += SUBSTITUTION_COST;
+        cell.substitution++;
+      }
+
+      // Deletion of a reference token.
+      const Cell &above = current[i - 1];
+      if (above.cost + DELETION_COST < cell.cost) {
+        cell = above;
+        cell.cost += DELETION_COST;
+        cell.deletion++;
+      }
+
+      // Insertion of the hypothesis token.
+      if (previous[i].cost + INSERTION_COST < cell.cost) {
+        cell = previous[i];
+        cell.cost += INSERTION_COST;
+        cell.insertion++;
+      }
+    }
+  }
+
+  Result
+  Incremental::get_result() const
+  {
+    // The reference prefix that fits the hypothesis best.
+    const Column &column = m_columns.back();
+    unsigned long best = 0;
+    for (unsigned long i = 1; i < column.size(); i++) {
+      if (column[i].cost < column[best].cost)
+        best = i;
+    }
+
+    Result result;
+    result.substitution = column[best].substitution;
+    result.deletion = column[best].deletion;
+    result.insertion = column[best].insertion;
+    result.correct = best - result.substitution - result.deletion;
+    return result;
+  }
+
+}
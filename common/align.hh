@@ -0,0 +1,139 @@
+#ifndef ALIGN_HH
+#define ALIGN_HH
+
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Minimum edit distance alignment of a hypothesis against a reference, for
+ * counting recognition errors. The costs are the same as the defaults of
+ * SCLite (substitution 4, deletion 3, insertion 3), so the counts are
+ * comparable to its "Scores:" line.
+ *
+ * The alignment is searched in a band of diagonals around the straight path
+ * and the band is doubled until no path outside it can be better, so the
+ * time is linear in the length of the texts when they are similar.
+ *
+ * Incremental aligns a growing hypothesis against a prefix of the reference
+ * for scores while the recognition is running. */
+namespace align {
+
+  /** Counts of an alignment. */
+  struct Result {
+    Result() { correct = substitution = deletion = insertion = 0; }
+    unsigned int correct;
+    unsigned int substitution;
+    unsigned int deletion;
+    unsigned int insertion;
+  };
+
+  /** Costs of the edit operations. */
+  enum { SUBSTITUTION_COST = 4, DELETION_COST = 3, INSERTION_COST = 3 };
+
+  /** Edit operations of an alignment. */
+  enum Operation { CORRECT, SUBSTITUTION, DELETION, INSERTION };
+
+  /** A cell of the alignment table. The counts of the best path to the cell
+   * are carried along, so no traceback is needed. */
+  struct Cell {
+    unsigned int cost;
+    unsigned int substitution;
+    unsigned int deletion;
+    unsigned int insertion;
+  };
+
+  /** Aligns two token sequences. Equal tokens are equal numbers.
+   * \param reference Reference tokens.
+   * \param hypothesis Hypothesis tokens.
+   * \param operations If not NULL, the operations of the alignment are
+   *                   stored here from the start to the end.
+   * \return Counts of the alignment. */
+  Result align_tokens(const std::vector<int> &reference,
+                      const std::vector<int> &hypothesis,
+                      std::vector<Operation> *operations = NULL);
+
+  /** Aligns the words of two texts. Words are separated by whitespace.
+   * \param reference Reference text.
+   * \param hypothesis Hypothesis text.
+   * \return Counts of the alignment. */
+  Result align_words(const std::string &reference,
+                     const std::string &hypothesis);
+
+  /** Aligns the characters of two texts. Every byte is a token, so word
+   * breaks are compared too.
+   * \param reference Reference text.
+   * \param hypothesis Hypothesis text.
+   * \return Counts of the alignment. */
+  Result align_chars(const std::string &reference,
+                     const std::string &hypothesis);
+
+  /** Cleans a text for scoring. Erases characters other than letters
+   * (including the Latin-1 letters a and o with diaeresis) and whitespace, and leading
+   * and trailing whitespace. Replaces whitespace between words with a
+   * single character given as a parameter.
+   * \param text Text to clean.
+   * \param space Character to replace whitespace between words. */
+  void clean(std::string &text, char space);
+
+  /** Numbers the words of a text. Equal words get equal numbers.
+   * \param text Text to split.
+   * \param words Known words and their numbers, new words are added.
+   * \param ids Numbers of the words are appended here. */
+  void number_words(const std::string &text,
+                    std::map<std::string, int> &words,
+                    std::vector<int> &ids);
+
+  /** Aligns a hypothesis that grows at the end against the reference. The
+   * hypothesis is aligned against the reference prefix that fits it best,
+   * so the part of the reference that hasn't been spoken yet isn't counted
+   * as deletions.
+   *
+   * The table is kept one column per hypothesis token, so appending a token
+   * costs one column over the reference. Only the last columns are kept;
+   * removing tokens further back than that aligns the hypothesis again from
+   * the start. */
+  class Incremental
+  {
+  public:
+
+    Incremental();
+
+    /** Sets the reference and clears the hypothesis.
+     * \param reference Reference tokens. */
+    void set_reference(const std::vector<int> &reference);
+    /** Removes hypothesis tokens from the end.
+     * \param size Number of tokens to keep. */
+    void resize(unsigned long size);
+    /** Appends a token to the hypothesis.
+     * \param token The token. */
+    void push_back(int token);
+
+    /** \return Number of hypothesis tokens. */
+    inline unsigned long size() const { return m_hypothesis.size(); }
+    /** \return Counts of the best alignment of the hypothesis. */
+    Result get_result() const;
+
+  private:
+
+    typedef std::vector<Cell> Column;
+
+    /** How many of the last columns are kept. */
+    static const unsigned int kept_columns = 32;
+
+    /** Calculates the next column from the last one.
+     * \param token Hypothesis token of the new column. */
+    void add_column(int token);
+
+    std::vector<int> m_reference; //!< Reference tokens.
+    std::vector<int> m_hypothesis; //!< Hypothesis tokens.
+    /** The last columns. Column i has the alignments of the first
+     * m_first_column + i hypothesis tokens. */
+    std::deque<Column> m_columns;
+    unsigned long m_first_column; //!< Hypothesis tokens of the first column.
+  };
+
+}
+
+#endif /* ALIGN_HH */
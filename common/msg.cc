@@ -23,7 +23,7 @@ namespace msg {
 
   InQueue::InQueue(int fd)
     : buffer(header_size, 0), bytes_got(0), fd(fd), eof(false), 
-      suspended(false)
+      suspended(false), throttled(false)
   {
     assert(sizeof(int) == 4);
   }
@@ -279,7 +279,7 @@ namespace msg {
 
     select_in_queues.clear();
     for (int i = 0; i < (int)in_queues.size(); i++) {
-      if (in_queues[i]->is_suspended())
+      if (in_queues[i]->is_suspended() || in_queues[i]->is_throttled())
         continue;
       int fd = in_queues[i]->get_fd();
       if (fd < 0)
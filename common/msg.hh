@@ -49,8 +49,43 @@ namespace msg {
 
     M_DEBUG,		// gui -> rec
     M_MESSAGE,		// gui <- rec <- dec
+
+    M_SPECTRUM_ON,	// gui -> rec
+    M_SPECTRUM_OFF,	// gui -> rec
+    // Power spectrum of one frame from the fft module of the front end:
+    // 4 bytes frame, 4 bytes number of bins n, n * 2 bytes levels
+    // (little endian). Level is 0 for power < 1, otherwise
+    // 1 + 200 * log10(power) limited to spectrum_max_level.
+    M_SPECTRUM,		// gui <- rec
+
+    // beam float token_limit int
+    M_DECODER_STATUS,	// gui <- rec <- dec
+
+    // Search statistics of a run of frames, 4 bytes each (little endian):
+    // first frame, number of frames, microseconds in the search, longest
+    // search of a frame in microseconds, frames waiting in the decoder
+    // input, beam (float), token limit, words of the hypothesis not yet fixed.
+    M_DECODER_STATS,	// gui <- rec <- dec
+
+    // Turns the trace timestamps on.
+    M_TRACE_ON,		// gui -> rec -> dec
+    // "stage frame microseconds": monotonic time a stage finished the
+    // frame. Stages are features and scored (rec) and decoded (dec).
+    M_TRACE,		// gui <- rec <- dec
+
+    // Stop (or continue) sending audio, the recognizer has too much of it
+    // waiting.
+    M_AUDIO_HOLD,	// gui <- rec
+    M_AUDIO_RESUME,	// gui <- rec
+    // "sample samples": the recognizer dropped the samples of audio before
+    // its input sample, which is counted without the dropped audio.
+    M_AUDIO_DROPPED,	// gui <- rec
   };
 
+  const int spectrum_bins = 128;
+  const int spectrum_max_level = 4095;
+  const int decoder_stats_size = 32;
+
   const int header_size = 6;
 
   void set_non_blocking(int fd);
@@ -174,6 +209,14 @@ namespace msg {
       suspended = false;
     }
 
+    /** Stop (or continue) reading the queue for flow control. Works like
+     * suspending, but independently of it, so the sender blocks when the
+     * pipe is full. */
+    void mux_throttle(bool throttle)
+    {
+      throttled = throttle;
+    }
+
     /** Fetch message from the file descriptor and insert it to the
      * queue.  For non-blocking files the function may return before
      * complete messages are read.
@@ -192,12 +235,16 @@ namespace msg {
     /** Return the suspend status of the queue. */
     bool is_suspended() { return suspended; }
 
+    /** Return the throttle status of the queue. */
+    bool is_throttled() { return throttled; }
+
   private:
     std::string buffer;
     int bytes_got;
     int fd;
     bool eof;
     bool suspended; //!< If true, mux ignores the queue
+    bool throttled; //!< If true, mux ignores the queue for flow control
   };
 
   class OutQueue {
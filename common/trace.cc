@@ -0,0 +1,96 @@
+#include "trace.hh"
+
+namespace trace {
+
+  /** \return The text as a JSON string. */
+  static std::string
+  quote(const std::string &text)
+  {
+    std::string str = "\"";
+    for (std::string::size_type i = 0; i < text.size(); i++) {
+      if (text[i] == '"' || text[i] == '\\')
+        str += '\\';
+      if ((unsigned char)text[i] >= ' ')
+        str += text[i];
+    }
+    return str + "\"";
+  }
+
+  Writer::Writer()
+    : m_file(NULL), m_first(true)
+  {
+  }
+
+  Writer::~Writer()
+  {
+    this->close();
+  }
+
+  bool
+  Writer::open(const std::string &filename)
+  {
+    this->close();
+    m_file = fopen(filename.c_str(), "w");
+    if (m_file == NULL)
+      return false;
+    fputs("{\"traceEvents\":[", m_file);
+    m_first = true;
+    return true;
+  }
+
+  void
+  Writer::close()
+  {
+    if (m_file == NULL)
+      return;
+    fputs("\n]}\n", m_file);
+    fclose(m_file);
+    m_file = NULL;
+  }
+
+  void
+  Writer::begin_event()
+  {
+    fputs(m_first ? "\n" : ",\n", m_file);
+    m_first = false;
+  }
+
+  void
+  Writer::name_process(int pid, const std::string &name)
+  {
+    if (m_file == NULL)
+      return;
+    begin_event();
+    fprintf(m_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":%s}}", pid, quote(name).c_str());
+  }
+
+  void
+  Writer::name_thread(int pid, int tid, const std::string &name)
+  {
+    if (m_file == NULL)
+      return;
+    begin_event();
+    fprintf(m_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":%s}}", pid, tid,
+            quote(name).c_str());
+  }
+
+  void
+  Writer::span(const std::string &name, int pid, int tid, long long id,
+               long long begin, long long end)
+  {
+    if (m_file == NULL)
+      return;
+    std::string quoted = quote(name);
+    begin_event();
+    fprintf(m_file, "{\"name\":%s,\"cat\":\"latency\",\"ph\":\"b\","
+            "\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%lld,"
+            "\"args\":{\"id\":%lld}}", quoted.c_str(), id, pid, tid, begin, id);
+    begin_event();
+    fprintf(m_file, "{\"name\":%s,\"cat\":\"latency\",\"ph\":\"e\","
+            "\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%lld}",
+            quoted.c_str(), id, pid, tid, end);
+  }
+
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+/** Timestamps for tracing the latency of the recognition pipeline and a
+ * writer of the Chrome trace event format, which chrome://tracing and
+ * Perfetto show. The timestamps are microseconds of the monotonic clock,
+ * so the ones taken in the gui, the recognizer and the decoder can be
+ * compared when they run on the same computer. */
+namespace trace {
+
+  /** \return Microseconds of the monotonic clock. */
+  inline long long
+  now()
+  {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000LL + time.tv_nsec / 1000;
+  }
+
+  /** Writes trace events to a JSON file. Processes and threads are plain
+   * numbers named with metadata events. */
+  class Writer
+  {
+  public:
+
+    Writer();
+    ~Writer();
+
+    /** Creates the file and starts the event list.
+     * \param filename Path of the file.
+     * \return false if the file couldn't be created. */
+    bool open(const std::string &filename);
+    /** Ends the event list and closes the file. */
+    void close();
+    /** \return true if the file is open. */
+    inline bool is_open() const { return m_file != NULL; }
+
+    /** Names a process.
+     * \param pid Number of the process.
+     * \param name Name shown for it. */
+    void name_process(int pid, const std::string &name);
+    /** Names a thread.
+     * \param pid Number of the process.
+     * \param tid Number of the thread in the process.
+     * \param name Name shown for it. */
+    void name_thread(int pid, int tid, const std::string &name);
+
+    /** Writes a span as an asynchronous event, so spans of a thread may
+     * overlap. Spans with the same id are drawn on the same row.
+     * \param name Name of the span.
+     * \param pid Number of the process.
+     * \param tid Number of the thread.
+     * \param id Identifier of the span, also written as an argument.
+     * \param begin Start time in microseconds.
+     * \param end End time in microseconds. */
+    void span(const std::string &name, int pid, int tid, long long id,
+              long long begin, long long end);
+
+  private:
+
+    /** Starts a new event in the list. */
+    void begin_event();
+
+    FILE *m_file; //!< The trace file, NULL if not open.
+    bool m_first; //!< No event has been written.
+  };
+
+}
+
+#endif /* TRACE_HH */
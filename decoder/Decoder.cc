@@ -1,10 +1,28 @@
+#include <time.h>
+#include <algorithm>
 #include "Decoder.hh"
 #include "str.hh"
+#include "trace.hh"
+
+// Frames between adjustments of the adaptive pruning, 0.2 seconds.
+static const int adapt_interval = 25;
+// Factors the pruning is narrowed and widened by at an adjustment.
+static const float narrow_factor = 0.9;
+static const float widen_factor = 1.05;
+
+static double
+get_seconds()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
 
 Decoder::Decoder(const char * hmm_path, const char * dur_path)
   : t(hmm_path, dur_path),
     paused(false),
     adaptation(false),
+    tracing(false),
     last_guaranteed_history(NULL)
 {
 }
@@ -28,10 +46,22 @@ Decoder::init(aku::conf::Config &config)
   
   t.set_print_text_result(0);
   
-  t.set_global_beam(config["beam"].get_float());
+  load.enabled = config["adaptive-pruning"].specified;
+  load.frame_budget = config["frame-budget"].get_float() / 1000;
+  load.max_backlog = config["max-backlog"].get_int();
+  load.min_scale = config["min-pruning"].get_float();
+  load.base_beam = load.beam = config["beam"].get_float();
+  load.base_token_limit = load.token_limit = config["token-limit"].get_int();
+  load.frame_time = 0;
+  load.frames = 0;
+
+  stats.interval = config["stats-interval"].get_int();
+  stats.frames = 0;
+
+  t.set_global_beam(load.beam);
   
   
-  t.set_token_limit(config["token-limit"].get_int());
+  t.set_token_limit(load.token_limit);
   t.set_prune_similar(3);
   
   t.set_duration_scale(1);
@@ -155,11 +185,110 @@ Decoder::message_result(bool send_all)
   out_queue.flush();
 }
 
+void
+Decoder::set_pruning(float beam, int token_limit)
+{
+  t.set_global_beam(beam);
+  t.set_token_limit(token_limit);
+  load.beam = beam;
+  load.token_limit = token_limit;
+
+  msg::Message message(msg::M_DECODER_STATUS);
+  message.append(str::fmt(64, "beam %g token_limit %d", beam, token_limit));
+  out_queue.queue.push_back(message);
+  out_queue.flush();
+}
+
+int
+Decoder::waiting_frames()
+{
+  int frames = 0;
+  for (std::deque<msg::Message>::iterator it = in_queue.queue.begin();
+       it != in_queue.queue.end(); ++it)
+  {
+    if (it->type() == msg::M_PROBS)
+      frames++;
+  }
+  return frames;
+}
+
+void
+Decoder::add_stats(double seconds)
+{
+  if (stats.frames == 0) {
+    stats.first_frame = frame - 1;
+    stats.total_time = stats.max_time = 0;
+  }
+  stats.frames++;
+  stats.total_time += seconds;
+  if (seconds > stats.max_time)
+    stats.max_time = seconds;
+  if (stats.frames >= stats.interval)
+    send_stats();
+}
+
+void
+Decoder::send_stats()
+{
+  if (stats.frames == 0)
+    return;
+
+  std::string buf(msg::decoder_stats_size, 0);
+  endian::put4(stats.first_frame, &buf[0]);
+  endian::put4(stats.frames, &buf[4]);
+  endian::put4((int)(stats.total_time * 1e6), &buf[8]);
+  endian::put4((int)(stats.max_time * 1e6), &buf[12]);
+  endian::put4(waiting_frames(), &buf[16]);
+  endian::put4(load.beam, &buf[20]);
+  endian::put4(load.token_limit, &buf[24]);
+  endian::put4((int)hist_vec.size(), &buf[28]);
+
+  msg::Message message(msg::M_DECODER_STATS);
+  message.append(buf);
+  out_queue.queue.push_back(message);
+  out_queue.flush();
+  stats.frames = 0;
+}
+
+void
+Decoder::adapt_pruning(double seconds)
+{
+  load.frame_time += 0.1 * (seconds - load.frame_time);
+  if (++load.frames < adapt_interval)
+    return;
+  load.frames = 0;
+
+  int backlog = waiting_frames();
+  float beam = load.beam;
+  int token_limit = load.token_limit;
+  if (load.frame_time > load.frame_budget || backlog > load.max_backlog) {
+    beam = std::max(beam * narrow_factor, load.base_beam * load.min_scale);
+    token_limit = std::max((int)(token_limit * narrow_factor),
+                           (int)(load.base_token_limit * load.min_scale));
+  }
+  else if (load.frame_time < load.frame_budget / 2 &&
+           backlog <= load.max_backlog / 4)
+  {
+    beam = std::min(beam * widen_factor, load.base_beam);
+    token_limit = std::min((int)(token_limit * widen_factor) + 1,
+                           load.base_token_limit);
+  }
+
+  if (beam != load.beam || token_limit != load.token_limit) {
+    if (verbose)
+      fprintf(stderr, "decoder: %.2f ms per frame, %d frames waiting, "
+              "beam %g token limit %d\n", load.frame_time * 1000, backlog,
+              beam, token_limit);
+    set_pruning(beam, token_limit);
+  }
+}
+
 void
 Decoder::reset()
 {
   t.reset(0);
   frame = 0;
+  stats.frames = 0;
   paused = false;
   last_guaranteed_history = NULL;
 }
@@ -169,6 +298,7 @@ Decoder::run()
 {
   out_queue.queue.push_back(msg::Message(msg::M_READY));
   out_queue.flush();
+  set_pruning(load.beam, load.token_limit);
 
   std::vector<float> log_probs;
   std::vector<std::string> fields;
@@ -216,15 +346,27 @@ Decoder::run()
       t.set_one_frame(frame, log_probs);
       if (verbose)
         fprintf(stderr, "decoder: processing frame %d\n", frame);
+      double start = get_seconds();
       bool ret = t.run();
+      double seconds = get_seconds() - start;
       if (verbose)
         fprintf(stderr, "decoder: frame %d processed\n", frame);
+      if (load.enabled)
+        adapt_pruning(seconds);
 
       assert(ret);
+      if (tracing) {
+        msg::Message trace_message(msg::M_TRACE);
+        trace_message.append(str::fmt(64, "decoded %d %lld", frame,
+                                      trace::now()));
+        out_queue.queue.push_back(trace_message);
+      }
       frame++;
       assert(t.frame() == frame);
 
       message_result(false);
+      if (stats.interval > 0)
+        add_stats(seconds);
     }
 
     // "End of acoustics" message
@@ -244,6 +386,7 @@ Decoder::run()
         assert(!ret);
 
         message_result(true);
+        send_stats();
         if (adaptation)
           send_state_history();
       }
@@ -272,7 +415,9 @@ Decoder::run()
           if (fields.size() != 2)
             fprintf(stderr, "decoder: invalid beam setting message\n");
           float beam = str::str2float(fields[1]);
-          t.set_global_beam(beam);
+          // The adaptive pruning narrows from the new beam.
+          load.base_beam = beam;
+          set_pruning(beam, load.token_limit);
           fprintf(stderr, "decoder: set beam to %g\n", beam);
         }
 
@@ -287,6 +432,9 @@ Decoder::run()
       }
     }
 
+    else if (message.type() == msg::M_TRACE_ON)
+      tracing = true;
+
     else if (message.type() == msg::M_RESET) {
       if (verbose)
         fprintf(stderr, "decoder: got RESET\n");
@@ -14,6 +14,11 @@ public:
   void run();
   void send_state_history();
   void message_result(bool send_all);
+  void set_pruning(float beam, int token_limit);
+  void adapt_pruning(double seconds);
+  int waiting_frames();
+  void add_stats(double seconds);
+  void send_stats();
 
   bool verbose;
   Toolbox t;
@@ -23,8 +28,35 @@ public:
   int frame;
   bool paused;
   bool adaptation;
+  bool tracing; // Send the time each frame is decoded.
 
   LMHistory *last_guaranteed_history;
+
+  // Load-adaptive pruning. The beam and the token limit are narrowed when
+  // the search is slower than the budget or frames pile up in the input,
+  // and widened back towards the base values when there is headroom.
+  struct {
+    bool enabled;
+    double frame_budget; // Seconds of search per frame.
+    int max_backlog; // Frames waiting in the input.
+    float min_scale; // Smallest fraction of the base values.
+    float base_beam;
+    int base_token_limit;
+    float beam;
+    int token_limit;
+    double frame_time; // Moving average of the search time per frame.
+    int frames; // Frames since the last adjustment.
+  } load;
+
+  // Search statistics sent in a DECODER_STATS message every interval
+  // frames, if interval is positive.
+  struct {
+    int interval;
+    int first_frame;
+    int frames; // Frames collected since the last message.
+    double total_time; // Seconds in the search.
+    double max_time; // Longest search of a frame.
+  } stats;
 };
 
 #endif /* DECODER_HH */
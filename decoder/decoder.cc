@@ -25,6 +25,16 @@ main(int argc, char *argv[])
        "token-limit pruning (default 30000)")
       ('\0', "beam=FLOAT", "arg", "200", 
        "beam pruning (default 200)")
+      ('\0', "adaptive-pruning", "", "", 
+       "narrow the beam and token limit when falling behind real time")
+      ('\0', "frame-budget=FLOAT", "arg", "6", 
+       "search milliseconds per frame the adaptive pruning aims at (default 6)")
+      ('\0', "max-backlog=INT", "arg", "25", 
+       "frames waiting before the adaptive pruning narrows (default 25)")
+      ('\0', "min-pruning=FLOAT", "arg", "0.5", 
+       "smallest fraction of the beam and token limit used (default 0.5)")
+      ('\0', "stats-interval=INT", "arg", "0", 
+       "send search statistics every INT frames (default 0, never)")
       ;
 
     config.default_parse(argc, argv);
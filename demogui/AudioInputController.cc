@@ -1,13 +1,50 @@
 
+#include <string.h>
+#include <time.h>
 #include "AudioInputController.hh"
 
+namespace audio {
+float audio_forward_period = 0.01;
+bool audio_fast_forward = false;
+}
+
+// The input buffer doesn't grow beyond this (seconds).
+static const float max_input_buffer_length = 60;
+// Audio read from a file in one forwarding round (seconds). Even long files
+// are read in a few seconds, but a round stays short.
+static const float file_block_length = 10;
+// No audio is added to the out queue while it has this many messages. The
+// queue is flushed without blocking, so a recognizer that doesn't read its
+// input keeps the queue from emptying, and the audio waits in the audio data
+// instead, like it does when the recognizer holds the audio. Fast forwarding
+// fills the queue up to this in one round.
+static const unsigned int max_queued_messages = 8;
+
 AudioInputController::AudioInputController(msg::OutQueue *out_queue)
-  : m_out_queue(out_queue),
-    m_playback_buffer(32000),
-    m_output_buffer(48000),
-    m_input_buffer(48000),
-    m_mode(RECORD)
+  : m_file_pending(false),
+    m_out_queue(out_queue),
+    m_trace(NULL),
+    m_audio_held(false),
+    m_mode(RECORD),
+    m_stop(false),
+    m_broken_pipe(false)
 {
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&this->m_lock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+  this->m_thread_created = false;
+  this->m_forwarding_enabled = true;
+
+  unsigned long buffer_size =
+    (unsigned long)(audio::audio_buffer_length * audio::audio_sample_rate);
+  this->m_playback_buffer = new AudioBuffer(buffer_size);
+  this->m_output_buffer = new AudioBuffer(buffer_size);
+  this->m_input_buffer = new AudioBuffer(buffer_size);
+  memset(&this->m_statistics, 0, sizeof(this->m_statistics));
+  memset(&this->m_stream_statistics, 0, sizeof(this->m_stream_statistics));
+
   this->m_recognizer_cursor = 0;
   this->m_output_cursor = 0;
   
@@ -22,37 +59,197 @@ AudioInputController::AudioInputController(msg::OutQueue *out_queue)
   this->m_playback_played = 0;
 }
 
+AudioInputController::~AudioInputController()
+{
+  if (this->m_thread_created)
+    this->stop_forwarding();
+  pthread_mutex_destroy(&this->m_lock);
+  delete this->m_playback_buffer;
+  delete this->m_output_buffer;
+  delete this->m_input_buffer;
+}
+
 bool
 AudioInputController::initialize()
 {
+  bool ok = false;
+  this->lock();
   if (!this->m_audio_stream.open(true, true, false)) {
     fprintf(stderr, "Failed to open audio stream.\n");
-    return false;
   }
-  if (!this->m_audio_stream.start()) {
+  else if (!this->m_audio_stream.start()) {
     fprintf(stderr, "AIC initialization failed to start audio stream.\n");
-    return false;
   }
-  return true;
+  else {
+    ok = true;
+  }
+  this->unlock();
+  return ok;
 }
 
 void
 AudioInputController::terminate()
 {
+  this->lock();
   this->m_audio_stream.close();
+  this->unlock();
+}
+
+bool
+AudioInputController::restart_stream()
+{
+  bool ok;
+  this->lock();
+  this->terminate();
+  // Counters of the new stream start from zero.
+  memset(&this->m_stream_statistics, 0, sizeof(this->m_stream_statistics));
+  ok = this->initialize();
+  this->unlock();
+  return ok;
 }
 
 bool
 AudioInputController::load_file(const std::string &filename)
 {
-  if (!audio::read_wav_data(filename, this->m_audio_data)) {
+  bool ok = false;
+  this->lock();
+  if (!this->m_file_reader.open(filename)) {
     fprintf(stderr, "AudioFileInputController::load_file failed.\n");
+  }
+  else {
+    this->m_audio_data.clear();
+    this->m_wave_summary.clear();
+    this->m_file_pending = true;
+    this->reset_cursors();
+    // The first block now, so the audio isn't empty until the next round.
+    this->read_file();
+    ok = true;
+  }
+  this->unlock();
+  return ok;
+}
+
+void
+AudioInputController::read_file()
+{
+  if (!this->m_file_reader.is_open())
+    return;
+
+  unsigned long frames =
+    (unsigned long)(file_block_length * audio::audio_sample_rate);
+  if (this->m_file_reader.read(this->m_audio_data, frames) > 0)
+    this->m_wave_summary.update(this->get_audio_data(),
+                                this->get_audio_data_size());
+  this->m_file_pending = this->m_file_reader.is_open();
+}
+
+bool
+AudioInputController::start_forwarding()
+{
+  this->m_broken_pipe = false;
+  if (this->m_thread_created) {
+    fprintf(stderr, "Can't create thread for audio: thread already created.\n");
     return false;
   }
-  this->reset_cursors();
+
+  this->m_stop = false;
+
+  if (pthread_create(&this->m_thread, NULL,
+                     AudioInputController::forwarding_callback, this) != 0) {
+    fprintf(stderr, "Couldn't create thread for audio.\n");
+    return false;
+  }
+
+  this->m_thread_created = true;
   return true;
 }
 
+void
+AudioInputController::stop_forwarding()
+{
+  if (this->m_thread_created) {
+    this->m_stop = true;
+    pthread_join(this->m_thread, NULL);
+    this->m_thread_created = false;
+  }
+  else {
+    fprintf(stderr, "Warning: Trying to join thread that is not created "
+                    "in AIC::stop_forwarding.\n");
+  }
+}
+
+void
+AudioInputController::enable_forwarding()
+{
+  this->lock();
+  this->m_forwarding_enabled = true;
+  this->unlock();
+}
+
+void
+AudioInputController::disable_forwarding()
+{
+  this->lock();
+  this->m_forwarding_enabled = false;
+  this->unlock();
+}
+
+void*
+AudioInputController::forwarding_callback(void *user_data)
+{
+  AudioInputController *object = (AudioInputController*)user_data;
+  object->run_forwarding();
+  return NULL;
+}
+
+void
+AudioInputController::run_forwarding()
+{
+  struct timespec next, now;
+  long period = (long)(audio::audio_forward_period * 1e9);
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!this->m_stop) {
+    this->lock();
+    if (this->m_forwarding_enabled && !this->m_broken_pipe) {
+      this->operate();
+      try {
+        if (this->m_out_queue)
+          this->m_out_queue->flush();
+      }
+      catch (msg::ExceptionBrokenPipe exception) {
+        fprintf(stderr, "AudioInputController got broken pipe when "
+                        "flushing.\n");
+        // Raise flag, the gui handles the broken pipe.
+        this->m_broken_pipe = true;
+      }
+    }
+    this->unlock();
+
+    // Sleep until the next round. Absolute times keep the period steady. If
+    // we are late, don't try to catch up with a burst of rounds.
+    next.tv_nsec += period;
+    while (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > next.tv_sec ||
+        (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+      next = now;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0 &&
+           !this->m_stop) { }
+  }
+}
+
+void
+AudioInputController::get_statistics(AudioStream::Statistics &statistics) const
+{
+  this->lock();
+  statistics = this->m_statistics;
+  this->unlock();
+}
+
 
 unsigned long
 AudioInputController::operate()
@@ -61,6 +258,20 @@ AudioInputController::operate()
   const char *audio_data;
   unsigned long read_size = 0;
 
+  this->lock();
+
+  // Continue reading the loaded audio file.
+  this->read_file();
+
+  // Underruns only matter if we had audio left to give.
+  if (this->m_playback)
+    this->check_statistics(this->m_playback_from + this->m_playback_played
+                           < this->get_audio_data_size());
+  else
+    this->check_statistics(this->m_mode == PLAY && !this->m_paused &&
+                           !this->is_fast_forwarding() &&
+                           this->m_output_cursor < this->get_audio_data_size());
+
   // Do playback if playback is requested.  
   if (this->m_playback) {
     unsigned long write_size;
@@ -75,10 +286,10 @@ AudioInputController::operate()
       if (this->m_playback_length < max_size)
         write_size = this->m_playback_length;
     }
-    this->m_playback_played += this->m_playback_buffer.write(this->get_audio_data() + this->m_playback_from + this->m_playback_played,
+    this->m_playback_played += this->m_playback_buffer->write(this->get_audio_data() + this->m_playback_from + this->m_playback_played,
                                                            write_size - this->m_playback_played);
 
-    if (this->m_playback_buffer.get_frames_read() >= write_size) {
+    if (this->m_playback_buffer->get_frames_read() >= write_size) {
       this->stop_playback();
     }
                                                            
@@ -86,108 +297,154 @@ AudioInputController::operate()
   
   // Read microphone input or put audio to output.
   this->read_input();
-  read_size = this->get_audio_cursor() - this->m_recognizer_cursor;
+  if (this->m_audio_held || (this->m_out_queue &&
+      this->m_out_queue->queue.size() >= max_queued_messages)) {
+    // The recognizer doesn't keep up, let the audio wait.
+    read_size = 0;
+  }
+  else if (this->is_fast_forwarding()) {
+    // All the audio is available when not paused, as much is sent as the
+    // recognizer has taken.
+    if (this->m_paused || !this->m_out_queue)
+      read_size = 0;
+    else
+      read_size = this->get_audio_data_size() - this->m_recognizer_cursor;
+  }
+  else {
+    read_size = this->get_audio_cursor() - this->m_recognizer_cursor;
+  }
+
+  // Without a device the audio is captured when it is sent.
+  long long capture_time = 0;
+  if (this->m_trace && this->m_trace->is_open())
+    capture_time = this->is_fast_forwarding() ? trace::now() :
+      this->m_audio_stream.get_callback_time();
 
-  if (this->m_out_queue) {
-    // Send audio in max 6000 frame messages.
-    if (read_size > 6000)
-      read_size = 6000;
+  unsigned long total_size = 0;
+  do {
+    unsigned long size = read_size;
+    if (this->m_out_queue) {
+      // Send audio in max 6000 frame messages.
+      if (size > 6000)
+        size = 6000;
         
-    if (read_size) {
-      // Clear previous audio data and make message of the new data.
-      message.clear_data();
-      // Write new data.
-      audio_data = this->m_audio_data.data();
-      message.append(&audio_data[this->m_recognizer_cursor*sizeof(AUDIO_FORMAT)],
-                     read_size * sizeof(AUDIO_FORMAT));
-
-      // Send message to out queue. (do not flush)
-      this->m_out_queue->add_message(message);
+      if (size) {
+        // Clear previous audio data and make message of the new data.
+        message.clear_data();
+        // Write new data.
+        audio_data = this->m_audio_data.data();
+        message.append(&audio_data[this->m_recognizer_cursor*sizeof(AUDIO_FORMAT)],
+                       size * sizeof(AUDIO_FORMAT));
+
+        // Send message to out queue. (do not flush)
+        this->m_out_queue->add_message(message);
+        if (capture_time)
+          this->m_trace->audio_sent(this->m_recognizer_cursor, size,
+                                    capture_time);
+      }
     }
-  }
 
-  this->m_recognizer_cursor += read_size;
-  return read_size;
+    this->m_recognizer_cursor += size;
+    total_size += size;
+    read_size -= size;
+    // Only fast forwarding sends more than one message in a round.
+  } while (read_size && this->is_fast_forwarding() &&
+           this->m_out_queue->queue.size() < max_queued_messages);
+
+  this->unlock();
+  return total_size;
 }
 
 void
 AudioInputController::set_mode(Mode mode)
 {
+  this->lock();
   this->m_mode = mode;
   this->pause_listening(this->m_paused);
+  this->unlock();
 }
 
 void
 AudioInputController::set_mute(bool mute)
 {
+  this->lock();
   if (mute) {
     this->m_audio_stream.set_output_buffer(NULL);
   }
   else {
     if (this->m_paused)
-      this->m_audio_stream.set_output_buffer(&this->m_playback_buffer);
+      this->m_audio_stream.set_output_buffer(this->m_playback_buffer);
     else
-      this->m_audio_stream.set_output_buffer(&this->m_output_buffer);
+      this->m_audio_stream.set_output_buffer(this->m_output_buffer);
   }
   this->m_mute = mute;
+  this->unlock();
 }
 
 
 void
 AudioInputController::pause_listening(bool pause)
 {
+  this->lock();
   if (pause) {
     this->m_audio_stream.set_input_buffer(NULL);
     if (!this->m_mute)
-      this->m_audio_stream.set_output_buffer(&this->m_playback_buffer);
+      this->m_audio_stream.set_output_buffer(this->m_playback_buffer);
   }
   else {
     if (this->m_mode == PLAY) {
       this->m_audio_stream.set_input_buffer(NULL);
       if (!this->m_mute)
-        this->m_audio_stream.set_output_buffer(&this->m_output_buffer);
+        this->m_audio_stream.set_output_buffer(this->m_output_buffer);
     }
     else { // this->m_mode == RECORD
-      this->m_audio_stream.set_input_buffer(&this->m_input_buffer);
+      this->m_audio_stream.set_input_buffer(this->m_input_buffer);
       this->m_audio_stream.set_output_buffer(NULL);
     }
     this->stop_playback();
   }
 
   this->m_paused = pause;
+  this->unlock();
 }
 
 bool
 AudioInputController::start_playback(unsigned long from, unsigned long length)
 {
+  bool started = false;
+  this->lock();
   // Start playback only if paused and not already playbacking.
   if (this->m_paused && !this->m_playback) {
-    this->m_playback = true;
     this->m_playback_from = from;
     this->m_playback_length = length;
     this->m_playback_played = 0;
-    return true;
+    this->m_playback = true;
+    started = true;
   }
-  return false;
+  this->unlock();
+  return started;
 }
 
 void
 AudioInputController::stop_playback()
 {
-  if (this->m_audio_stream.get_output_buffer() == &this->m_playback_buffer) {
+  this->lock();
+  if (this->m_audio_stream.get_output_buffer() == this->m_playback_buffer) {
     this->m_audio_stream.set_output_buffer(NULL);
-    this->m_playback_buffer.clear();
-    this->m_audio_stream.set_output_buffer(&this->m_playback_buffer);
+    this->m_playback_buffer->clear();
+    this->m_audio_stream.set_output_buffer(this->m_playback_buffer);
   }
   else {
-    this->m_playback_buffer.clear();
+    this->m_playback_buffer->clear();
   }
   this->m_playback = false;
+  this->unlock();
 }
 
 void
 AudioInputController::reset()
 {
+  this->lock();
   // These are for thread safety.
   AudioBuffer *input_buffer = this->m_audio_stream.get_input_buffer();
   AudioBuffer *output_buffer = this->m_audio_stream.get_output_buffer();
@@ -195,21 +452,26 @@ AudioInputController::reset()
   this->m_audio_stream.set_output_buffer(NULL);
 
   // Resetting.
+  this->m_file_reader.close();
+  this->m_file_pending = false;
   this->m_audio_data.clear();
+  this->m_wave_summary.clear();
   this->m_playback_length = 0;
   this->m_playback_played = 0;
   this->m_playback = false;
-  this->m_playback_buffer.clear();
+  this->m_playback_buffer->clear();
   this->reset_cursors();
 
   // ... for thread safety
   this->m_audio_stream.set_input_buffer(input_buffer);
   this->m_audio_stream.set_output_buffer(output_buffer);
+  this->unlock();
 }
 
 void
 AudioInputController::reset_cursors()
 {
+  this->lock();
   // These are for thread safety.
   AudioBuffer *input_buffer = this->m_audio_stream.get_input_buffer();
   AudioBuffer *output_buffer = this->m_audio_stream.get_output_buffer();
@@ -217,12 +479,97 @@ AudioInputController::reset_cursors()
   this->m_audio_stream.set_output_buffer(NULL);
 
   // Resetting.
-  this->m_input_buffer.clear();
-  this->m_output_buffer.clear();
+  this->m_input_buffer->clear();
+  this->m_output_buffer->clear();
   this->m_output_cursor = 0;
   this->m_recognizer_cursor = 0;
+  // The recognizer lets go of the audio of the reset utterance.
+  this->m_audio_held = false;
 
   // ... for thread safety
   this->m_audio_stream.set_input_buffer(input_buffer);
   this->m_audio_stream.set_output_buffer(output_buffer);
+  this->unlock();
+}
+
+void
+AudioInputController::grow_input_buffer()
+{
+  unsigned long max_size =
+    (unsigned long)(max_input_buffer_length * audio::audio_sample_rate);
+  AudioBuffer *old_buffer = this->m_input_buffer;
+  AudioBuffer *new_buffer;
+  AUDIO_FORMAT *to;
+  unsigned long frames;
+
+  if (old_buffer->get_size() >= max_size)
+    return;
+
+  new_buffer = new AudioBuffer(old_buffer->get_size() * 2);
+  fprintf(stderr, "Warning: Audio input is not read fast enough, "
+          "growing input buffer to %lu samples.\n", new_buffer->get_size());
+
+  // Attach the new buffer first, so the stream doesn't drop audio while we
+  // empty the old one. The old buffer has the older audio, read it first.
+  if (this->m_audio_stream.get_input_buffer() == old_buffer)
+    this->m_audio_stream.set_input_buffer(new_buffer);
+  this->m_input_buffer = new_buffer;
+
+  frames = old_buffer->get_size();
+  to = (AUDIO_FORMAT*)this->m_audio_data.reserve(frames * sizeof(AUDIO_FORMAT));
+  if (to) {
+    frames = old_buffer->read(to, frames);
+    this->m_audio_data.commit(frames * sizeof(AUDIO_FORMAT));
+    this->m_wave_summary.update(this->get_audio_data(),
+                                this->get_audio_data_size());
+  }
+  delete old_buffer;
+}
+
+void
+AudioInputController::check_statistics(bool output_pending)
+{
+  AudioStream::Statistics current;
+  AudioStream::Statistics &last = this->m_stream_statistics;
+  unsigned long count;
+
+  this->m_audio_stream.get_statistics(current);
+
+  if (current.dropped_input_frames != last.dropped_input_frames) {
+    count = current.dropped_input_frames - last.dropped_input_frames;
+    this->m_statistics.dropped_input_frames += count;
+    fprintf(stderr, "Warning: Audio input buffer full, lost %lu samples.\n",
+            count);
+  }
+  if (current.input_overflows != last.input_overflows) {
+    count = current.input_overflows - last.input_overflows;
+    this->m_statistics.input_overflows += count;
+    fprintf(stderr, "Warning: Audio device lost input %lu times.\n", count);
+  }
+  if (current.output_underflows != last.output_underflows) {
+    count = current.output_underflows - last.output_underflows;
+    this->m_statistics.output_underflows += count;
+  }
+  if (current.output_underruns != last.output_underruns && output_pending) {
+    count = current.output_underruns - last.output_underruns;
+    this->m_statistics.output_underruns += count;
+    fprintf(stderr, "Warning: Audio output buffer ran empty %lu times.\n",
+            count);
+  }
+  if (current.max_jitter > this->m_statistics.max_jitter) {
+    this->m_statistics.max_jitter = current.max_jitter;
+    // Only log jitter bigger than 10 ms.
+    if (current.max_jitter > 10000)
+      fprintf(stderr, "Audio callback jitter now up to %.1f ms.\n",
+              current.max_jitter / 1000.0);
+  }
+  if (current.callback_frames != last.callback_frames) {
+    fprintf(stderr, "Audio callback size %lu samples (%.1f ms).\n",
+            current.callback_frames,
+            current.callback_frames * 1000.0 /
+            this->m_audio_stream.get_device_rate());
+  }
+  this->m_statistics.callback_period = current.callback_period;
+  this->m_statistics.callback_frames = current.callback_frames;
+  last = current;
 }
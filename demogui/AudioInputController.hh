@@ -3,12 +3,32 @@
 #define AUDIOINPUTCONTROLLER_HH_
 
 #include <string>
+#include <atomic>
+#include <pthread.h>
 #include "AudioStream.hh"
+#include "LatencyTrace.hh"
+#include "MappedStore.hh"
+#include "WaveSummary.hh"
 #include "msg.hh"
 
+namespace audio
+{
+  /** Time between audio forwarding rounds in seconds. */
+  extern float audio_forward_period;
+  /** In PLAY mode, forward the audio to the recognizer as fast as it takes
+   * it instead of at the playback speed. The audio isn't played then. */
+  extern bool audio_fast_forward;
+};
+
 /**
  * Class for handling operations between audio stream and out queue (pipe to
  * recognizer). Stores the whole audio data.
+ *
+ * Audio is forwarded in an own thread every audio::audio_forward_period
+ * seconds, so sending audio to the recognizer doesn't wait for the gui to
+ * draw. The out queue is shared with the gui, so lock() the controller when
+ * adding messages to the queue or flushing it. The public functions lock
+ * the controller themselves.
  */
 class AudioInputController
 {
@@ -16,9 +36,11 @@ public:
 
   enum Mode { RECORD, PLAY };
 
-  /** Reads the audio data from an audio file into own audio data array.
+  /** Opens an audio file to replace the audio data. The file is read in
+   * blocks by the forwarding thread, so the audio grows like when recording
+   * but much faster, and the recognition can start right away.
    * \param filename Audio file to read.
-   * \return false if failed to read the file. */  
+   * \return false if failed to open the file. */  
   bool load_file(const std::string &filename);
 
   /** Set mode. */  
@@ -27,23 +49,61 @@ public:
   /** \param mute When mute is set to true, no output is played whatsoever. */
   void set_mute(bool mute);
 
+  /** \param trace Audio sent to the recognizer is traced here. NULL stops
+   *              tracing. */
+  inline void set_latency_trace(LatencyTrace *trace);
+
+  /** Stops (or continues) sending audio to the recognizer. The recognizer
+   * asks this when it has too much audio waiting. The audio waits in the
+   * audio data meanwhile. Can be called from any thread.
+   * \param hold True to stop sending, false to continue. */
+  inline void hold_audio(bool hold);
+
   /** Constructs an audio input controller.
    * \param out_queue The out queue which the audio messages should be sent
    *                  to. */
   AudioInputController(msg::OutQueue *out_queue);
   
   /** Destructs the controller. */
-  virtual ~AudioInputController() { }
+  virtual ~AudioInputController();
 
   /** Creates audio stream.
    * \return false if failed to activate the audio stream for some reason. */
   bool initialize();
   /** Closes the audio stream. */
   void terminate();
+  /** Closes and opens the audio stream again, e.g. to use new audio
+   * settings. Buffers stay attached.
+   * \return false if failed to activate the audio stream. */
+  bool restart_stream();
 
-  /** Reads new audio input and sends it as messages to out queue.
+  /** Reads new audio input and sends it as messages to out queue. Called by
+   * the forwarding thread, no need to call it elsewhere.
    * \return The amount of audio samples sent to out queue. */
   unsigned long operate();
+
+  /** Starts a new thread which calls operate and flushes the out queue
+   * periodically.
+   * \return false if thread already active or thread creation failed. */
+  bool start_forwarding();
+  /** Stops the forwarding thread. When function returns, you can be sure
+   * that the thread has really finished. */
+  void stop_forwarding();
+  /** Enables forwarding. */
+  void enable_forwarding();
+  /** Disables forwarding. When the function returns, you can be sure that
+   * the thread doesn't touch the audio or the out queue anymore. */
+  void disable_forwarding();
+  /** If flushing the out queue fails in the forwarding thread this flag is
+   * raised. Should be checked often.
+   * \return true if out queue has a broken pipe. */
+  inline bool is_broken_pipe() const;
+
+  /** Locks the controller. Needed when using the out queue from another
+   * thread. Can be locked several times by the same thread. */
+  inline void lock() const;
+  /** Unlocks the controller. */
+  inline void unlock() const;
   /** Pauses (or unpauses) audio input reading. Only in paused state is playback
    * allowed.
    * \param pause True for pause, false for unpause. */
@@ -68,10 +128,14 @@ public:
   /** Resets cursors thus starting to send audio messages from the beginning. */
   virtual void reset_cursors();
 
-  /** \return Audio samples (=audio data) as an array. */
+  /** \return Audio samples (=audio data) as an array. The array doesn't move
+   * when more audio is recorded. */
   inline const AUDIO_FORMAT* get_audio_data() const;
   /** \return The amount of audio samples (=size of audio data array). */
   inline unsigned long get_audio_data_size() const;
+  /** \return Minimum and maximum summary of the audio data. Updated when
+   * audio is added. */
+  inline const WaveSummary& get_wave_summary() const;
 
   /** \return The amount of audio frames sent to out queue. */
   inline unsigned long get_read_cursor() const;
@@ -79,23 +143,60 @@ public:
   inline unsigned long get_audio_cursor() const;
   
   inline bool is_eof() const;
+
+  /** \param statistics Audio problems counted so far are copied here.
+   * Output underruns at the end of the audio are not counted. */
+  void get_statistics(AudioStream::Statistics &statistics) const;
+  /** \return Current size of the input buffer in samples. */
+  inline unsigned long get_input_buffer_size() const;
+  /** \return Input latency of the audio stream in seconds. */
+  inline double get_input_latency() const;
   
 protected:
 
   /** Reads audio samples from some source. */
   inline void read_input();
+  /** \return true if the audio goes to the recognizer without playing. */
+  inline bool is_fast_forwarding() const;
+  /** Appends the next block of the loaded audio file to the audio data. */
+  void read_file();
   
+  /** Replaces the input buffer with a bigger one. Called when the buffer
+   * fills too much between reads, so no microphone audio is lost. */
+  void grow_input_buffer();
+  /** Reads the counters of the audio stream and logs the changes.
+   * \param output_pending true if there is audio data waiting to be written
+   *                       to the output buffer. Underruns are counted only
+   *                       then. */
+  void check_statistics(bool output_pending);
+
+  /** Callback function for the pthread.
+   * \param user_data this pointer to the object itself.
+   * \return Return value of the thread, we use NULL. */
+  static void* forwarding_callback(void *user_data);
+  /** Loop of the forwarding thread. */
+  void run_forwarding();
+
   /** Opens an audio stream. Opens both input and output streams (no matter
    * used or not) because it seemed to fix the audio delay bug.
    * \return False if failed for some reason. */
   bool open_stream();
   
-  /** Audio samples stored as a string. Remember to type cast the array
-   * into AUDIO_FORMAT array when modifying/reading samples. */
-  std::string m_audio_data;
+  /** Audio samples stored in a memory mapped file. Remember to type cast the
+   * array into AUDIO_FORMAT array when modifying/reading samples. */
+  MappedStore m_audio_data;
+  /** Min/max summary of m_audio_data for drawing the wave. */
+  WaveSummary m_wave_summary;
+  /** Audio file which is still being read into m_audio_data. */
+  audio::FileReader m_file_reader;
+  /** The audio file hasn't been read to the end. Read without locking. */
+  std::atomic<bool> m_file_pending;
   
   /** Out queue which the audio messages are sent to. */
   msg::OutQueue *m_out_queue;
+  LatencyTrace *m_trace; //!< Trace of the sent audio, or NULL.
+  /** The recognizer has asked to hold the audio. Read without locking. */
+  std::atomic<bool> m_audio_held;
   
   /** Audio stream. */
   AudioStream m_audio_stream;
@@ -103,38 +204,73 @@ protected:
 private:
 
   /** Index of the last audio sample sent as an audio message. */
-  unsigned long m_recognizer_cursor;
+  std::atomic<unsigned long> m_recognizer_cursor;
   /** Cursor for output in PLAY-mode. Tells how much audio has been written
    * to output buffer. Note that it doesn't mean that it all has played yet! */
   unsigned long m_output_cursor;
 
   // Variables for playback.
-  AudioBuffer m_playback_buffer; //!< Audio output buffer for playback.
-  bool m_playback; //!< Tells if we are playing playback.
+  AudioBuffer *m_playback_buffer; //!< Audio output buffer for playback.
+  std::atomic<bool> m_playback; //!< Tells if we are playing playback.
   unsigned long m_playback_from; //!< Index of the sample to start playback.
   unsigned long m_playback_length; //!< Number of samples to playback.
   unsigned long m_playback_played; //!< Samples written to output buffer.
 
-  AudioBuffer m_output_buffer; //!< Audio output buffer for recognition.
-  AudioBuffer m_input_buffer; //!< Audio input buffer for recognition.
+  AudioBuffer *m_output_buffer; //!< Audio output buffer for recognition.
+  AudioBuffer *m_input_buffer; //!< Audio input buffer for recognition.
   Mode m_mode; //!< Mode: play or record (microphone).
 
   bool m_paused; //!< When paused, only playback may be played.
   bool m_mute; //!< When muted, no output is played whatsoever.
 
+  AudioStream::Statistics m_statistics; //!< Counted audio problems.
+  AudioStream::Statistics m_stream_statistics; //!< Last stream counters.
+
+  // Variables for the forwarding thread.
+  mutable pthread_mutex_t m_lock; //!< Recursive lock for the controller.
+  pthread_t m_thread; //!< Thread structure.
+  bool m_thread_created; //!< Flag telling if thread is already active.
+  std::atomic<bool> m_stop; //!< Flag telling when to quit the thread.
+  bool m_forwarding_enabled; //!< Flag telling if audio should be forwarded.
+  std::atomic<bool> m_broken_pipe; //!< Flushing the out queue failed.
+
 };
 
 //*
 bool
 AudioInputController::is_eof() const
 {
-  if (this->m_mode == PLAY)
-    return this->get_read_cursor() >= this->get_audio_data_size();
+  if (this->m_mode == PLAY) {
+    if (this->m_file_pending ||
+        this->get_read_cursor() < this->get_audio_data_size())
+      return false;
+    // Urgent messages go before the queued audio, so the end of audio must
+    // wait until the queue is empty.
+    bool queued = false;
+    if (this->is_fast_forwarding() && this->m_out_queue) {
+      this->lock();
+      queued = !this->m_out_queue->empty();
+      this->unlock();
+    }
+    return !queued;
+  }
   
   return false;
 }
 //*/
 
+void
+AudioInputController::set_latency_trace(LatencyTrace *trace)
+{
+  this->m_trace = trace;
+}
+
+void
+AudioInputController::hold_audio(bool hold)
+{
+  this->m_audio_held = hold;
+}
+
 bool
 AudioInputController::is_paused() const
 {
@@ -144,8 +280,10 @@ AudioInputController::is_paused() const
 unsigned long
 AudioInputController::get_audio_cursor() const
 {
-  if (this->m_mode == PLAY)
-    return this->m_output_buffer.get_frames_read();
+  if (this->is_fast_forwarding())
+    return this->get_read_cursor();
+  else if (this->m_mode == PLAY)
+    return this->m_output_buffer->get_frames_read();
   else // this->m_mode == RECORD
     return this->get_audio_data_size();
 }
@@ -153,17 +291,40 @@ AudioInputController::get_audio_cursor() const
 void
 AudioInputController::read_input()
 {
-  if (this->m_mode == PLAY) {
+  if (this->is_fast_forwarding()) {
+    // Nothing is played, operate() sends the audio directly.
+  }
+  else if (this->m_mode == PLAY) {
     // Send audio to output stream.
     this->m_output_cursor +=
-      this->m_output_buffer.write(this->get_audio_data() + this->m_output_cursor,
-                                  this->get_audio_data_size() - this->m_output_cursor);
+      this->m_output_buffer->write(this->get_audio_data() + this->m_output_cursor,
+                                   this->get_audio_data_size() - this->m_output_cursor);
   }
   else { // this->m_mode == RECORD
-    this->m_input_buffer.read(this->m_audio_data);
+    // If the buffer got over half full since the last read, we were late
+    // and might lose audio next time.
+    if (this->m_input_buffer->get_read_size() > this->m_input_buffer->get_size() / 2)
+      this->grow_input_buffer();
+
+    // Read straight into the end of the audio data.
+    unsigned long frames = this->m_input_buffer->get_size();
+    AUDIO_FORMAT *to =
+      (AUDIO_FORMAT*)this->m_audio_data.reserve(frames * sizeof(AUDIO_FORMAT));
+    if (to) {
+      frames = this->m_input_buffer->read(to, frames);
+      this->m_audio_data.commit(frames * sizeof(AUDIO_FORMAT));
+      this->m_wave_summary.update(this->get_audio_data(),
+                                  this->get_audio_data_size());
+    }
   }
 }  
 
+bool
+AudioInputController::is_fast_forwarding() const
+{
+  return audio::audio_fast_forward && this->m_mode == PLAY;
+}
+
 bool
 AudioInputController::is_playbacking() const
 {
@@ -173,7 +334,37 @@ AudioInputController::is_playbacking() const
 unsigned long
 AudioInputController::get_playback_cursor() const
 {
-  return this->m_playback_from + this->m_playback_buffer.get_frames_read();
+  return this->m_playback_from + this->m_playback_buffer->get_frames_read();
+}
+
+bool
+AudioInputController::is_broken_pipe() const
+{
+  return this->m_broken_pipe;
+}
+
+void
+AudioInputController::lock() const
+{
+  pthread_mutex_lock(&this->m_lock);
+}
+
+void
+AudioInputController::unlock() const
+{
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+unsigned long
+AudioInputController::get_input_buffer_size() const
+{
+  return this->m_input_buffer->get_size();
+}
+
+double
+AudioInputController::get_input_latency() const
+{
+  return this->m_audio_stream.get_input_latency();
 }
 
 const AUDIO_FORMAT*
@@ -188,6 +379,12 @@ AudioInputController::get_audio_data_size() const
   return this->m_audio_data.size() / sizeof(AUDIO_FORMAT);
 }
 
+const WaveSummary&
+AudioInputController::get_wave_summary() const
+{
+  return this->m_wave_summary;
+}
+
 unsigned long
 AudioInputController::get_read_cursor() const
 {
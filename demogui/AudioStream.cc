@@ -1,42 +1,150 @@
 #include <cstring>
 #include <cstdio>
+#include <cmath>
 #include <cassert>
 #include <iostream>
 #include <stdexcept>
+#include <sched.h>
+#include <time.h>
 #include <sndfile.h>
 #include <portaudio.h>
 #include "AudioStream.hh"
+#include "MappedStore.hh"
+#include "trace.hh"
 
 using namespace std;
 
+// Frames read from an audio file at a time when it is converted.
+static const unsigned long file_frames = 16384;
+// The callback converts this many device samples at a time.
+static const unsigned long callback_piece = 4096;
+
+// Converts a float sample in the range of AUDIO_FORMAT with clipping.
+static inline AUDIO_FORMAT float_to_sample(float value)
+{
+	if (value > 32767.0f)
+		value = 32767.0f;
+	else if (value < -32768.0f)
+		value = -32768.0f;
+	return (AUDIO_FORMAT) lrintf(value);
+}
+
 namespace audio {
 
-bool read_wav_data(const std::string &filename, std::string &to)
+FileReader::FileReader() :
+	m_file(NULL), m_convert(false), m_file_ended(false), m_channels(1)
+{
+}
+
+FileReader::~FileReader()
+{
+	this->close();
+}
+
+bool FileReader::open(const std::string &filename)
 {
 	SF_INFO info;
-	SNDFILE *file;
-	char *data;
-	unsigned long read_size = 0;
 
+	this->close();
 	info.format = 0;
-	file = sf_open(filename.data(), SFM_READ, &info);
+	this->m_file = sf_open(filename.data(), SFM_READ, &info);
 
-	if (file == NULL) {
+	if (this->m_file == NULL) {
 		perror("sf_open failed");
-		fprintf(stderr, "read_wav_data failed to open file \"%s\"\n",
+		fprintf(stderr, "FileReader failed to open file \"%s\"\n",
 				filename.data());
 		return false;
 	}
 
-	data = new char[sizeof(AUDIO_FORMAT) * info.frames + 1];
-	read_size = audio_read_function(file, (AUDIO_FORMAT*) data, info.frames);
+	// Other rates and stereo files are converted on the fly, the demo and the
+	// recognizer only handle mono audio_sample_rate audio.
+	this->m_channels = info.channels;
+	this->m_convert = (unsigned int) info.samplerate != audio_sample_rate
+			|| info.channels != 1;
+	this->m_file_ended = false;
+	if (this->m_convert) {
+		fprintf(stderr, "Converting \"%s\" from %d Hz, %d channels to %u Hz "
+				"mono.\n", filename.data(), info.samplerate, info.channels,
+				audio_sample_rate);
+		if (!this->m_resampler.configure(info.samplerate, audio_sample_rate,
+				info.channels, file_frames)) {
+			fprintf(stderr, "FileReader: bad format in file \"%s\"\n",
+					filename.data());
+			this->close();
+			return false;
+		}
+		this->m_frames.resize(file_frames * info.channels);
+		this->m_samples.resize(file_frames);
+	}
+	return true;
+}
+
+void FileReader::close()
+{
+	if (this->m_file) {
+		sf_close(this->m_file);
+		this->m_file = NULL;
+	}
+}
+
+unsigned long FileReader::read(MappedStore &to, unsigned long frames)
+{
+	AUDIO_FORMAT *data;
+	sf_count_t read_size;
+
+	if (this->m_file == NULL)
+		return 0;
+
+	// Read directly into the store, no temporary copy is needed.
+	data = (AUDIO_FORMAT*) to.reserve(sizeof(AUDIO_FORMAT) * frames);
+	if (data == NULL) {
+		fprintf(stderr, "FileReader: no room for more audio\n");
+		this->close();
+		return 0;
+	}
+	if (this->m_convert)
+		read_size = this->read_converted(data, frames);
+	else
+		read_size = audio_read_function(this->m_file, data, frames);
+	if (read_size < 0)
+		read_size = 0;
+	to.commit(read_size * sizeof(AUDIO_FORMAT));
 
-	// Because there might be '\0' character in the data, don't not use =-operator
-	to.assign(data, read_size * sizeof(AUDIO_FORMAT));
+	if ((unsigned long) read_size < frames)
+		this->close();
+	return read_size;
+}
 
-	delete[] data;
-	sf_close(file);
-	return true;
+unsigned long FileReader::read_converted(AUDIO_FORMAT *to, unsigned long frames)
+{
+	unsigned long count = 0;
+
+	while (count < frames) {
+		// Converted samples first, then more frames from the file.
+		unsigned long size = frames - count;
+		if (size > this->m_samples.size())
+			size = this->m_samples.size();
+		size = this->m_resampler.read(&this->m_samples[0], size);
+		for (unsigned long i = 0; i < size; i++)
+			to[count + i] = float_to_sample(this->m_samples[i] * 32768.0f);
+		count += size;
+		if (size > 0)
+			continue;
+
+		if (this->m_file_ended)
+			break;
+		// libsndfile scales the samples to [-1, 1].
+		sf_count_t read_size = sf_readf_float(this->m_file, &this->m_frames[0],
+				file_frames);
+		if (read_size > 0) {
+			this->m_resampler.write(&this->m_frames[0], read_size);
+		}
+		else {
+			this->m_resampler.finish();
+			this->m_file_ended = true;
+		}
+	}
+	return count;
 }
 
 bool write_wav_data(const std::string &filename, const AUDIO_FORMAT *from,
@@ -66,22 +174,35 @@ bool write_wav_data(const std::string &filename, const AUDIO_FORMAT *from,
 }
 
 unsigned int audio_sample_rate = 16000;
+unsigned int audio_device_rate = 0;
+float audio_buffer_length = 3;
+float audio_input_latency = -1;
+unsigned long audio_frames_per_buffer = 0;
+SampleFormat audio_device_format = INT16;
 
 }
 
-AudioStream::AudioStream()
+AudioStream::AudioStream() :
+	m_input_buffer(NULL), m_output_buffer(NULL), m_callback_count(0),
+	m_callback_time(0),
+	m_dropped_input_frames(0), m_input_overflows(0), m_output_underflows(0),
+	m_output_underruns(0), m_max_jitter(0), m_callback_period(0),
+	m_callback_frames(0), m_input_float(callback_piece),
+	m_output_float(callback_piece), m_input_scratch(callback_piece),
+	m_output_scratch(callback_piece)
 {
 	this->m_stream = NULL;
-	this->m_input_buffer = NULL;
-	this->m_output_buffer = NULL;
-	pthread_mutex_init(&this->m_inputbuffer_lock, NULL);
-	pthread_mutex_init(&this->m_outputbuffer_lock, NULL);
+	this->m_last_callback_time = 0;
+	this->m_output_flowing = false;
+	this->m_input_latency = 0;
+	this->m_output_latency = 0;
+	this->m_float_samples = false;
+	this->m_device_rate = audio::audio_sample_rate;
+	this->m_resample = false;
 }
 
 AudioStream::~AudioStream()
 {
-	pthread_mutex_destroy(&this->m_inputbuffer_lock);
-	pthread_mutex_destroy(&this->m_outputbuffer_lock);
 }
 
 bool AudioStream::open(bool input_stream, bool output_stream, bool select_devices)
@@ -90,6 +211,47 @@ bool AudioStream::open(bool input_stream, bool output_stream, bool select_device
 	PaStreamParameters *output_params = NULL;
 	PaError error;
 
+	// Statistics are collected per stream.
+	this->m_dropped_input_frames = 0;
+	this->m_input_overflows = 0;
+	this->m_output_underflows = 0;
+	this->m_output_underruns = 0;
+	this->m_max_jitter = 0;
+	this->m_callback_period = 0;
+	this->m_callback_frames = 0;
+	this->m_last_callback_time = 0;
+	this->m_output_flowing = false;
+	this->m_float_samples = audio::audio_device_format == audio::FLOAT32;
+
+	// Resamplers and the scratch buffers they need are set up before the
+	// stream starts. A piece of device input gives at most input_size
+	// samples, a piece of device output needs at most output_size samples:
+	// the piece at the model rate and the delay of the filter.
+	this->m_device_rate = audio::audio_device_rate ? audio::audio_device_rate
+			: audio::audio_sample_rate;
+	this->m_resample = this->m_device_rate != audio::audio_sample_rate;
+	unsigned long input_size = callback_piece;
+	unsigned long output_size = callback_piece;
+	if (this->m_resample) {
+		input_size = callback_piece * audio::audio_sample_rate
+				/ this->m_device_rate + 2;
+		this->m_input_resampler.configure(this->m_device_rate,
+				audio::audio_sample_rate, 1, callback_piece);
+		// The filter length depends only on the rates, configure once to
+		// get it.
+		this->m_output_resampler.configure(audio::audio_sample_rate,
+				this->m_device_rate, 1, 0);
+		output_size = (callback_piece * audio::audio_sample_rate
+				+ this->m_device_rate - 1) / this->m_device_rate
+				+ this->m_output_resampler.get_taps();
+		this->m_output_resampler.configure(audio::audio_sample_rate,
+				this->m_device_rate, 1, output_size);
+	}
+	this->m_input_float.resize(max(input_size, callback_piece));
+	this->m_input_scratch.resize(input_size);
+	this->m_output_float.resize(max(output_size, callback_piece));
+	this->m_output_scratch.resize(output_size);
+
 	// Initialize PortAudio.
 	error = Pa_Initialize();
 	if (error != paNoError) {
@@ -182,10 +344,14 @@ bool AudioStream::open(bool input_stream, bool output_stream, bool select_device
 		input_params = new PaStreamParameters;
 		input_params->device = input_device;
 		input_params->channelCount = 1;
-		input_params->sampleFormat = PA_AUDIO_FORMAT;
+		input_params->sampleFormat = this->m_float_samples ? paFloat32
+				: PA_AUDIO_FORMAT;
 		input_device_info = Pa_GetDeviceInfo(input_params->device);
-		input_params->suggestedLatency
-				= input_device_info->defaultHighInputLatency;
+		if (audio::audio_input_latency >= 0)
+			input_params->suggestedLatency = audio::audio_input_latency;
+		else
+			input_params->suggestedLatency
+					= input_device_info->defaultHighInputLatency;
 		input_params->hostApiSpecificStreamInfo = NULL;
 	}
 
@@ -195,7 +361,8 @@ bool AudioStream::open(bool input_stream, bool output_stream, bool select_device
 		output_params = new PaStreamParameters;
 		output_params->device = output_device;
 		output_params->channelCount = 1;
-		output_params->sampleFormat = PA_AUDIO_FORMAT;
+		output_params->sampleFormat = this->m_float_samples ? paFloat32
+				: PA_AUDIO_FORMAT;
 		output_device_info = Pa_GetDeviceInfo(output_params->device);
 		output_params->suggestedLatency
 				= output_device_info->defaultLowOutputLatency;
@@ -204,8 +371,12 @@ bool AudioStream::open(bool input_stream, bool output_stream, bool select_device
 
 	// Try to open audio stream.
 	cerr << "Sample rate: " << audio::audio_sample_rate << endl;
+	if (this->m_resample)
+		cerr << "Device sample rate: " << this->m_device_rate << endl;
 	error = Pa_OpenStream(&this->m_stream, input_params, output_params,
-			audio::audio_sample_rate, paFramesPerBufferUnspecified, paNoFlag,
+			this->m_device_rate,
+			audio::audio_frames_per_buffer ? audio::audio_frames_per_buffer
+					: paFramesPerBufferUnspecified, paNoFlag,
 			AudioStream::callback, this);
 
 	if (input_params != NULL)
@@ -218,6 +389,16 @@ bool AudioStream::open(bool input_stream, bool output_stream, bool select_device
 		return false;
 	}
 
+	// The device may not give what was asked for.
+	const PaStreamInfo *stream_info = Pa_GetStreamInfo(this->m_stream);
+	if (stream_info) {
+		this->m_input_latency = stream_info->inputLatency;
+		this->m_output_latency = stream_info->outputLatency;
+		cerr << "Stream latency: input " << this->m_input_latency * 1000
+				<< " ms, output " << this->m_output_latency * 1000 << " ms"
+				<< endl;
+	}
+
 	return true;
 }
 
@@ -257,16 +438,26 @@ bool AudioStream::start()
 
 void AudioStream::set_input_buffer(AudioBuffer *input_buffer)
 {
-	pthread_mutex_lock(&this->m_inputbuffer_lock);
-	this->m_input_buffer = input_buffer;
-	pthread_mutex_unlock(&this->m_inputbuffer_lock);
+	this->m_input_buffer.store(input_buffer);
+	this->wait_callback();
 }
 
 void AudioStream::set_output_buffer(AudioBuffer *output_buffer)
 {
-	pthread_mutex_lock(&this->m_outputbuffer_lock);
-	this->m_output_buffer = output_buffer;
-	pthread_mutex_unlock(&this->m_outputbuffer_lock);
+	this->m_output_buffer.store(output_buffer);
+	this->wait_callback();
+}
+
+void AudioStream::wait_callback()
+{
+	// The callback increments the counter before loading the buffer pointers
+	// (all sequentially consistent). So if the callback still uses an old
+	// pointer, the counter is odd now and changes when the callback ends.
+	unsigned long count = this->m_callback_count.load();
+	if (count & 1) {
+		while (this->m_callback_count.load() == count)
+			sched_yield();
+	}
 }
 
 int AudioStream::callback(const void* input_buffer, void* output_buffer,
@@ -274,46 +465,140 @@ int AudioStream::callback(const void* input_buffer, void* output_buffer,
 		PaStreamCallbackFlags status_flags, void* instance)
 {
 	AudioStream *object = (AudioStream*) instance;
-	if (input_buffer) {
-		object->input_stream_callback((AUDIO_FORMAT*) input_buffer, frame_count);
+	object->m_callback_count.fetch_add(1);
+	object->m_callback_time.store(trace::now(), memory_order_relaxed);
+	object->update_statistics(frame_count, time_info, status_flags);
+	if (!object->m_float_samples && !object->m_resample) {
+		if (input_buffer) {
+			object->input_stream_callback((AUDIO_FORMAT*) input_buffer,
+					frame_count);
+		}
+		if (output_buffer) {
+			object->output_stream_callback((AUDIO_FORMAT*) output_buffer,
+					frame_count);
+		}
 	}
-	if (output_buffer) {
-		object->output_stream_callback((AUDIO_FORMAT*) output_buffer,
-				frame_count);
+	else {
+		// Convert in pieces that fit the scratch buffers.
+		for (unsigned long done = 0; done < frame_count; done += callback_piece) {
+			unsigned long frames = frame_count - done;
+			if (frames > callback_piece)
+				frames = callback_piece;
+			if (input_buffer)
+				object->convert_input(input_buffer, done, frames);
+			if (output_buffer)
+				object->convert_output(output_buffer, done, frames);
+		}
 	}
+	object->m_callback_count.fetch_add(1);
 	return paContinue;
 }
 
+void AudioStream::convert_input(const void *input_buffer,
+		unsigned long offset, unsigned long frames)
+{
+	float *samples = &this->m_input_float[0];
+	unsigned long count = frames;
+
+	if (this->m_float_samples) {
+		const float *from = (const float*) input_buffer + offset;
+		for (unsigned long i = 0; i < frames; i++)
+			samples[i] = from[i] * 32768.0f;
+	}
+	else {
+		const AUDIO_FORMAT *from = (const AUDIO_FORMAT*) input_buffer + offset;
+		for (unsigned long i = 0; i < frames; i++)
+			samples[i] = from[i];
+	}
+
+	if (this->m_resample) {
+		this->m_input_resampler.write(samples, frames);
+		count = this->m_input_resampler.read(samples,
+				this->m_input_scratch.size());
+	}
+
+	AUDIO_FORMAT *to = &this->m_input_scratch[0];
+	for (unsigned long i = 0; i < count; i++)
+		to[i] = float_to_sample(samples[i]);
+	this->input_stream_callback(to, count);
+}
+
+void AudioStream::convert_output(void *output_buffer, unsigned long offset,
+		unsigned long frames)
+{
+	float *samples = &this->m_output_float[0];
+	unsigned long count = frames;
+
+	// Take as much audio as the device samples need. A dry buffer gives
+	// zeros, which are resampled like audio.
+	if (this->m_resample) {
+		count = this->m_output_resampler.get_needed_input(frames);
+		if (count > this->m_output_scratch.size())
+			count = this->m_output_scratch.size();
+	}
+	const AUDIO_FORMAT *from = &this->m_output_scratch[0];
+	this->output_stream_callback(&this->m_output_scratch[0], count);
+	for (unsigned long i = 0; i < count; i++)
+		samples[i] = from[i];
+
+	if (this->m_resample) {
+		this->m_output_resampler.write(samples, count);
+		count = this->m_output_resampler.read(samples, frames);
+		for (unsigned long i = count; i < frames; i++)
+			samples[i] = 0;
+	}
+
+	if (this->m_float_samples) {
+		float *to = (float*) output_buffer + offset;
+		for (unsigned long i = 0; i < frames; i++)
+			to[i] = samples[i] * (1.0f / 32768.0f);
+	}
+	else {
+		AUDIO_FORMAT *to = (AUDIO_FORMAT*) output_buffer + offset;
+		for (unsigned long i = 0; i < frames; i++)
+			to[i] = float_to_sample(samples[i]);
+	}
+}
+
 void AudioStream::input_stream_callback(const AUDIO_FORMAT *input_buffer,
 		unsigned long frame_count)
 {
 	unsigned long write_size;
+	AudioBuffer *buffer = this->m_input_buffer.load();
 
-	pthread_mutex_lock(&this->m_inputbuffer_lock);
-	if (this->m_input_buffer) {
-		write_size = this->m_input_buffer->write(input_buffer, frame_count);
+	if (buffer) {
+		write_size = buffer->write(input_buffer, frame_count);
 
+		// Printing is not safe here, the controller reports the drops.
 		if (write_size < frame_count) {
-			fprintf(stderr,
-					"Warning: Audio input stream buffer full, losing audio.\n");
-			assert(false);
+			this->m_dropped_input_frames.store(
+					this->m_dropped_input_frames.load(memory_order_relaxed)
+							+ frame_count - write_size, memory_order_relaxed);
 		}
 	}
-	pthread_mutex_unlock(&this->m_inputbuffer_lock);
 }
 
 void AudioStream::output_stream_callback(AUDIO_FORMAT *output_buffer,
 		unsigned long frame_count)
 {
 	unsigned long read_size = 0;
+	AudioBuffer *buffer = this->m_output_buffer.load();
+
+	if (buffer) {
+		read_size = buffer->read(output_buffer, frame_count);
 
-	pthread_mutex_lock(&this->m_outputbuffer_lock);
-	if (this->m_output_buffer) {
-		read_size = this->m_output_buffer->read(output_buffer, frame_count);
+		// Count only the moment the output runs dry, not every silent
+		// callback after it.
+		if (read_size < frame_count && this->m_output_flowing) {
+			this->m_output_underruns.store(
+					this->m_output_underruns.load(memory_order_relaxed) + 1,
+					memory_order_relaxed);
+		}
+		this->m_output_flowing = read_size == frame_count;
 	} else {
 		read_size = 0;
+		this->m_output_flowing = false;
 	}
-	pthread_mutex_unlock(&this->m_outputbuffer_lock);
 
 	// Prevent undefined scratching output..
 	if (frame_count > read_size) {
@@ -323,6 +608,62 @@ void AudioStream::output_stream_callback(AUDIO_FORMAT *output_buffer,
 
 }
 
+void AudioStream::update_statistics(unsigned long frame_count,
+		const PaStreamCallbackTimeInfo *time_info,
+		PaStreamCallbackFlags status_flags)
+{
+	if (status_flags & paInputOverflow) {
+		this->m_input_overflows.store(
+				this->m_input_overflows.load(memory_order_relaxed) + 1,
+				memory_order_relaxed);
+	}
+	if (status_flags & paOutputUnderflow) {
+		this->m_output_underflows.store(
+				this->m_output_underflows.load(memory_order_relaxed) + 1,
+				memory_order_relaxed);
+	}
+
+	// Some host APIs don't give the time (zero), use the system clock then.
+	double now;
+	if (time_info != NULL && time_info->currentTime > 0) {
+		now = time_info->currentTime;
+	}
+	else {
+		struct timespec time;
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		now = time.tv_sec + time.tv_nsec * 1e-9;
+	}
+
+	if (this->m_last_callback_time > 0) {
+		double expected = (double) frame_count / this->m_device_rate;
+		double interval = now - this->m_last_callback_time;
+		unsigned long jitter = (unsigned long) (fabs(interval - expected) * 1e6);
+		if (jitter > this->m_max_jitter.load(memory_order_relaxed))
+			this->m_max_jitter.store(jitter, memory_order_relaxed);
+
+		// Running average of the period, starting from the first interval.
+		unsigned long period = this->m_callback_period.load(memory_order_relaxed);
+		if (period == 0)
+			period = (unsigned long) (interval * 1e6);
+		else
+			period = (unsigned long) (0.9 * period + 0.1 * interval * 1e6);
+		this->m_callback_period.store(period, memory_order_relaxed);
+	}
+	this->m_callback_frames.store(frame_count, memory_order_relaxed);
+	this->m_last_callback_time = now;
+}
+
+void AudioStream::get_statistics(Statistics &statistics) const
+{
+	statistics.dropped_input_frames = this->m_dropped_input_frames.load();
+	statistics.input_overflows = this->m_input_overflows.load();
+	statistics.output_underflows = this->m_output_underflows.load();
+	statistics.output_underruns = this->m_output_underruns.load();
+	statistics.max_jitter = this->m_max_jitter.load();
+	statistics.callback_period = this->m_callback_period.load();
+	statistics.callback_frames = this->m_callback_frames.load();
+}
+
 void AudioStream::print_error(const std::string &message, const PaError *error)
 {
 	fputs(message.data(), stderr);
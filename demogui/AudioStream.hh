@@ -4,8 +4,13 @@
 
 #include <portaudio.h>
 #include <string>
-#include <pthread.h>
+#include <atomic>
+#include <vector>
 #include "Buffer.hh"
+#include "Resampler.hh"
+
+class MappedStore;
+struct SNDFILE_tag;
 
 // These definitions make it easier to change audio format.
 typedef short AUDIO_FORMAT;
@@ -22,11 +27,51 @@ typedef Buffer<AUDIO_FORMAT> AudioBuffer;
 // defined here to make it easier to change the audio format.
 namespace audio
 {
-  /** Reads the audio data from an audio file.
-   * \param filename Audio file to read.
-   * \param to String which the audio data is written into.
-   * \return false if failed to read the audio file. */
-  bool read_wav_data(const std::string &filename, std::string &to);
+  /** Reads an audio file in blocks straight into the end of a store, so a
+   * long file can be used before it has been read to the end. Files of
+   * another sample rate than audio_sample_rate or with more channels are
+   * resampled and down-mixed. */
+  class FileReader
+  {
+  public:
+
+    FileReader();
+    /** Closes the file. */
+    ~FileReader();
+
+    /** Opens an audio file. A file opened before is closed.
+     * \param filename Audio file to read.
+     * \return false if failed to open the file. */
+    bool open(const std::string &filename);
+    /** Closes the file. */
+    void close();
+    /** \return true if the file is open, that is, not read to the end. */
+    inline bool is_open() const { return this->m_file != NULL; }
+
+    /** Reads the next block of the file. The file is closed when the end
+     * is reached or reading fails.
+     * \param to Store which the audio samples are appended to.
+     * \param frames Maximum amount of audio samples to read.
+     * \return The amount of audio samples read. */
+    unsigned long read(MappedStore &to, unsigned long frames);
+
+  private:
+
+    /** Reads and converts the next block of a file that isn't in the
+     * sample format of the demo.
+     * \param to The converted audio samples are stored here.
+     * \param frames Maximum amount of audio samples to store.
+     * \return The amount of audio samples stored. */
+    unsigned long read_converted(AUDIO_FORMAT *to, unsigned long frames);
+
+    SNDFILE_tag *m_file; //!< Open libsndfile file or NULL.
+    bool m_convert; //!< Samples go through m_resampler.
+    bool m_file_ended; //!< All frames of the file are in m_resampler.
+    unsigned int m_channels; //!< Channels in the file.
+    Resampler m_resampler; //!< Converts to audio_sample_rate and mono.
+    std::vector<float> m_frames; //!< Frames read from the file.
+    std::vector<float> m_samples; //!< Converted samples.
+  };
 
   /** Opens an audio file and writes audio samples into it.
    * \param filename Audio file to write.
@@ -37,7 +82,27 @@ namespace audio
                       const AUDIO_FORMAT *from,
                       unsigned long frames);
 
+  /** Sample rate of the audio everywhere in the demo. Audio of other rates
+   * is converted to this. */
   extern unsigned int audio_sample_rate;
+  /** Sample rate the audio device is opened with. Zero uses
+   * audio_sample_rate, otherwise the stream resamples in the callback. */
+  extern unsigned int audio_device_rate;
+  /** Initial length of the audio buffers in seconds. The input buffer grows
+   * if the recognizer can't keep up. */
+  extern float audio_buffer_length;
+
+  /** Sample formats of the audio device. Audio is always stored as
+   * AUDIO_FORMAT, other formats are converted in the callback. */
+  enum SampleFormat { INT16, FLOAT32 };
+
+  /** Suggested input latency in seconds. Negative uses the high latency
+   * default of the device. */
+  extern float audio_input_latency;
+  /** Samples per callback. Zero lets PortAudio decide (may vary). */
+  extern unsigned long audio_frames_per_buffer;
+  /** Sample format requested from the device. */
+  extern SampleFormat audio_device_format;
                       
 };
 
@@ -50,12 +115,41 @@ namespace audio
  * buffer and reads output buffer to output. If a stream is wanted to pause,
  * the buffer(s) should be disconnected (set to NULL). Thus input/output won't
  * communicate with the buffer anymore. Also the buffers can be changed at
- * anytime. */
+ * anytime.
+ *
+ * The callback runs in a real-time thread and never blocks. Buffer pointers
+ * are atomic and the callback marks when it is running, so a buffer setter
+ * can wait until the callback has stopped using the old buffer.
+ *
+ * The buffers always have audio_sample_rate audio. If the device runs at
+ * another rate, the callback converts both ways with preconfigured
+ * resamplers. */
 class AudioStream
 {
   
 public:
 
+  /** Counters for audio problems. Collected by the callback and copied with
+   * get_statistics(). */
+  struct Statistics {
+    /** Input samples lost because the input buffer was full. */
+    unsigned long dropped_input_frames;
+    /** Times PortAudio reported lost input (paInputOverflow). */
+    unsigned long input_overflows;
+    /** Times PortAudio reported inserted output (paOutputUnderflow). */
+    unsigned long output_underflows;
+    /** Times an attached output buffer ran dry in the middle of output. */
+    unsigned long output_underruns;
+    /** Largest deviation of the time between callbacks from the audio
+     * duration of a callback, in microseconds. */
+    unsigned long max_jitter;
+    /** Measured time between callbacks (running average), in
+     * microseconds. */
+    unsigned long callback_period;
+    /** Samples in the latest callback. */
+    unsigned long callback_frames;
+  };
+
   /** Constructs audio stream object. */
   AudioStream();
   /** Destructs the audio stream object. */
@@ -89,8 +183,32 @@ public:
   /** \return Current output buffer. */
   inline AudioBuffer* get_output_buffer();
 
+  /** \param statistics The counters collected since the stream was opened
+   *                   are copied here. */
+  void get_statistics(Statistics &statistics) const;
+
+  /** \return Input latency reported by PortAudio for the open stream in
+   * seconds. */
+  inline double get_input_latency() const;
+  /** \return Output latency reported by PortAudio for the open stream in
+   * seconds. */
+  inline double get_output_latency() const;
+  /** \return Sample rate of the audio device. */
+  inline unsigned int get_device_rate() const;
+  /** \return Monotonic time of the latest callback in microseconds, zero
+   * if there has been none. */
+  inline long long get_callback_time() const;
+
 protected:
 
+  /** Updates the statistics. Called from the callback.
+   * \param frame_count Number of audio samples in the callback.
+   * \param time_info PortAudio time info.
+   * \param status_flags PortAudio status flags. */
+  void update_statistics(unsigned long frame_count,
+                         const PaStreamCallbackTimeInfo *time_info,
+                         PaStreamCallbackFlags status_flags);
+
   /** Callback function for input stream.
    * \param input_buffer Buffer containing new audio input.
    * \param frame_count Number of audio samples. */
@@ -103,6 +221,24 @@ protected:
   void output_stream_callback(AUDIO_FORMAT *output_buffer,
                               unsigned long frame_count);
 
+  /** Converts a piece of device input to the input buffer format and
+   * rate and passes it to input_stream_callback().
+   * \param input_buffer Input of the callback.
+   * \param offset First sample of the piece.
+   * \param frames Number of device samples in the piece. */
+  void convert_input(const void *input_buffer,
+                     unsigned long offset,
+                     unsigned long frames);
+
+  /** Fills a piece of device output from output_stream_callback(),
+   * converted to the device format and rate.
+   * \param output_buffer Output of the callback.
+   * \param offset First sample of the piece.
+   * \param frames Number of device samples in the piece. */
+  void convert_output(void *output_buffer,
+                      unsigned long offset,
+                      unsigned long frames);
+
   /** Callback function for PortAudio.
    * \param input_buffer Buffer containing new audio input.
    * \param output_buffer Output should be written into this buffer.
@@ -118,6 +254,10 @@ protected:
                       PaStreamCallbackFlags status_flags,
                       void* instance);
 
+  /** Waits until the callback isn't using the buffers it loaded before the
+   * last buffer change. Returns immediately if the callback isn't running. */
+  void wait_callback();
+
   /** Print error text to stderr.
    * \param message Error message.
    * \param error Pointer to PortAudio's own error value. */
@@ -128,24 +268,78 @@ private:
 
   PaStream *m_stream; //!< PortAudio audio stream.
 
-  AudioBuffer *m_input_buffer; //!< Pointer to input buffer.
-  AudioBuffer *m_output_buffer; //!< Pointer to output buffer.
-  
-  // Locks to prevent buffer change while writing/reading the buffer.
-  pthread_mutex_t m_inputbuffer_lock; //!< Lock for input buffer changes.
-  pthread_mutex_t m_outputbuffer_lock; //!< Lock for output buffer changes.
+  std::atomic<AudioBuffer*> m_input_buffer; //!< Pointer to input buffer.
+  std::atomic<AudioBuffer*> m_output_buffer; //!< Pointer to output buffer.
+
+  /** Incremented when the callback starts and when it ends, so the value is
+   * odd while the callback is running. */
+  std::atomic<unsigned long> m_callback_count;
+  /** Time of the latest callback for tracing. */
+  std::atomic<long long> m_callback_time;
+
+  // Statistics. Written only by the callback, hence relaxed atomics.
+  std::atomic<unsigned long> m_dropped_input_frames;
+  std::atomic<unsigned long> m_input_overflows;
+  std::atomic<unsigned long> m_output_underflows;
+  std::atomic<unsigned long> m_output_underruns;
+  std::atomic<unsigned long> m_max_jitter;
+  std::atomic<unsigned long> m_callback_period;
+  std::atomic<unsigned long> m_callback_frames;
+  double m_last_callback_time; //!< Stream time of the previous callback.
+  bool m_output_flowing; //!< Previous callback got full output from buffer.
+
+  double m_input_latency; //!< Input latency of the open stream.
+  double m_output_latency; //!< Output latency of the open stream.
+
+  /** Device uses float samples, convert them in the callback. */
+  bool m_float_samples;
+  unsigned int m_device_rate; //!< Sample rate of the device.
+  /** Device rate differs from audio_sample_rate, resample in the
+   * callback. */
+  bool m_resample;
+  Resampler m_input_resampler; //!< From the device rate to the buffers.
+  Resampler m_output_resampler; //!< From the buffers to the device rate.
+  // Preallocated buffers for the conversion, the callback can't allocate.
+  std::vector<float> m_input_float;
+  std::vector<float> m_output_float;
+  std::vector<AUDIO_FORMAT> m_input_scratch;
+  std::vector<AUDIO_FORMAT> m_output_scratch;
 };
 
 AudioBuffer*
 AudioStream::get_input_buffer()
 {
-  return this->m_input_buffer;
+  return this->m_input_buffer.load();
 }
 
 AudioBuffer*
 AudioStream::get_output_buffer()
 {
-  return this->m_output_buffer;
+  return this->m_output_buffer.load();
+}
+
+double
+AudioStream::get_input_latency() const
+{
+  return this->m_input_latency;
+}
+
+double
+AudioStream::get_output_latency() const
+{
+  return this->m_output_latency;
+}
+
+unsigned int
+AudioStream::get_device_rate() const
+{
+  return this->m_device_rate;
+}
+
+long long
+AudioStream::get_callback_time() const
+{
+  return this->m_callback_time.load(std::memory_order_relaxed);
 }
 
 #endif /*AUDIOSTREAM_HH_*/
@@ -1,4 +1,3 @@
-
 // This is .cc for template class so it should be considered as hh file.
 #ifndef BUFFER_CC
 #define BUFFER_CC
@@ -9,15 +8,18 @@
 
 template <class T>
 Buffer<T>::Buffer(unsigned long size)
+  : m_read_pos(0), m_write_pos(0), m_frames_read(0)
 {
-  this->m_buffer = new T[size];
+  // Round up to a power of two.
+  this->m_size = 1;
+  while (this->m_size < size)
+    this->m_size <<= 1;
+  this->m_mask = this->m_size - 1;
+
+  this->m_buffer = new T[this->m_size];
   if (!this->m_buffer) {
     fprintf(stderr, "Fatal error in Buffer constructor:\nOut of memory.\n");
   }
-  this->m_size = size;
-  this->m_read_index = 0;
-  this->m_write_index = 0;
-  this->m_frames_read = 0;
 }
 
 template <class T>
@@ -33,16 +35,15 @@ template <class T>
 unsigned long
 Buffer<T>::read(T *to, unsigned long frames)
 {
-  unsigned long read_size = this->get_read_size();
+  // Acquire the writer's position so the data before it is visible.
+  unsigned long write_pos = this->m_write_pos.load(std::memory_order_acquire);
+  unsigned long read_pos = this->m_read_pos.load(std::memory_order_relaxed);
+  unsigned long read_size = write_pos - read_pos;
   if (read_size > frames)
     read_size = frames;
-  
-  // We can read without locking, because writing is done to different part
-  read_size = this->do_reading(to, read_size);
-  
-  // Move read cursor
-  this->move_read_pos(read_size);
-  
+
+  this->copy_from(read_pos, to, read_size);
+  this->move_read_pos(read_pos, read_size);
   return read_size;
 }
 
@@ -50,14 +51,19 @@ template <class T>
 unsigned long
 Buffer<T>::read(std::string &to)
 {
-  unsigned long read_size = this->get_read_size();
-
-  // We can read without locking, because writing is done to different part
-  read_size = this->do_reading(to, read_size);
-  
-  // Move read cursor
-  this->move_read_pos(read_size);
-  
+  unsigned long write_pos = this->m_write_pos.load(std::memory_order_acquire);
+  unsigned long read_pos = this->m_read_pos.load(std::memory_order_relaxed);
+  unsigned long read_size = write_pos - read_pos;
+  unsigned long offset = read_pos & this->m_mask;
+  unsigned long first = read_size;
+
+  // Read the data (in two parts if necessary)
+  if (first > this->m_size - offset)
+    first = this->m_size - offset;
+  to.append((char*)(this->m_buffer + offset), sizeof(T) * first);
+  to.append((char*)this->m_buffer, sizeof(T) * (read_size - first));
+
+  this->move_read_pos(read_pos, read_size);
   return read_size;
 }
 
@@ -65,104 +71,72 @@ template <class T>
 unsigned long
 Buffer<T>::write(const T *from, unsigned long frames)
 {
-  unsigned long write_size = this->get_write_size();
+  // Acquire the reader's position so it has really finished with the data
+  // we are about to overwrite.
+  unsigned long read_pos = this->m_read_pos.load(std::memory_order_acquire);
+  unsigned long write_pos = this->m_write_pos.load(std::memory_order_relaxed);
+  unsigned long write_size = this->m_size - (write_pos - read_pos);
   if (write_size > frames)
     write_size = frames;
-  
-  // We can write without locking, because reading is done to different part
-  write_size = this->do_writing(from, write_size);
-  
-  // Move read cursor
-  this->move_write_pos(write_size);
-  
+
+  this->copy_to(write_pos, from, write_size);
+
+  // Publish the data.
+  this->m_write_pos.store(write_pos + write_size, std::memory_order_release);
   return write_size;
 }
 
 template <class T>
-unsigned long
-Buffer<T>::do_reading(T *buffer, unsigned long frames) const
+void
+Buffer<T>::copy_from(unsigned long position, T *buffer,
+                     unsigned long frames) const
 {
-  unsigned long halfing_size = 0;
-  
-  if (frames >= this->m_size) {
-    frames = this->m_size - 1;
-    assert(false); // Use assert just to notice if this occurs.
-  }
+  unsigned long offset = position & this->m_mask;
+  unsigned long first = frames;
 
   // Check for end of buffer (need for two-part-copying)
-  if (frames > this->m_size - this->m_read_index)
-    halfing_size = this->m_size - this->m_read_index;
+  if (first > this->m_size - offset)
+    first = this->m_size - offset;
 
-  // Read the data (in two parts if necessary)
-  if (halfing_size && frames > halfing_size) {
-    memcpy(buffer, this->m_buffer + this->m_read_index, sizeof(T) * halfing_size);
-    memcpy(buffer + halfing_size, this->m_buffer, sizeof(T) * (frames - halfing_size));
-  }
-  else {
-    memcpy(buffer, this->m_buffer + this->m_read_index, sizeof(T) * frames);
-  }
-  return frames;
+  memcpy(buffer, this->m_buffer + offset, sizeof(T) * first);
+  if (frames > first)
+    memcpy(buffer + first, this->m_buffer, sizeof(T) * (frames - first));
 }
 
 template <class T>
-unsigned long
-Buffer<T>::do_reading(std::string &buffer, unsigned long frames) const
+void
+Buffer<T>::copy_to(unsigned long position, const T *buffer,
+                   unsigned long frames)
 {
-  unsigned long halfing_size = 0;
-
-  if (frames >= this->m_size) {
-    frames = this->m_size - 1;
-    assert(false); // Use assert just to notice if this occurs.
-  }
+  unsigned long offset = position & this->m_mask;
+  unsigned long first = frames;
 
   // Check for end of buffer (need for two-part-copying)
-  if (frames > this->m_size - this->m_read_index)
-    halfing_size = this->m_size - this->m_read_index;
+  if (first > this->m_size - offset)
+    first = this->m_size - offset;
 
-  // Read the data (in two parts if necessary)
-  if (halfing_size && frames > halfing_size) {
-    buffer.append((char*)(this->m_buffer + this->m_read_index), sizeof(T) * halfing_size);
-    buffer.append((char*)this->m_buffer, sizeof(T) * (frames - halfing_size));
-  }
-  else {
-    buffer.append((char*)(this->m_buffer + this->m_read_index), sizeof(T) * frames);
-  }
-  return frames;
+  memcpy(this->m_buffer + offset, buffer, sizeof(T) * first);
+  if (frames > first)
+    memcpy(this->m_buffer, buffer + first, sizeof(T) * (frames - first));
 }
 
 template <class T>
-unsigned long
-Buffer<T>::do_writing(const T *buffer, unsigned long frames)
+void
+Buffer<T>::move_read_pos(unsigned long position, unsigned long frames)
 {
-  unsigned long halfing_size = 0;
-
-  if (frames >= this->m_size) {
-    frames = this->m_size - 1;
-    fprintf(stderr, "Warning: Trying to write to buffer more than its size.\n");
-    assert(false); // Use assert just to notice if this occurs.
-  }
-  
-  // Check for end of buffer (need for two-part-copying)
-  if (frames > this->m_size - this->m_write_index)
-    halfing_size = this->m_size - this->m_write_index;
-    
-  // Write the buffer (in two parts if necessary)
-  if (halfing_size) {
-    memcpy(this->m_buffer + this->m_write_index, buffer, sizeof(T) * halfing_size);
-    memcpy(this->m_buffer, buffer + halfing_size, sizeof(T) * (frames - halfing_size));
-  }
-  else {
-    memcpy(this->m_buffer + this->m_write_index, buffer, sizeof(T) * frames);
-  }
-  return frames;
+  // Only the reader modifies these, so no read-modify-write is needed.
+  this->m_frames_read.store(this->m_frames_read.load(std::memory_order_relaxed)
+                            + frames, std::memory_order_release);
+  this->m_read_pos.store(position + frames, std::memory_order_release);
 }
 
 template <class T>
 void
 Buffer<T>::clear()
 {
-  this->m_read_index = this->m_write_index;
-  this->m_frames_read = 0;
+  this->m_read_pos.store(this->m_write_pos.load(std::memory_order_acquire),
+                         std::memory_order_release);
+  this->m_frames_read.store(0, std::memory_order_release);
 }
 
 template <class T>
@@ -172,40 +146,20 @@ Buffer<T>::get_size() const
   return this->m_size;
 }
 
-template <class T>
-unsigned long
-Buffer<T>::get_frames_read() const
-{
-  return this->m_frames_read;
-}
-
 template <class T>
 unsigned long
 Buffer<T>::get_read_size() const
 {
-  return (this->m_size + this->m_write_index - this->m_read_index) % this->m_size;
+  // Load the read position first, so it can't pass the write position.
+  unsigned long read_pos = this->m_read_pos.load(std::memory_order_acquire);
+  return this->m_write_pos.load(std::memory_order_acquire) - read_pos;
 }
 
 template <class T>
 unsigned long
-Buffer<T>::get_write_size() const
-{
-  return (this->m_size + this->m_read_index - this->m_write_index - 1) % this->m_size;
-}
-
-template <class T>
-void
-Buffer<T>::move_read_pos(unsigned long add)
-{
-  this->m_read_index = (this->m_read_index + add) % this->m_size;
-  this->m_frames_read += add;
-}
-
-template <class T>
-void
-Buffer<T>::move_write_pos(unsigned long add)
+Buffer<T>::get_frames_read() const
 {
-  this->m_write_index = (this->m_write_index + add) % this->m_size;
+  return this->m_frames_read.load(std::memory_order_acquire);
 }
 
 #endif
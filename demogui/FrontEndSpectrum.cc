@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include "FrontEndSpectrum.hh"
+#include "endian.hh"
+
+FrontEndSpectrum::FrontEndSpectrum(unsigned int bins)
+  : m_bins(bins), m_frames(0)
+{
+  pthread_mutex_init(&this->m_lock, NULL);
+}
+
+FrontEndSpectrum::~FrontEndSpectrum()
+{
+  pthread_mutex_destroy(&this->m_lock);
+}
+
+bool
+FrontEndSpectrum::add(const char *data, unsigned long length)
+{
+  if (length < 8)
+    return false;
+
+  long frame = endian::get4<int>(data);
+  unsigned long bins = endian::get4<int>(data + 4);
+  if (frame < 0 || bins != this->m_bins || length < 8 + 2 * bins) {
+    fprintf(stderr, "FrontEndSpectrum: Invalid spectrum message.\n");
+    return false;
+  }
+
+  pthread_mutex_lock(&this->m_lock);
+  if ((unsigned long)frame >= this->m_received.size()) {
+    this->m_received.resize(frame + 1, false);
+    this->m_levels.resize((frame + 1) * this->m_bins);
+  }
+
+  // Levels are little endian.
+  const unsigned char *from = (const unsigned char*)data + 8;
+  Level *to = &this->m_levels[frame * this->m_bins];
+  for (unsigned int ind = 0; ind < this->m_bins; ind++)
+    to[ind] = from[2 * ind] | (from[2 * ind + 1] << 8);
+  this->m_received[frame] = true;
+
+  while (this->m_frames < this->m_received.size() &&
+         this->m_received[this->m_frames])
+    this->m_frames++;
+  pthread_mutex_unlock(&this->m_lock);
+  return true;
+}
+
+bool
+FrontEndSpectrum::get(unsigned long frame, Level *levels)
+{
+  bool found = false;
+
+  pthread_mutex_lock(&this->m_lock);
+  if (frame < this->m_received.size() && this->m_received[frame]) {
+    memcpy(levels, &this->m_levels[frame * this->m_bins],
+           this->m_bins * sizeof(Level));
+    found = true;
+  }
+  pthread_mutex_unlock(&this->m_lock);
+  return found;
+}
+
+unsigned long
+FrontEndSpectrum::get_frames()
+{
+  pthread_mutex_lock(&this->m_lock);
+  unsigned long frames = this->m_frames;
+  pthread_mutex_unlock(&this->m_lock);
+  return frames;
+}
+
+void
+FrontEndSpectrum::clear()
+{
+  pthread_mutex_lock(&this->m_lock);
+  this->m_levels.clear();
+  this->m_received.clear();
+  this->m_frames = 0;
+  pthread_mutex_unlock(&this->m_lock);
+}
@@ -0,0 +1,62 @@
+#ifndef FRONTENDSPECTRUM_HH_
+#define FRONTENDSPECTRUM_HH_
+
+#include <pthread.h>
+#include <vector>
+#include "SpectrogramCache.hh"
+
+/** Power spectra calculated by the front end of the recognizer, one per
+ * recognizer frame. The recognizer sends them in M_SPECTRUM messages when
+ * asked with M_SPECTRUM_ON. The levels use the same quantization as
+ * SpectrogramCache, so the spectrogram can draw them with the same tables.
+ *
+ * Spectra are added by the RecognizerListener thread and read by the gui,
+ * so the access is locked. */
+class FrontEndSpectrum
+{
+
+public:
+
+  typedef SpectrogramCache::Level Level;
+
+  /** Constructs an empty spectrum store.
+   * \param bins Number of frequency bins in a frame. */
+  FrontEndSpectrum(unsigned int bins);
+  /** Destructs the store. */
+  ~FrontEndSpectrum();
+
+  /** Adds the spectrum of a M_SPECTRUM message.
+   * \param data Message data without the header.
+   * \param length Length of the data.
+   * \return false if the message was malformed. */
+  bool add(const char *data, unsigned long length);
+  /** Copies the spectrum of a frame.
+   * \param frame Recognizer frame.
+   * \param levels get_bins() levels are written here.
+   * \return false if the frame hasn't been received. */
+  bool get(unsigned long frame, Level *levels);
+  /** \return Number of frames received without gaps from the beginning. */
+  unsigned long get_frames();
+
+  /** Throws away all the spectra. */
+  void clear();
+
+  /** \return Number of frequency bins in a frame. */
+  inline unsigned int get_bins() const;
+
+private:
+
+  pthread_mutex_t m_lock; //!< Lock for the spectra.
+  const unsigned int m_bins; //!< Frequency bins in a frame.
+  std::vector<Level> m_levels; //!< Levels of all frames.
+  std::vector<bool> m_received; //!< Which frames have been received.
+  unsigned long m_frames; //!< Frames received without gaps.
+};
+
+unsigned int
+FrontEndSpectrum::get_bins() const
+{
+  return this->m_bins;
+}
+
+#endif /*FRONTENDSPECTRUM_HH_*/
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include "LatencyTrace.hh"
+#include "AudioStream.hh"
+#include "RecognizerStatus.hh"
+
+std::string LatencyTrace::filename;
+
+// Process and thread numbers of the trace.
+enum { GUI = 1, RECOGNIZER = 2, DECODER = 3 };
+enum { AUDIO_THREAD = 1, LISTENER_THREAD = 2, PIPELINE_THREAD = 3 };
+
+LatencyTrace::LatencyTrace(const RecognizerStatus *recognition)
+  : m_recognition(recognition),
+    m_first_frame(0),
+    m_id_base(0)
+{
+  pthread_mutex_init(&this->m_lock, NULL);
+}
+
+LatencyTrace::~LatencyTrace()
+{
+  this->close();
+  pthread_mutex_destroy(&this->m_lock);
+}
+
+bool
+LatencyTrace::open()
+{
+  if (filename.empty())
+    return true;
+
+  pthread_mutex_lock(&this->m_lock);
+  bool ok = this->m_writer.open(filename);
+  if (ok) {
+    this->m_writer.name_process(GUI, "gui");
+    this->m_writer.name_thread(GUI, AUDIO_THREAD, "audio");
+    this->m_writer.name_thread(GUI, LISTENER_THREAD, "recognizer listener");
+    this->m_writer.name_thread(GUI, PIPELINE_THREAD, "pipeline");
+    this->m_writer.name_process(RECOGNIZER, "recognizer");
+    this->m_writer.name_thread(RECOGNIZER, 1, "acoustics");
+    this->m_writer.name_process(DECODER, "decoder");
+    this->m_writer.name_thread(DECODER, 1, "search");
+  }
+  else {
+    fprintf(stderr, "Couldn't create trace file %s\n", filename.c_str());
+  }
+  pthread_mutex_unlock(&this->m_lock);
+  return ok;
+}
+
+void
+LatencyTrace::close()
+{
+  pthread_mutex_lock(&this->m_lock);
+  this->m_writer.close();
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+LatencyTrace::reset()
+{
+  pthread_mutex_lock(&this->m_lock);
+  this->m_id_base += this->m_first_frame + this->m_frames.size();
+  this->m_blocks.clear();
+  this->m_frames.clear();
+  this->m_first_frame = 0;
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+LatencyTrace::audio_sent(unsigned long first_sample,
+                         unsigned long samples,
+                         long long capture_time)
+{
+  if (!this->is_open())
+    return;
+
+  Block block;
+  block.end = first_sample + samples;
+  block.capture = capture_time;
+  block.sent = trace::now();
+  pthread_mutex_lock(&this->m_lock);
+  this->m_blocks.push_back(block);
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+LatencyTrace::add_stage(const char *message, unsigned long length)
+{
+  if (!this->is_open())
+    return;
+
+  std::string data(message, length);
+  char stage[16];
+  unsigned long frame;
+  long long time;
+  if (sscanf(data.c_str(), "%15s %lu %lld", stage, &frame, &time) != 3) {
+    fprintf(stderr, "Invalid trace message: %s\n", data.c_str());
+    return;
+  }
+
+  pthread_mutex_lock(&this->m_lock);
+  if (frame >= this->m_first_frame) {
+    unsigned long index = frame - this->m_first_frame;
+    if (index >= this->m_frames.size()) {
+      Frame unknown = { 0, 0, 0 };
+      this->m_frames.resize(index + 1, unknown);
+    }
+    std::string name(stage);
+    if (name == "features")
+      this->m_frames[index].features = time;
+    else if (name == "scored")
+      this->m_frames[index].scored = time;
+    else if (name == "decoded")
+      this->m_frames[index].decoded = time;
+  }
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+LatencyTrace::received(unsigned long frames)
+{
+  if (!this->is_open())
+    return;
+
+  long long now = trace::now();
+  pthread_mutex_lock(&this->m_lock);
+  while (this->m_first_frame < frames && !this->m_frames.empty()) {
+    this->write_frame(this->m_first_frame, this->m_frames.front(), now);
+    this->m_frames.pop_front();
+    this->m_first_frame++;
+  }
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+LatencyTrace::write_frame(unsigned long frame, const Frame &times,
+                          long long received)
+{
+  long long id = this->m_id_base + frame;
+
+  // The frame is complete when its last sample has been sent. Blocks
+  // before it aren't needed by the later frames either.
+  unsigned long samples_per_frame =
+    audio::audio_sample_rate / RecognizerStatus::frames_per_second;
+  unsigned long last_sample =
+    (this->m_recognition->get_audio_frame(frame) + 1) * samples_per_frame - 1;
+  while (!this->m_blocks.empty() && this->m_blocks.front().end <= last_sample)
+    this->m_blocks.pop_front();
+
+  long long sent = 0;
+  if (!this->m_blocks.empty()) {
+    const Block &block = this->m_blocks.front();
+    sent = block.sent;
+    this->m_writer.span("audio", GUI, AUDIO_THREAD, id, block.capture, sent);
+    this->m_writer.span("total", GUI, PIPELINE_THREAD, id, block.capture,
+                        received);
+  }
+  if (sent && times.features)
+    this->m_writer.span("features", RECOGNIZER, 1, id, sent, times.features);
+  if (times.features && times.scored)
+    this->m_writer.span("scoring", RECOGNIZER, 1, id, times.features,
+                        times.scored);
+  if (times.scored && times.decoded)
+    this->m_writer.span("decoding", DECODER, 1, id, times.scored,
+                        times.decoded);
+  if (times.decoded)
+    this->m_writer.span("result", GUI, LISTENER_THREAD, id, times.decoded,
+                        received);
+}
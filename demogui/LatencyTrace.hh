@@ -0,0 +1,110 @@
+#ifndef LATENCYTRACE_HH_
+#define LATENCYTRACE_HH_
+
+#include <deque>
+#include <pthread.h>
+#include <string>
+#include "trace.hh"
+
+class RecognizerStatus;
+
+/** Latency of every recognition frame through the pipeline, written to a
+ * Chrome trace file. The audio thread tells when audio was captured and
+ * sent to the recognizer, the recognizer and the decoder send the times
+ * their stages finished each frame in TRACE messages, and the recognizer
+ * listener tells when the recognition of the frame arrived. When a frame
+ * is received, its stages are written as spans:
+ *   audio     capture -> sent to the recognizer (gui)
+ *   features  sent -> features generated (recognizer acoustics thread)
+ *   scoring   features -> state probabilities computed (recognizer)
+ *   decoding  probabilities -> decoded (decoder)
+ *   result    decoded -> recognition received (gui listener)
+ *   total     capture -> recognition received (gui)
+ * The capture time of a sample is the time of the audio callback that
+ * passed the newest sample of its block, so it may be late by the length
+ * of the block. The times of the recognizer and the decoder are only
+ * comparable when they run on the same computer as the gui.
+ *
+ * Audio and recognitions come from different threads, so the access is
+ * locked. */
+class LatencyTrace
+{
+
+public:
+
+  /** File to write the trace to. Empty disables tracing. */
+  static std::string filename;
+
+  /** \param recognition Converts the frames of the recognizer to audio
+   *                    frames when audio has been dropped. */
+  LatencyTrace(const RecognizerStatus *recognition);
+  ~LatencyTrace();
+
+  /** Creates the trace file if a file name is set.
+   * \return false if the file couldn't be created. */
+  bool open();
+  /** Writes the end of the trace and closes the file. */
+  void close();
+  /** \return true if tracing. */
+  inline bool is_open() const;
+
+  /** Call when the recognizer is reset, frames and samples start again
+   * from zero. */
+  void reset();
+
+  /** Call when audio is sent to the recognizer.
+   * \param first_sample Index of the first sample since the reset.
+   * \param samples Number of samples.
+   * \param capture_time Time the audio was captured in microseconds. */
+  void audio_sent(unsigned long first_sample, unsigned long samples,
+                  long long capture_time);
+  /** Call when M_TRACE is received.
+   * \param message The message data: "stage frame microseconds".
+   * \param length Length of the message. */
+  void add_stage(const char *message, unsigned long length);
+  /** Call when a recognition is received. Writes the frames before it.
+   * \param frames Number of frames the recognition covers. */
+  void received(unsigned long frames);
+
+private:
+
+  /** Audio sent in one message. */
+  struct Block {
+    unsigned long end; //!< Index of the sample after the block.
+    long long capture; //!< Capture time.
+    long long sent; //!< Time the block was sent.
+  };
+
+  /** Times the stages finished a frame, zero if not known. */
+  struct Frame {
+    long long features;
+    long long scored;
+    long long decoded;
+  };
+
+  /** Writes the spans of a frame.
+   * \param frame Frame index since the reset.
+   * \param times Stage times of the frame.
+   * \param received Time the recognition of the frame arrived. */
+  void write_frame(unsigned long frame, const Frame &times,
+                   long long received);
+
+  const RecognizerStatus *m_recognition; //!< Frames to audio frames.
+  trace::Writer m_writer; //!< The trace file.
+  pthread_mutex_t m_lock; //!< Lock for all the data.
+
+  std::deque<Block> m_blocks; //!< Blocks of the frames not yet written.
+  std::deque<Frame> m_frames; //!< Frames not yet written.
+  unsigned long m_first_frame; //!< Frame index of the first in m_frames.
+  /** Span id of frame zero. The ids keep growing over resets, so the
+   * utterances don't share rows. */
+  long long m_id_base;
+};
+
+bool
+LatencyTrace::is_open() const
+{
+  return this->m_writer.is_open();
+}
+
+#endif /*LATENCYTRACE_HH_*/
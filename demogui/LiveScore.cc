@@ -0,0 +1,113 @@
+#include "LiveScore.hh"
+#include "str.hh"
+
+LiveScore::LiveScore()
+{
+  this->set_reference("");
+}
+
+void
+LiveScore::set_reference(const std::string &reference)
+{
+  std::string reference_word = reference;
+  std::string reference_char = reference;
+  align::clean(reference_word, ' ');
+  align::clean(reference_char, '_');
+  this->m_has_reference = !reference_word.empty();
+
+  std::vector<int> ids;
+  this->m_word_ids.clear();
+  align::number_words(reference_word, this->m_word_ids, ids);
+  this->m_words.set_reference(ids);
+  this->m_chars.set_reference(std::vector<int>(reference_char.begin(),
+                                               reference_char.end()));
+  this->clear_recognition();
+}
+
+void
+LiveScore::clear_recognition()
+{
+  this->m_parts = 0;
+  this->m_last_part = NULL;
+  this->m_text.clear();
+  this->m_tail = 0;
+  this->m_tail_words = 0;
+  this->m_word_chars.clear();
+  this->m_words.resize(0);
+  this->m_chars.resize(0);
+  this->store_results();
+}
+
+void
+LiveScore::store_results()
+{
+  this->m_word_result = this->m_words.get_result();
+  this->m_char_result = this->m_chars.get_result();
+}
+
+bool
+LiveScore::update(const RecognitionSnapshot &snapshot)
+{
+  bool changed = false;
+
+  if (!this->m_has_reference)
+    return false;
+
+  // Recognized parts are only appended unless the recognition has been
+  // reset or replaced by the whole result.
+  if (snapshot.recognized.size() < this->m_parts ||
+      (this->m_parts > 0 &&
+       snapshot.recognized[this->m_parts - 1].get() != this->m_last_part)) {
+    this->clear_recognition();
+    changed = true;
+  }
+  if (snapshot.recognized.size() == this->m_parts)
+    return changed;
+
+  for (unsigned long ind = this->m_parts; ind < snapshot.recognized.size(); ind++) {
+    const MorphemeList &morphemes = *snapshot.recognized[ind];
+    for (unsigned int jnd = 0; jnd < morphemes.size(); jnd++)
+      this->m_text.append(morphemes[jnd].data);
+  }
+  this->m_parts = snapshot.recognized.size();
+  this->m_last_part = snapshot.recognized[this->m_parts - 1].get();
+
+  // Score the last word again with the new text.
+  std::string tail = this->m_text.substr(this->m_tail);
+  align::clean(tail, ' ');
+  std::vector<std::string> words = str::split(tail, " ", true);
+
+  if (this->m_tail_words < this->m_word_chars.size())
+    this->m_chars.resize(this->m_word_chars[this->m_tail_words]);
+  this->m_word_chars.resize(this->m_tail_words);
+  this->m_words.resize(this->m_tail_words);
+
+  for (unsigned int ind = 0; ind < words.size(); ind++) {
+    std::map<std::string, int>::iterator it =
+      this->m_word_ids.insert(std::make_pair(words[ind],
+                                             (int)this->m_word_ids.size())).first;
+    this->m_words.push_back(it->second);
+
+    // Word breaks are '_' characters like in TextComparer.
+    this->m_word_chars.push_back(this->m_chars.size());
+    if (this->m_word_chars.size() > 1)
+      this->m_chars.push_back('_');
+    for (unsigned int jnd = 0; jnd < words[ind].size(); jnd++)
+      this->m_chars.push_back(words[ind][jnd]);
+  }
+
+  // The last word is complete only if the text ends in a word break.
+  unsigned long last_space = this->m_text.find_last_of(" \t\n");
+  if (last_space == this->m_text.size() - 1) {
+    this->m_tail = this->m_text.size();
+    this->m_tail_words = this->m_word_chars.size();
+  }
+  else if (last_space != std::string::npos && last_space >= this->m_tail) {
+    this->m_tail = last_space + 1;
+    std::string last = this->m_text.substr(this->m_tail);
+    align::clean(last, ' ');
+    this->m_tail_words = this->m_word_chars.size() - (last.empty() ? 0 : 1);
+  }
+  this->store_results();
+  return true;
+}
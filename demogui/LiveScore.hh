@@ -0,0 +1,88 @@
+#ifndef LIVESCORE_HH_
+#define LIVESCORE_HH_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "align.hh"
+#include "RecognizerStatus.hh"
+
+/** Word and character error counts of the recognized text against a
+ * reference, kept up to date while the recognition runs. Only the recognized
+ * (not hypothesis) morphemes are scored. New morphemes are appended to the
+ * incremental aligners, so an update costs only the new words. The texts
+ * are cleaned with align::clean like in TextComparer, so the final counts
+ * equal those of the comparison window when the whole reference has been
+ * spoken. Use only in the gui thread. */
+class LiveScore
+{
+
+public:
+
+  LiveScore();
+
+  /** Sets the reference text and scores the recognition again.
+   * \param reference Reference text. Empty disables scoring. */
+  void set_reference(const std::string &reference);
+  /** \return true if a reference has been set. */
+  inline bool has_reference() const;
+
+  /** Scores the new recognized morphemes of the snapshot.
+   * \param snapshot Current recognition.
+   * \return true if the scores changed. */
+  bool update(const RecognitionSnapshot &snapshot);
+
+  /** \return Counts of the word alignment. */
+  inline align::Result get_word_result() const;
+  /** \return Counts of the character alignment. */
+  inline align::Result get_char_result() const;
+
+private:
+
+  /** Throws away the scored recognition. */
+  void clear_recognition();
+  /** Stores the results of the aligners. */
+  void store_results();
+
+  bool m_has_reference; //!< Reference is not empty.
+  /** Numbers of the reference and recognized words. */
+  std::map<std::string, int> m_word_ids;
+  align::Incremental m_words; //!< Word aligner.
+  align::Incremental m_chars; //!< Character aligner.
+
+  /** Number of recognized parts of the snapshot which have been scored. */
+  unsigned long m_parts;
+  /** The last scored part, to notice when the recognition is replaced. */
+  const MorphemeList *m_last_part;
+  std::string m_text; //!< Recognized text.
+  /** Position in m_text where the last word starts. The word may continue
+   * in the next morphemes, so it is scored again. */
+  unsigned long m_tail;
+  unsigned long m_tail_words; //!< Number of words before m_tail.
+  /** Index of the first character token of each scored word, including the
+   * word break before it. */
+  std::vector<unsigned long> m_word_chars;
+
+  align::Result m_word_result; //!< Counts of the word alignment.
+  align::Result m_char_result; //!< Counts of the character alignment.
+};
+
+bool
+LiveScore::has_reference() const
+{
+  return this->m_has_reference;
+}
+
+align::Result
+LiveScore::get_word_result() const
+{
+  return this->m_word_result;
+}
+
+align::Result
+LiveScore::get_char_result() const
+{
+  return this->m_char_result;
+}
+
+#endif /*LIVESCORE_HH_*/
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+#include "MappedStore.hh"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+MappedStore::MappedStore(unsigned long segment_size)
+  : m_size(0)
+{
+  unsigned long page_size = sysconf(_SC_PAGESIZE);
+
+  // Segments must be whole pages because they are mapped separately.
+  this->m_segment_size = (segment_size + page_size - 1) / page_size * page_size;
+  if (this->m_segment_size == 0)
+    this->m_segment_size = page_size;
+
+  this->m_base = NULL;
+  this->m_reserved = 0;
+  this->m_capacity = 0;
+  this->m_fd = -1;
+  this->m_spill_failed = false;
+
+  this->reserve_address_space();
+  this->open_spill_file();
+}
+
+MappedStore::~MappedStore()
+{
+  if (this->m_base)
+    munmap(this->m_base, this->m_reserved);
+  if (this->m_fd >= 0)
+    close(this->m_fd);
+}
+
+void
+MappedStore::reserve_address_space()
+{
+  // 4 GB is over 37 hours of 16 kHz 16-bit audio. Address space is only
+  // reserved, nothing is allocated until the store grows.
+  unsigned long reserve = sizeof(void*) >= 8 ? 1UL << 32 : 1UL << 28;
+  void *address;
+
+  for (; reserve >= this->m_segment_size; reserve /= 2) {
+    address = mmap(NULL, reserve, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (address != MAP_FAILED) {
+      this->m_base = (char*)address;
+      this->m_reserved = reserve / this->m_segment_size * this->m_segment_size;
+      return;
+    }
+  }
+  fprintf(stderr, "MappedStore: Couldn't reserve address space.\n");
+}
+
+void
+MappedStore::open_spill_file()
+{
+  const char *directory = getenv("TMPDIR");
+  if (!directory || !*directory)
+    directory = "/tmp";
+
+  std::string filename = std::string(directory) + "/demogui-audio-XXXXXX";
+  char *name = new char[filename.size() + 1];
+  strcpy(name, filename.c_str());
+
+  this->m_fd = mkstemp(name);
+  if (this->m_fd >= 0) {
+    // The file disappears when it is closed or the program crashes.
+    unlink(name);
+    this->m_spill_failed = false;
+  }
+  else if (!this->m_spill_failed) {
+    // clear() tries again for every recording, don't repeat the message.
+    fprintf(stderr, "MappedStore: Couldn't create spill file %s, "
+            "keeping audio in memory.\n", name);
+    this->m_spill_failed = true;
+  }
+  delete [] name;
+}
+
+bool
+MappedStore::grow(unsigned long capacity)
+{
+  void *address;
+  unsigned long new_capacity;
+  unsigned long grow_size;
+
+  if (capacity <= this->m_capacity)
+    return true;
+
+  new_capacity = (capacity + this->m_segment_size - 1) / this->m_segment_size
+    * this->m_segment_size;
+  if (new_capacity > this->m_reserved) {
+    fprintf(stderr, "MappedStore: Out of reserved space (%lu bytes).\n",
+            this->m_reserved);
+    return false;
+  }
+  grow_size = new_capacity - this->m_capacity;
+
+  if (this->m_fd >= 0) {
+    // Allocate the disk blocks now. Writing to a page of a sparse file with
+    // a full disk would kill us with SIGBUS.
+    if (posix_fallocate(this->m_fd, this->m_capacity, grow_size) == 0) {
+      address = mmap(this->m_base + this->m_capacity, grow_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                     this->m_fd, this->m_capacity);
+      if (address != MAP_FAILED) {
+        this->m_capacity = new_capacity;
+        return true;
+      }
+    }
+    fprintf(stderr, "MappedStore: Failed to grow spill file, "
+            "keeping rest of the audio in memory.\n");
+    close(this->m_fd);
+    this->m_fd = -1;
+  }
+
+  // Segments are mapped separately, so anonymous ones can follow the file
+  // backed ones.
+  address = mmap(this->m_base + this->m_capacity, grow_size,
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                 -1, 0);
+  if (address == MAP_FAILED) {
+    perror("MappedStore: mmap failed");
+    return false;
+  }
+  this->m_capacity = new_capacity;
+  return true;
+}
+
+char*
+MappedStore::reserve(unsigned long size)
+{
+  unsigned long used = this->m_size.load(std::memory_order_relaxed);
+  if (!this->m_base || !this->grow(used + size))
+    return NULL;
+  return this->m_base + used;
+}
+
+void
+MappedStore::commit(unsigned long size)
+{
+  this->m_size.store(this->m_size.load(std::memory_order_relaxed) + size,
+                     std::memory_order_release);
+}
+
+unsigned long
+MappedStore::append(const char *data, unsigned long size)
+{
+  char *to = this->reserve(size);
+  if (!to)
+    return 0;
+  memcpy(to, data, size);
+  this->commit(size);
+  return size;
+}
+
+void
+MappedStore::clear()
+{
+  this->m_size.store(0, std::memory_order_release);
+
+  if (this->m_capacity) {
+    // Replace the segments with inaccessible address space again and give
+    // the pages and disk blocks back.
+    if (mmap(this->m_base, this->m_capacity, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0)
+        == MAP_FAILED) {
+      perror("MappedStore: mmap failed");
+      return;
+    }
+    if (this->m_fd >= 0 && ftruncate(this->m_fd, 0) < 0)
+      perror("MappedStore: ftruncate failed");
+    this->m_capacity = 0;
+  }
+
+  // Growing the file may have failed because the disk was full for a
+  // while. Try the disk again for the next recording.
+  if (this->m_fd < 0)
+    this->open_spill_file();
+}
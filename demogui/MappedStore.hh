@@ -0,0 +1,89 @@
+#ifndef MAPPEDSTORE_HH_
+#define MAPPEDSTORE_HH_
+
+#include <atomic>
+
+/** Growable byte array which never moves its data. A large range of address
+ * space is reserved once and the store grows inside it by mapping fixed-size
+ * segments of an unlinked temporary file at the end of the used area. Thus
+ * growing never copies the old data and pointers returned by data() stay
+ * valid until the store is destructed. The pages live in the page cache and
+ * may be written to disk by the kernel, so long recordings don't need to fit
+ * in the memory. If no temporary file can be created, anonymous memory is
+ * used instead.
+ *
+ * The store is meant for one writer thread. Readers may access the first
+ * size() bytes while the writer appends more: the size is published only
+ * after the data has been written. */
+class MappedStore
+{
+
+public:
+
+  /** Constructs an empty store.
+   * \param segment_size The store grows by multiples of this size (bytes). */
+  MappedStore(unsigned long segment_size = 1 << 20);
+  /** Unmaps the memory and closes the temporary file. */
+  ~MappedStore();
+
+  /** Appends data to the end of the store.
+   * \param data Data to append.
+   * \param size Number of bytes to append.
+   * \return size, or 0 if out of space. Data is never partly appended. */
+  unsigned long append(const char *data, unsigned long size);
+
+  /** Makes sure that there is room for at least size bytes after the used
+   * area. Write the data into the returned pointer and call commit() to
+   * make it part of the store.
+   * \param size Number of bytes wanted.
+   * \return Pointer to the end of the used area or NULL if out of space. */
+  char* reserve(unsigned long size);
+  /** Adds bytes written after reserve() to the used area.
+   * \param size Number of bytes written. */
+  void commit(unsigned long size);
+
+  /** Empties the store. Unmaps the segments and releases their pages and
+   * disk blocks, so the store grows again from zero. Opens the spill file
+   * again if an earlier failure left the store in memory. */
+  void clear();
+
+  /** \return Pointer to the beginning of the data. */
+  inline const char* data() const;
+  /** \return Number of bytes in use. */
+  inline unsigned long size() const;
+
+private:
+
+  /** Reserves address space for the store. Tries smaller ranges if the
+   * address space is tight. */
+  void reserve_address_space();
+  /** Opens the unlinked temporary file used for backing the pages. A
+   * failure is reported only once until the file can be created again. */
+  void open_spill_file();
+  /** Maps more segments so that capacity is at least the given size.
+   * \param capacity Wanted capacity in bytes.
+   * \return false if the store can't grow that much. */
+  bool grow(unsigned long capacity);
+
+  char *m_base; //!< Start of the reserved address range.
+  unsigned long m_reserved; //!< Size of the reserved address range.
+  unsigned long m_capacity; //!< Bytes mapped for use from the beginning.
+  std::atomic<unsigned long> m_size; //!< Bytes in use.
+  unsigned long m_segment_size; //!< Growing granularity.
+  int m_fd; //!< Spill file or -1 when anonymous memory is used.
+  bool m_spill_failed; //!< Creating the spill file failed and was reported.
+};
+
+const char*
+MappedStore::data() const
+{
+  return this->m_base;
+}
+
+unsigned long
+MappedStore::size() const
+{
+  return this->m_size.load(std::memory_order_acquire);
+}
+
+#endif /*MAPPEDSTORE_HH_*/
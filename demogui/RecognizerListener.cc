@@ -1,22 +1,33 @@
 
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "RecognizerListener.hh"
 //#include "str.hh"
 
-
 RecognizerListener::RecognizerListener(msg::InQueue *in_queue,
                                        RecognizerStatus *recognition)
+  : m_stop(false),
+    m_enabled(true),
+    m_broken_pipe(false)
 {
   this->m_in_queue = in_queue;
   this->m_recognition = recognition;
-  this->m_stop = false;
-  this->m_enabled = true;
+  this->m_trace = NULL;
+  this->m_audio_input = NULL;
   this->m_thread_created = false;
   this->m_wait_ready = false;
   pthread_mutex_init(&this->m_disable_lock, NULL);
+  this->m_wakeup_fd = eventfd(0, EFD_NONBLOCK);
+  if (this->m_wakeup_fd < 0)
+    perror("RecognizerListener: eventfd failed");
 }
 
 RecognizerListener::~RecognizerListener()
 {
+  if (this->m_wakeup_fd >= 0)
+    close(this->m_wakeup_fd);
   pthread_mutex_destroy(&this->m_disable_lock);
 }
 
@@ -46,6 +57,7 @@ RecognizerListener::stop()
 {
   if (this->m_thread_created) {
     this->m_stop = true;
+    this->wake_up();
     pthread_join(this->m_thread, NULL);
     this->m_thread_created = false;
   }
@@ -60,6 +72,7 @@ void
 RecognizerListener::enable()
 {
   this->m_enabled = true;
+  this->wake_up();
 }
 
 void
@@ -68,6 +81,17 @@ RecognizerListener::disable()
   pthread_mutex_lock(&this->m_disable_lock);
   this->m_enabled = false;
   pthread_mutex_unlock(&this->m_disable_lock);
+  // Stop polling the in queue.
+  this->wake_up();
+}
+
+void
+RecognizerListener::wake_up()
+{
+  uint64_t value = 1;
+  if (this->m_wakeup_fd >= 0 &&
+      write(this->m_wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    perror("RecognizerListener: eventfd write failed");
 }
 
 void*
@@ -93,13 +117,32 @@ RecognizerListener::callback(void *user_data)
 void
 RecognizerListener::run() throw(msg::ExceptionBrokenPipe)
 {
-  msg::Message message;
-  bool yield = false;
+  struct pollfd fds[2];
+  uint64_t value;
+  int ret;
   
   if (!this->m_in_queue)
     return;
 
+  fds[0].fd = this->m_wakeup_fd;
+  fds[0].events = POLLIN;
+  fds[1].events = POLLIN;
+
   while (!this->m_stop) {
+    // Don't poll the in queue when disabled, it would wake us up all the
+    // time.
+    fds[1].fd = this->m_enabled ? this->m_in_queue->get_fd() : -1;
+    ret = poll(fds, 2, -1);
+    if (ret < 0 && errno != EINTR) {
+      perror("RecognizerListener: poll failed");
+      break;
+    }
+    if (ret > 0 && (fds[0].revents & POLLIN)) {
+      if (read(this->m_wakeup_fd, &value, sizeof(value)) < 0 &&
+          errno != EAGAIN)
+        perror("RecognizerListener: eventfd read failed");
+    }
+
     pthread_mutex_lock(&this->m_disable_lock);
     if (this->m_enabled) {
       
@@ -112,49 +155,81 @@ RecognizerListener::run() throw(msg::ExceptionBrokenPipe)
 
       // Read input from recognizer.
       this->m_in_queue->flush();
-      if (!this->m_in_queue->empty()) {
-        message = this->m_in_queue->queue.front();
-        // Check ready message.
-        if (message.type() == msg::M_READY) {
-          if (this->m_wait_ready)
-            this->m_wait_ready = false;
-          this->m_recognition->set_ready();
-        }
-        // This has to be read because it might mean adaptation finished.
-        if (message.type() == msg::M_RECOG_END) {
-          this->m_recognition->recognition_end();
-        }
-	if (message.type() == msg::M_ADAPT_CANCELLED) {
-	  // FIXME: Show information that adaptation failed
-	  this->m_recognition->cancel_adaptation();
-	}
-        if (!this->m_wait_ready) {
-          // Read recognition message if not waiting for ready.
-          if (message.type() == msg::M_RECOG) {
-            // Pass recognition message forward.
-//            fprintf(stderr, "RECOG: %s\n", message.data_str().c_str());
-            this->m_recognition->lock();
-            this->m_recognition->parse(message.buf.substr(msg::header_size));
-            this->m_recognition->unlock();
-            this->m_recognition->received_recognition();
-          }
-        }
-        this->m_in_queue->queue.pop_front();
-      }
-      else {
-        // No messages, we can yield.
-        yield = true;
-      }
-    }
-    else {
-      // Disabled, we can yield.
-      yield = true;
+      this->handle_messages();
     }
     pthread_mutex_unlock(&this->m_disable_lock);
-    
-    if (yield) {
-      pthread_yield();
-      yield = false;
+  }
+}
+
+void
+RecognizerListener::handle_messages()
+{
+  msg::Message message;
+
+  while (!this->m_in_queue->empty()) {
+    message = this->m_in_queue->queue.front();
+    // Check ready message.
+    if (message.type() == msg::M_READY) {
+      if (this->m_wait_ready)
+        this->m_wait_ready = false;
+      this->m_recognition->set_ready();
+    }
+    // This has to be read because it might mean adaptation finished.
+    if (message.type() == msg::M_RECOG_END) {
+      this->m_recognition->recognition_end();
+    }
+    if (message.type() == msg::M_ADAPT_CANCELLED) {
+      // FIXME: Show information that adaptation failed
+      this->m_recognition->cancel_adaptation();
+    }
+    if (message.type() == msg::M_DECODER_STATUS) {
+      this->m_recognition->set_decoder_status(message.buf.data() + msg::header_size,
+                                              message.buf.size() - msg::header_size);
+    }
+    // Flow control of the audio applies whether waiting or not.
+    if (message.type() == msg::M_AUDIO_HOLD ||
+        message.type() == msg::M_AUDIO_RESUME) {
+      if (this->m_audio_input)
+        this->m_audio_input->hold_audio(message.type() == msg::M_AUDIO_HOLD);
+    }
+    if (message.type() == msg::M_DECODER_STATS) {
+      this->m_recognition->set_decoder_stats(message.buf.data() + msg::header_size,
+                                             message.buf.size() - msg::header_size);
+    }
+    if (!this->m_wait_ready) {
+      // Read recognition message if not waiting for ready.
+      if (message.type() == msg::M_RECOG) {
+        // Pass recognition message forward.
+        RecognizerStatus::parse(message.buf.data() + msg::header_size,
+                                message.buf.size() - msg::header_size,
+                                this->m_update);
+        // The trace counts the frames of the recognizer.
+        if (this->m_trace)
+          this->m_trace->received(this->m_update.frame);
+        this->m_recognition->to_audio_frames(this->m_update);
+        this->m_recognition->apply(this->m_update);
+        this->m_recognition->received_recognition();
+      }
+      else if (message.type() == msg::M_AUDIO_DROPPED) {
+        this->m_recognition->add_dropped_audio(message.buf.data() + msg::header_size,
+                                               message.buf.size() - msg::header_size);
+      }
+      else if (message.type() == msg::M_TRACE) {
+        if (this->m_trace)
+          this->m_trace->add_stage(message.buf.data() + msg::header_size,
+                                   message.buf.size() - msg::header_size);
+      }
+      else if (message.type() == msg::M_SPECTRUM) {
+        // The spectra are shown on the audio timeline.
+        if (message.data_length() >= 4) {
+          char *frame = message.data_ptr();
+          endian::put4((int)this->m_recognition->get_audio_frame(
+                         endian::get4<int>(frame)), frame);
+        }
+        this->m_recognition->get_spectrum()->add(message.buf.data() + msg::header_size,
+                                                 message.buf.size() - msg::header_size);
+      }
     }
+    this->m_in_queue->queue.pop_front();
   }
 }
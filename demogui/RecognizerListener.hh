@@ -2,12 +2,20 @@
 #ifndef RECOGNIZERLISTENER_HH_
 #define RECOGNIZERLISTENER_HH_
 
+#include <atomic>
 #include <pthread.h>
+#include "AudioInputController.hh"
+#include "LatencyTrace.hh"
 #include "RecognizerStatus.hh"
 #include "msg.hh"
 
 /** Class for reading in queue and handling the incoming messages. Operates
- * in an own thread. */
+ * in an own thread which sleeps in poll until the recognizer writes something
+ * or the thread is woken up through an eventfd by stop(), enable() or
+ * disable(). Recognition messages are parsed in the thread and published
+ * as snapshots by RecognizerStatus, so the gui never waits for the parsing.
+ * The gui takes the latest snapshot with RecognizerStatus::update_snapshot.
+ * */
 class RecognizerListener
 {
 
@@ -43,6 +51,14 @@ public:
   /** \return true if not waiting for a ready message. */
   inline bool is_ready() const;
 
+  /** \param trace Trace messages and received recognitions are passed to
+   *              this object. NULL stops tracing. Set before start(). */
+  inline void set_latency_trace(LatencyTrace *trace);
+  /** \param audio_input Audio hold and resume messages of the recognizer
+   *                    are passed to this object, or NULL. Set before
+   *                    start(). */
+  inline void set_audio_input(AudioInputController *audio_input);
+
 private:
 
   /** Callback function for the pthread.
@@ -54,16 +70,25 @@ private:
    * in queue has a broken pipe, it throws an exception to quit the the
    * thread and raise a broken pipe flag. */
   void run() throw(msg::ExceptionBrokenPipe);
+  /** Handles all messages in the in queue. Called with the disable lock. */
+  void handle_messages();
+  /** Wakes up the thread from poll. */
+  void wake_up();
 
   RecognizerStatus *m_recognition; //!< Object for recognition message parsing.
   msg::InQueue *m_in_queue; //!< The in queue to read.
 
-  bool m_stop; //!< Flag telling when to quit the thread.
-  bool m_enabled; //!< Flag telling if in queue should be read.
+  std::atomic<bool> m_stop; //!< Flag telling when to quit the thread.
+  std::atomic<bool> m_enabled; //!< Flag telling if in queue should be read.
   bool m_thread_created; //!< Flag telling if thread is already active.
-  bool m_broken_pipe; //!< Flag telling if in queue has a broken pipe.
+  std::atomic<bool> m_broken_pipe; //!< Flag telling if in queue has a broken pipe.
   pthread_t m_thread; //!< Thread structure.
   pthread_mutex_t m_disable_lock; //!< Lock to make disabling safe.
+  int m_wakeup_fd; //!< eventfd for waking up the thread.
+  RecognitionUpdate m_update; //!< Reused for parsing the recognitions.
+  LatencyTrace *m_trace; //!< Trace of the recognitions, or NULL.
+  /** Holds the audio when the recognizer asks, or NULL. */
+  AudioInputController *m_audio_input;
   
   // TODO: This waiting should be done with an ID. An ID of the ready message
   // that should be waited is given. This prevents some reseting bugs.
@@ -93,5 +118,17 @@ RecognizerListener::is_ready() const
   return this->m_wait_ready == 0;
 }
 
+void
+RecognizerListener::set_latency_trace(LatencyTrace *trace)
+{
+  this->m_trace = trace;
+}
+
+void
+RecognizerListener::set_audio_input(AudioInputController *audio_input)
+{
+  this->m_audio_input = audio_input;
+}
+
 
 #endif /*RECOGNIZERLISTENER_HH_*/
@@ -1,18 +1,58 @@
 
 #include "RecognizerStatus.hh"
-#include "str.hh"
+#include "AudioStream.hh"
+#include "msg.hh"
+#include <algorithm>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 
 const unsigned int RecognizerStatus::frames_per_second = 125;
 bool RecognizerStatus::words = false;
+bool RecognizerStatus::frontend_spectrum = false;
 
 
 
+void
+RecognizedParts::push_back(const Part &part)
+{
+  // Chunks shared with the snapshots are copied, not modified.
+  Chunk *last = this->m_last ? new Chunk(*this->m_last) : new Chunk;
+  if (last->empty())
+    last->reserve(chunk_size);
+  last->push_back(part);
+  this->m_size++;
+
+  if (last->size() < chunk_size) {
+    this->m_last.reset(last);
+  }
+  else {
+    ChunkList *full =
+      this->m_full ? new ChunkList(*this->m_full) : new ChunkList;
+    full->push_back(std::shared_ptr<const Chunk>(last));
+    this->m_full.reset(full);
+    this->m_last.reset();
+  }
+}
+
+void
+RecognizedParts::clear()
+{
+  this->m_full.reset();
+  this->m_last.reset();
+  this->m_size = 0;
+}
+
 RecognizerStatus::RecognizerStatus()
-  : m_message_result_true_called(false), 
+  : m_published(NULL),
+    m_snapshot(new RecognitionSnapshot),
+    m_spectrum(msg::spectrum_bins),
     m_recognition_status(READY),
-    m_adaptation_status(NONE)
+    m_adaptation_status(NONE),
+    m_beam(0),
+    m_token_limit(0),
+    m_frame_time(0)
 {
   m_was_adapting_when_reseted = false;
   pthread_mutex_init(&m_lock, NULL);
@@ -20,6 +60,7 @@ RecognizerStatus::RecognizerStatus()
 
 RecognizerStatus::~RecognizerStatus()
 {
+  delete m_published.exchange(NULL);
   pthread_mutex_destroy(&m_lock);
 }
 
@@ -101,101 +142,314 @@ RecognizerStatus::get_adaptation_status() const
   return m_adaptation_status;
 }
 
+void
+RecognizerStatus::set_decoder_status(const char *message, unsigned long length)
+{
+  std::string data(message, length);
+  float beam;
+  int token_limit;
+  if (sscanf(data.c_str(), "beam %f token_limit %d", &beam, &token_limit) != 2) {
+    fprintf(stderr, "Invalid decoder status: %s\n", data.c_str());
+    return;
+  }
+  lock();
+  m_beam = beam;
+  m_token_limit = token_limit;
+  unlock();
+}
+
+float
+RecognizerStatus::get_beam() const
+{
+  return m_beam;
+}
+
+int
+RecognizerStatus::get_token_limit() const
+{
+  return m_token_limit;
+}
+
+void
+RecognizerStatus::set_decoder_stats(const char *message, unsigned long length)
+{
+  if (length < (unsigned long)msg::decoder_stats_size) {
+    fprintf(stderr, "Invalid decoder statistics of %lu bytes\n", length);
+    return;
+  }
+  int frames = endian::get4<int>(message + 4);
+  int microseconds = endian::get4<int>(message + 8);
+  lock();
+  if (frames > 0)
+    m_frame_time = microseconds / 1000.0 / frames;
+  unlock();
+}
+
+float
+RecognizerStatus::get_frame_time() const
+{
+  return m_frame_time;
+}
+
+void
+RecognizerStatus::add_dropped_audio(const char *message, unsigned long length)
+{
+  std::string data(message, length);
+  unsigned long sample, samples;
+  if (sscanf(data.c_str(), "%lu %lu", &sample, &samples) != 2) {
+    fprintf(stderr, "Invalid dropped audio: %s\n", data.c_str());
+    return;
+  }
+  if (!m_dropped.empty() && m_dropped.back().first == sample)
+    m_dropped.back().second += samples;
+  else
+    m_dropped.push_back(std::make_pair(
+                          sample,
+                          (m_dropped.empty() ? 0 : m_dropped.back().second) +
+                          samples));
+}
+
+unsigned long
+RecognizerStatus::get_audio_frame(unsigned long frame) const
+{
+  if (m_dropped.empty())
+    return frame;
+
+  unsigned long samples_per_frame =
+    audio::audio_sample_rate / RecognizerStatus::frames_per_second;
+  unsigned long sample = frame * samples_per_frame;
+
+  // The last drop at or before the start of the frame.
+  std::vector<std::pair<unsigned long, unsigned long> >::const_iterator it =
+    std::upper_bound(m_dropped.begin(), m_dropped.end(),
+                     std::make_pair(sample, ULONG_MAX));
+  if (it == m_dropped.begin())
+    return frame;
+  --it;
+  return (sample + it->second) / samples_per_frame;
+}
+
+void
+RecognizerStatus::to_audio_frames(RecognitionUpdate &update) const
+{
+  if (m_dropped.empty())
+    return;
+  to_audio_frames(update.recognized);
+  to_audio_frames(update.hypothesis);
+  update.frame = get_audio_frame(update.frame);
+}
+
+void
+RecognizerStatus::to_audio_frames(MorphemeList &morphemes) const
+{
+  for (MorphemeList::iterator iter = morphemes.begin();
+       iter != morphemes.end();
+       iter++) {
+    unsigned long end = get_audio_frame(iter->time + iter->duration);
+    iter->time = get_audio_frame(iter->time);
+    iter->duration = end - iter->time;
+  }
+}
+
 std::string
 RecognizerStatus::get_recognition_text() const
 {
   std::string text;
-  RecognizerStatus::append_morphemes(text, m_recognized);
-  RecognizerStatus::append_morphemes(text, m_hypothesis);
+  for (unsigned int ind = 0; ind < m_snapshot->recognized.size(); ind++)
+    RecognizerStatus::append_morphemes(text, *m_snapshot->recognized[ind]);
+  RecognizerStatus::append_morphemes(text, m_snapshot->hypothesis);
   return text;
 }
 
 void
 RecognizerStatus::reset()
 {
-  m_recognized.clear();
-  m_hypothesis.clear();
-  m_recognition_frame = 0;
+  m_latest = RecognitionSnapshot();
+  delete m_published.exchange(NULL);
+  m_snapshot.reset(new RecognitionSnapshot);
+  m_spectrum.clear();
+  m_dropped.clear();
+}
+
+void
+RecognizerStatus::apply(const RecognitionUpdate &update)
+{
+  // Check if we are in the end of recognition
+  if (update.all) {
+    m_latest.recognized.clear();
+    m_latest.recognized_size = 0;
+    m_latest.result_true_called = true;
+  }
+  if (m_latest.result_true_called && update.part)
+    m_latest.result_true_called = false;
+
+  // The old parts may be in use by the gui, so the new morphemes go to a new
+  // part.
+  if (!update.recognized.empty()) {
+    m_latest.recognized.push_back(
+      std::shared_ptr<const MorphemeList>(new MorphemeList(update.recognized)));
+    m_latest.recognized_size += update.recognized.size();
+  }
+  m_latest.hypothesis = update.hypothesis;
+  m_latest.frame = update.frame;
+
+  // Publish. If the gui didn't take the previous snapshot, nobody else will.
+  delete m_published.exchange(new RecognitionSnapshot(m_latest),
+                              std::memory_order_acq_rel);
+}
+
+bool
+RecognizerStatus::update_snapshot()
+{
+  RecognitionSnapshot *snapshot = m_published.exchange(NULL,
+                                                       std::memory_order_acq_rel);
+  if (!snapshot)
+    return false;
+  m_snapshot.reset(snapshot);
+  return true;
+}
+
+/** Finds the next token separated by spaces.
+ * \param pos Position in the message, moved past the token.
+ * \param end End of the message.
+ * \param token Set to the beginning of the token.
+ * \param length Set to the length of the token.
+ * \return false if there are no more tokens. */
+static inline bool
+next_token(const char *&pos, const char *end, const char *&token,
+           unsigned long &length)
+{
+  while (pos < end && *pos == ' ')
+    pos++;
+  if (pos == end)
+    return false;
+  token = pos;
+  while (pos < end && *pos != ' ')
+    pos++;
+  length = pos - token;
+  return true;
+}
+
+/** \return true if there are only spaces left in the message. */
+static inline bool
+at_end(const char *pos, const char *end)
+{
+  while (pos < end && *pos == ' ')
+    pos++;
+  return pos == end;
+}
+
+/** Converts a token to a number.
+ * \param token The token.
+ * \param length Length of the token.
+ * \param value The number is written here.
+ * \return false if the token is not a number. */
+static inline bool
+token_to_long(const char *token, unsigned long length, long &value)
+{
+  const char *end = token + length;
+  bool negative = false;
+
+  if (token < end && *token == '-') {
+    negative = true;
+    token++;
+  }
+  if (token == end)
+    return false;
+
+  value = 0;
+  for (; token < end; token++) {
+    if (*token < '0' || *token > '9')
+      return false;
+    value = value * 10 + (*token - '0');
+  }
+  if (negative)
+    value = -value;
+  return true;
+}
+
+/** \return true if the token equals to the C string. */
+static inline bool
+token_equals(const char *token, unsigned long length, const char *str)
+{
+  return strncmp(token, str, length) == 0 && str[length] == '\0';
 }
 
 void
-RecognizerStatus::parse(const std::string &message)
+RecognizerStatus::parse(const char *message, unsigned long length,
+                        RecognitionUpdate &update)
 {
-  std::vector<std::string> split_vector;
+  const char *pos = message;
+  const char *end = message + length;
+  const char *token;
+  unsigned long token_length;
   Morpheme new_morpheme;
-  Morpheme *last_morpheme = NULL;
-  bool hypothesis_part = false;
+  MorphemeList *last_list = NULL; // List of the last morpheme.
+  MorphemeList *list = &update.recognized;
   bool next_is_time = true;
   bool ok = true;
   long last_time = 0;
+  long start_time, end_time;
 
-  // Split the text into parts.
-  split_vector = str::split(message, " ", true);
-
-  // Clear previous
-  m_hypothesis.clear();
+  // The vectors keep their memory from the previous message.
+  update.recognized.clear();
+  update.hypothesis.clear();
+  update.all = false;
+  update.part = false;
+  new_morpheme.time = 0;
+  new_morpheme.duration = 0;
 
   // Check if we are in the end of recognition
-  if (split_vector.at(0) == "all") {
-    m_recognized.clear();
-    m_message_result_true_called = true;
+  if (next_token(pos, end, token, token_length)) {
+    update.all = token_equals(token, token_length, "all");
+    update.part = token_equals(token, token_length, "part");
   }
-  if (m_message_result_true_called && split_vector.at(0) == "part")
-    m_message_result_true_called = false;
-    
+
   // Format example: "101 jou 120 lu * 130 on 140 jo 148"
-  for (unsigned int ind = 1; ind < split_vector.size(); ind++) {
-    if (split_vector.at(ind) == "*") {
-      hypothesis_part = true;
+  while (next_token(pos, end, token, token_length)) {
+    if (token_equals(token, token_length, "*")) {
+      list = &update.hypothesis;
     }
     else {
       if (next_is_time) {
-        if (ind == split_vector.size()-1) {
-          long start_time = str::str2long(split_vector.at(ind));
-          if (!words && last_morpheme)
-            last_morpheme->duration = start_time - last_morpheme->time;
+        if (!token_to_long(token, token_length, start_time)) {
+          ok = false;
+          start_time = 0;
+        }
+        if (at_end(pos, end)) {
+          if (!words && last_list)
+            last_list->back().duration = start_time - last_list->back().time;
           last_time = start_time;
         }
         else {
-          long start_time = str::str2long(split_vector.at(ind));
-          ind++;
-          long end_time = str::str2long(split_vector.at(ind));
+          next_token(pos, end, token, token_length);
+          if (!token_to_long(token, token_length, end_time)) {
+            ok = false;
+            end_time = 0;
+          }
           new_morpheme.time = start_time < 0 ? 0 : start_time;
           if (words) {
             if (start_time > 0 && end_time > start_time)
               new_morpheme.duration = end_time-start_time;
           }
           else {
-            if (last_morpheme)
-              last_morpheme->duration = start_time - last_morpheme->time;
+            if (last_list)
+              last_list->back().duration = start_time - last_list->back().time;
           } 
         }
         next_is_time = false;
       }
       else {
-        write_morpheme_data(new_morpheme.data, split_vector.at(ind));
-        if (hypothesis_part) {
-          if (words && last_morpheme) {
-            Morpheme wb;
-            wb.time = last_morpheme->time + last_morpheme->duration;
-            wb.duration = new_morpheme.time - wb.time;
-            wb.data = std::string(" ");
-            m_hypothesis.push_back(wb);
-          }
-          m_hypothesis.push_back(new_morpheme);
-          last_morpheme = &m_hypothesis.back();
-        }
-        else {
-          if (words && last_morpheme) {
-            Morpheme wb;
-            wb.time = last_morpheme->time + last_morpheme->duration;
-            wb.duration = new_morpheme.time - wb.time;
-            wb.data = std::string(" ");
-            m_recognized.push_back(wb);
-          }
-          m_recognized.push_back(new_morpheme);
-          last_morpheme = &m_recognized.back();
+        if (words && last_list) {
+          Morpheme wb;
+          wb.time = last_list->back().time + last_list->back().duration;
+          wb.duration = new_morpheme.time - wb.time;
+          wb.data = std::string(" ");
+          list->push_back(wb);
         }
+        list->push_back(new_morpheme);
+        write_morpheme_data(list->back().data, token, token_length);
+        last_list = list;
         next_is_time = true;
       }
     }
@@ -208,18 +462,19 @@ RecognizerStatus::parse(const std::string &message)
     fprintf(stderr, "Warning: No ending frame in parsed recognition.\n");
 
   // Update last frame.
-  m_recognition_frame = last_time;
+  update.frame = last_time;
 }
 
 void
-RecognizerStatus::write_morpheme_data(std::string &data, const std::string &morpheme)
+RecognizerStatus::write_morpheme_data(std::string &data, const char *morpheme,
+                                      unsigned long length)
 {
-  if (morpheme == "<w>")
+  if (token_equals(morpheme, length, "<w>"))
     data = " ";
-  else if (/*morpheme == "<s>" || */morpheme == "</s>")
+  else if (token_equals(morpheme, length, "</s>"))
     data = ".";
-  else if (morpheme == "<s>")
+  else if (token_equals(morpheme, length, "<s>"))
     data = "";
-  else if (morpheme != "<s>")
-    data = morpheme;
+  else
+    data.assign(morpheme, length);
 }
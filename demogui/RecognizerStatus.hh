@@ -2,8 +2,13 @@
 #ifndef RECOGNITION_HH_
 #define RECOGNITION_HH_
 
-#include <list>
+#include <atomic>
+#include <memory>
+#include <pthread.h>
 #include <string>
+#include <utility>
+#include <vector>
+#include "FrontEndSpectrum.hh"
 
 /** Data structure for morphemes. */
 struct Morpheme
@@ -14,7 +19,88 @@ struct Morpheme
 };
 
 /** Container type for morphemes. */
-typedef std::list<Morpheme> MorphemeList;
+typedef std::vector<Morpheme> MorphemeList;
+
+/** One parsed recognition message. */
+struct RecognitionUpdate
+{
+  bool all; //!< Whole recognition was sent, old recognized part is replaced.
+  bool part; //!< Partial result, only new recognized morphemes were sent.
+  MorphemeList recognized; //!< Morphemes to append to the recognized part.
+  MorphemeList hypothesis; //!< The new hypothesis.
+  unsigned long frame; //!< The last frame of the recognition.
+};
+
+/** Parts of the recognized morphemes, one part for each recognition message.
+ * The parts are kept in chunks of fixed size which are never modified after
+ * they are full, so copies share them. Only the last chunk is copied when a
+ * part is added, and the list of the full chunks when the last one fills,
+ * so copying and appending don't get slower as the recognition grows. */
+class RecognizedParts
+{
+public:
+
+  typedef std::shared_ptr<const MorphemeList> Part;
+
+  RecognizedParts() : m_size(0) { }
+
+  /** \return Number of parts. */
+  inline unsigned long size() const;
+  /** \param index Index of the part, less than size().
+   * \return The part. */
+  inline const Part& operator[](unsigned long index) const;
+  /** Adds a part to the end. Copies of this object don't see it.
+   * \param part The part. */
+  void push_back(const Part &part);
+  /** Removes all parts. */
+  void clear();
+
+private:
+
+  /** Parts in one chunk. */
+  static const unsigned long chunk_size = 64;
+
+  typedef std::vector<Part> Chunk;
+  typedef std::vector<std::shared_ptr<const Chunk> > ChunkList;
+
+  std::shared_ptr<const ChunkList> m_full; //!< Full chunks, or NULL.
+  std::shared_ptr<const Chunk> m_last; //!< The chunk being filled, or NULL.
+  unsigned long m_size; //!< Number of parts.
+};
+
+unsigned long
+RecognizedParts::size() const
+{
+  return this->m_size;
+}
+
+const RecognizedParts::Part&
+RecognizedParts::operator[](unsigned long index) const
+{
+  unsigned long chunk = index / chunk_size;
+  if (this->m_full && chunk < this->m_full->size())
+    return (*(*this->m_full)[chunk])[index % chunk_size];
+  return (*this->m_last)[index % chunk_size];
+}
+
+/** Recognition as it was after some recognition message. A snapshot is never
+ * modified after it has been published, so the gui can read it without
+ * locking. The recognized part only grows, so it is stored in parts: the
+ * next snapshot shares the old parts and adds a new one. */
+struct RecognitionSnapshot
+{
+  RecognitionSnapshot() : recognized_size(0), frame(0),
+                          result_true_called(false) { }
+
+  /** Recognized morphemes in the order of the recognition messages. */
+  RecognizedParts recognized;
+  unsigned long recognized_size; //!< Number of recognized morphemes.
+  MorphemeList hypothesis; //!< List of hypothesis morphemes.
+  unsigned long frame; //!< The last frame of the recognition.
+  /** The whole recognition has been received (message_result(true) has been
+   * called in the recognizer). */
+  bool result_true_called;
+};
 
 /** Data structure containing a morpheme lists both for recognized part and
  * hypothesis part. Recognitions are passed as a message to parse function.
@@ -40,6 +126,9 @@ public:
 
   /** If word based recognition or not */
   static bool words;
+
+  /** If the spectrogram shows the spectrum of the recognizer front end. */
+  static bool frontend_spectrum;
   
   /** Constructs the object. */
   RecognizerStatus();
@@ -66,10 +155,41 @@ public:
   void recognition_end();
   /** \return The adaptation status of the recognizer. */
   AdaptationStatus get_adaptation_status() const;
+
+  /** Call when M_DECODER_STATUS is received.
+   * \param message The message data: "beam float token_limit int".
+   * \param length Length of the message. */
+  void set_decoder_status(const char *message, unsigned long length);
+  /** \return The beam the decoder uses, 0 if not known. */
+  float get_beam() const;
+  /** \return The token limit the decoder uses, 0 if not known. */
+  int get_token_limit() const;
+  /** Call when M_DECODER_STATS is received.
+   * \param message The message data, see msg::M_DECODER_STATS.
+   * \param length Length of the message. */
+  void set_decoder_stats(const char *message, unsigned long length);
+  /** \return Average search time of a frame in the latest statistics in
+   * milliseconds, 0 if not known. */
+  float get_frame_time() const;
+
+  /** Call when M_AUDIO_DROPPED is received. Frames of the recognizer skip
+   * the dropped audio from then on. Only the thread calling apply may call
+   * this and the functions below.
+   * \param message The message data: "sample samples".
+   * \param length Length of the message. */
+  void add_dropped_audio(const char *message, unsigned long length);
+  /** \param frame Frame index of the recognizer.
+   * \return Index of the audio frame the recognizer frame starts at. */
+  unsigned long get_audio_frame(unsigned long frame) const;
+  /** Converts the frames of a parsed recognition to audio frames.
+   * \param update The update made by parse function. */
+  void to_audio_frames(RecognitionUpdate &update) const;
   
   /**
-   * Takes a recognition message as a parameter and updates recognized text
-   * and hypothesis according to that.
+   * Parses a recognition message into an update. Does not touch any object,
+   * so it can be called in any thread. The message is read in one pass
+   * without copying it. Morphemes are written to the vectors of the update,
+   * so reusing the same update for the next message avoids allocations.
    * \param message Formatted string containing the information: starting
    *                and ending frames for every morpheme and separation of
    *                hypothesis and recognition by * .
@@ -78,38 +198,51 @@ public:
    *                  "120 sana 135"
    *                  "101"
    *                  "* 120 hypo 151 teesi 174"
+   * \param length Length of the message.
+   * \param update The parsed recognition is written here.
    * */
-  void parse(const std::string &message);
+  static void parse(const char *message, unsigned long length,
+                    RecognitionUpdate &update);
+  /** Updates recognized text and hypothesis according to a parsed
+   * recognition message and publishes a new snapshot of them. Only one
+   * thread (the one reading the recognizer) may call this.
+   * \param update The update made by parse function. */
+  void apply(const RecognitionUpdate &update);
+  /** Takes the latest published snapshot into use in the gui thread. Never
+   * blocks.
+   * \return true if there was a new snapshot. */
+  bool update_snapshot();
+  /** \return The snapshot taken into use by update_snapshot. Valid until the
+   * next call to update_snapshot or reset. Use only in the gui thread. */
+  inline const RecognitionSnapshot& get_snapshot() const;
   
   /** Function returns when no other thread has lock on. You can use lock
-   * function if you want to synchronize threads.
+   * function if you want to synchronize threads. Recognitions are not
+   * protected by the lock, only the status.
    * 
    * NOTE: A bit stupid to have locks here: what does this data structure
    *       know about threads. Maybe there's a better way to do this? */
   inline void lock();
   /** Releases the lock for this thread. */
   inline void unlock();
-  
-  /** \return List of morphemes considered as hypothesis. */
-  inline const MorphemeList& get_hypothesis() const;
-  
-  /** \return List of morphemes considered recognized. */
-  inline const MorphemeList& get_recognized() const;
-
-  /** \return The last frame of the whole recognition and hypothesis. */
-  inline unsigned long get_recognition_frame() const;
 
-  /** \return Recognized and hypothesis morphemes as a text. */
+  /** \return Recognized and hypothesis morphemes of the current snapshot as
+   * a text. */
   std::string get_recognition_text() const;
   
-  /** Clears all morphemes and recognition frame. */
-  void reset();
+  /** \return Spectra received from the recognizer front end. */
+  inline FrontEndSpectrum* get_spectrum();
 
-  /** message_result(true) has been called */
-  bool m_message_result_true_called;
+  /** Clears all morphemes, recognition frame and front end spectra. Must not
+   * be called while the thread calling apply may be running. */
+  void reset();
   
 protected:
   
+  /** Converts the frames of the morphemes to audio frames.
+   * \param morphemes Morphemes to convert. */
+  void to_audio_frames(MorphemeList &morphemes) const;
+
   /** Writes morpheme into the string.
    * \param str Writes morphemes into this string.
    * \param morphemes Morphemes to write. */
@@ -119,22 +252,36 @@ protected:
   /** Copies the morpheme to the data string. Changes "<w> to " " and
    * "</s>" to ".". Ignores "<s>" to "".
    * \param data Destination of the copy.
-   * \param morpheme Source of the copy. */
-  static void write_morpheme_data(std::string &data,
-                                  const std::string &morpheme);
+   * \param morpheme Source of the copy.
+   * \param length Length of the morpheme. */
+  static void write_morpheme_data(std::string &data, const char *morpheme,
+                                  unsigned long length);
                                   
 private:
 
-  MorphemeList m_hypothesis; //!< List of hypothesis morphemes.
-  MorphemeList m_recognized; //!< List of recognized morphemes.
+  /** The latest recognition. Used by apply to build the next snapshot. */
+  RecognitionSnapshot m_latest;
+  /** Published snapshot waiting for the gui, or NULL. The writer exchanges a
+   * new one in and deletes the one it gets back, the gui exchanges NULL in
+   * and keeps what it gets. */
+  std::atomic<RecognitionSnapshot*> m_published;
+  /** The snapshot used by the gui. */
+  std::unique_ptr<RecognitionSnapshot> m_snapshot;
 
-  unsigned long m_recognition_frame; //!< Frame set by user.
+  /** Spectra received from the front end. Has its own lock. */
+  FrontEndSpectrum m_spectrum;
 
   pthread_mutex_t m_lock; //!< Lock for users of this class.
   
   RecognitionStatus m_recognition_status;
   AdaptationStatus m_adaptation_status;
   bool m_was_adapting_when_reseted;
+  float m_beam; //!< Current beam of the decoder.
+  int m_token_limit; //!< Current token limit of the decoder.
+  float m_frame_time; //!< Search milliseconds per frame of the decoder.
+  /** Audio dropped by the recognizer: the recognizer sample after the
+   * dropped audio and the samples dropped before it in total. */
+  std::vector<std::pair<unsigned long, unsigned long> > m_dropped;
 };
 
 void
@@ -149,22 +296,16 @@ RecognizerStatus::unlock()
   pthread_mutex_unlock(&this->m_lock);
 }
 
-const MorphemeList&
-RecognizerStatus::get_hypothesis() const
+FrontEndSpectrum*
+RecognizerStatus::get_spectrum()
 {
-  return this->m_hypothesis;
+  return &m_spectrum;
 }
 
-const MorphemeList&
-RecognizerStatus::get_recognized() const
-{
-  return this->m_recognized;
-}
-
-unsigned long
-RecognizerStatus::get_recognition_frame() const
+const RecognitionSnapshot&
+RecognizerStatus::get_snapshot() const
 {
-  return this->m_recognition_frame;
+  return *this->m_snapshot;
 }
 
 void
@@ -0,0 +1,227 @@
+#include <math.h>
+#include <string.h>
+#include "Resampler.hh"
+
+// Zero crossings of the sinc on each side of the center, at the lower of
+// the two rates. More gives a sharper cutoff.
+static const unsigned int zero_crossings = 16;
+// Passband edge relative to the Nyquist frequency of the lower rate.
+static const double rolloff = 0.92;
+// Shape of the Kaiser window, about 80 dB stopband attenuation.
+static const double kaiser_beta = 8.0;
+
+static unsigned int
+gcd(unsigned int a, unsigned int b)
+{
+  while (b) {
+    unsigned int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/** Modified Bessel function of the first kind and order zero. */
+static double
+bessel_i0(double x)
+{
+  double sum = 1, term = 1;
+  for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+/** Dot product of a filter branch and the input. Four independent sums let
+ * the compiler keep them in one SIMD register. */
+static inline float
+dot_product(const float *filter, const float *input, unsigned int taps)
+{
+  float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+  unsigned int i = 0;
+  for (; i + 4 <= taps; i += 4) {
+    sum0 += filter[i] * input[i];
+    sum1 += filter[i + 1] * input[i + 1];
+    sum2 += filter[i + 2] * input[i + 2];
+    sum3 += filter[i + 3] * input[i + 3];
+  }
+  for (; i < taps; i++)
+    sum0 += filter[i] * input[i];
+  return (sum0 + sum1) + (sum2 + sum3);
+}
+
+Resampler::Resampler()
+{
+  this->configure(1, 1, 1, 0);
+}
+
+bool
+Resampler::configure(unsigned int from_rate,
+                     unsigned int to_rate,
+                     unsigned int channels,
+                     unsigned long max_frames)
+{
+  if (!from_rate || !to_rate || !channels)
+    return false;
+
+  unsigned int divisor = gcd(from_rate, to_rate);
+  this->m_up = to_rate / divisor;
+  this->m_down = from_rate / divisor;
+  this->m_channels = channels;
+
+  if (this->m_up == this->m_down) {
+    // Only down-mixing.
+    this->m_taps = 1;
+    this->m_filters.assign(1, 1.0f);
+  }
+  else {
+    // The cutoff is below the Nyquist frequency of the lower rate. When
+    // reducing the rate the sinc is wider in input samples.
+    double ratio = (double)this->m_up / this->m_down;
+    double cutoff = 0.5 * rolloff * (ratio < 1 ? ratio : 1);
+    this->m_taps =
+      (unsigned int)ceil(2 * zero_crossings * (ratio < 1 ? 1 / ratio : 1));
+
+    // Prototype filter at the upsampled rate, coefficient k is at time
+    // (k - center) / m_up input samples. Branch p has the coefficients
+    // p + m_up * t, reversed to the order of the input. The center is a
+    // whole number of input samples, the delay reset() compensates.
+    unsigned long length = (unsigned long)this->m_up * this->m_taps;
+    double center = (double)((this->m_taps - 1) / 2) * this->m_up;
+    double half_width = length - center;
+    this->m_filters.resize(length);
+    for (unsigned int phase = 0; phase < this->m_up; phase++) {
+      float *branch = &this->m_filters[phase * this->m_taps];
+      double sum = 0;
+      for (unsigned int t = 0; t < this->m_taps; t++) {
+        unsigned long k = phase + (unsigned long)this->m_up * t;
+        double x = (k - center) / this->m_up;
+        double sinc = x == 0 ? 2 * cutoff :
+          sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double position = (k - center) / half_width;
+        double window = bessel_i0(kaiser_beta * sqrt(1 - position * position)) /
+          bessel_i0(kaiser_beta);
+        branch[this->m_taps - 1 - t] = (float)(sinc * window);
+        sum += sinc * window;
+      }
+      // Every branch passes the DC as is.
+      for (unsigned int t = 0; t < this->m_taps; t++)
+        branch[t] = (float)(branch[t] / sum);
+    }
+  }
+
+  // History, the input and the zeros written by finish().
+  this->m_buffer.resize(2 * this->m_taps + max_frames);
+  this->reset();
+  return true;
+}
+
+void
+Resampler::reset()
+{
+  // The filter is centered, so the history starts with the zeros before
+  // the input that the first output sample needs.
+  unsigned int delay = (this->m_taps - 1) / 2;
+  this->m_buffered = this->m_taps - 1 - delay;
+  memset(&this->m_buffer[0], 0, this->m_buffered * sizeof(float));
+  this->m_index = this->m_taps - 1;
+  this->m_phase = 0;
+  this->m_finished = false;
+  this->m_input_frames = 0;
+  this->m_output_frames = 0;
+  this->m_end = 0;
+}
+
+unsigned long
+Resampler::write(const float *input, unsigned long frames)
+{
+  // Drop the samples no output needs any more. The next output may be
+  // past the buffered samples, then the first written ones are skipped.
+  unsigned long drop = this->m_index - (this->m_taps - 1);
+  if (drop > this->m_buffered)
+    drop = this->m_buffered;
+  if (drop > 0) {
+    memmove(&this->m_buffer[0], &this->m_buffer[drop],
+            (this->m_buffered - drop) * sizeof(float));
+    this->m_buffered -= drop;
+    this->m_index -= drop;
+  }
+
+  unsigned long room = this->m_buffer.size() - this->m_buffered;
+  if (frames > room)
+    frames = room;
+
+  float *to = &this->m_buffer[this->m_buffered];
+  if (this->m_channels == 1) {
+    memcpy(to, input, frames * sizeof(float));
+  }
+  else {
+    float scale = 1.0f / this->m_channels;
+    for (unsigned long i = 0; i < frames; i++) {
+      float sum = 0;
+      for (unsigned int c = 0; c < this->m_channels; c++)
+        sum += *input++;
+      to[i] = sum * scale;
+    }
+  }
+  this->m_buffered += frames;
+  this->m_input_frames += frames;
+  return frames;
+}
+
+void
+Resampler::finish()
+{
+  if (this->m_finished)
+    return;
+
+  // The last output samples need the zeros after the input, as many as the
+  // filter is delayed.
+  unsigned int delay = (this->m_taps - 1) / 2;
+  unsigned long zeros = this->m_buffer.size() - this->m_buffered;
+  if (zeros > delay)
+    zeros = delay;
+  memset(&this->m_buffer[this->m_buffered], 0, zeros * sizeof(float));
+  this->m_buffered += zeros;
+
+  this->m_end = (this->m_input_frames * this->m_up + this->m_down - 1) /
+    this->m_down;
+  this->m_finished = true;
+}
+
+unsigned long
+Resampler::read(float *output, unsigned long frames)
+{
+  if (this->m_finished && this->m_output_frames + frames > this->m_end)
+    frames = this->m_end - this->m_output_frames;
+
+  const unsigned int taps = this->m_taps;
+  unsigned long count = 0;
+  while (count < frames && this->m_index < this->m_buffered) {
+    const float *branch = &this->m_filters[this->m_phase * taps];
+    output[count++] = dot_product(branch,
+                                  &this->m_buffer[this->m_index + 1 - taps],
+                                  taps);
+    this->m_phase += this->m_down;
+    this->m_index += this->m_phase / this->m_up;
+    this->m_phase %= this->m_up;
+  }
+  this->m_output_frames += count;
+  return count;
+}
+
+unsigned long
+Resampler::get_needed_input(unsigned long frames) const
+{
+  if (frames == 0)
+    return 0;
+
+  // The newest input sample of the last wanted output.
+  unsigned long long last = this->m_index +
+    (this->m_phase + (unsigned long long)(frames - 1) * this->m_down) /
+    this->m_up;
+  if (last < this->m_buffered)
+    return 0;
+  return last + 1 - this->m_buffered;
+}
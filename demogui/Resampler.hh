@@ -0,0 +1,98 @@
+#ifndef RESAMPLER_HH_
+#define RESAMPLER_HH_
+
+#include <vector>
+
+/** Converts audio from one sample rate to another and down-mixes the
+ * channels to mono. The conversion is a polyphase windowed sinc filter:
+ * the rates are reduced to a ratio up/down and the filter is split into
+ * one branch per output phase, so every output sample costs one short dot
+ * product over the latest input samples. The filter is delayed so that
+ * the output is aligned with the input.
+ *
+ * Input is written and output read in pieces of any size. After
+ * configure(), writing, reading and get_needed_input() never allocate, so
+ * the resampler can be used in the audio callback. Samples are floats in
+ * any scale, the scale is kept. */
+class Resampler
+{
+
+public:
+
+  Resampler();
+
+  /** Designs the filter and clears the state. Allocates memory.
+   * \param from_rate Sample rate of the input.
+   * \param to_rate Sample rate of the output.
+   * \param channels Number of interleaved channels in the input.
+   * \param max_frames Most input frames written at a time.
+   * \return false if a rate or the channel count is zero. */
+  bool configure(unsigned int from_rate,
+                 unsigned int to_rate,
+                 unsigned int channels,
+                 unsigned long max_frames);
+  /** Clears the input and output, keeps the filter. */
+  void reset();
+
+  /** Appends input frames. Read the output before writing more than the
+   * max_frames given to configure().
+   * \param input Interleaved input samples.
+   * \param frames Number of input frames.
+   * \return Number of frames taken, less than frames if out of room. */
+  unsigned long write(const float *input, unsigned long frames);
+  /** Marks the end of the input, so the output of the last input frames
+   * can be read. Write nothing after this before reset(). */
+  void finish();
+
+  /** Reads output samples.
+   * \param output The samples are stored here.
+   * \param frames Most samples to read.
+   * \return Number of samples read. Zero when more input is needed. */
+  unsigned long read(float *output, unsigned long frames);
+
+  /** \param frames Number of output samples wanted.
+   * \return Number of input frames to write before that many samples can
+   * be read. */
+  unsigned long get_needed_input(unsigned long frames) const;
+  /** \return Length of a filter branch in input samples. */
+  inline unsigned int get_taps() const;
+  /** \return true if the rates are equal and the input is mono, so the
+   * output is the input. */
+  inline bool is_identity() const;
+
+private:
+
+  unsigned int m_up; //!< Output samples per m_down input samples.
+  unsigned int m_down; //!< Input samples per m_up output samples.
+  unsigned int m_channels; //!< Channels of the input.
+  unsigned int m_taps; //!< Coefficients in a filter branch.
+  /** Filter branch of each phase, m_taps coefficients each in the order of
+   * the input samples they are multiplied with. */
+  std::vector<float> m_filters;
+
+  /** Mono input. The first samples are the history the next output sample
+   * needs. */
+  std::vector<float> m_buffer;
+  unsigned long m_buffered; //!< Number of samples in m_buffer.
+  unsigned long m_index; //!< Newest input sample of the next output.
+  unsigned int m_phase; //!< Filter phase of the next output.
+
+  bool m_finished; //!< No more input is coming.
+  unsigned long long m_input_frames; //!< Input frames written.
+  unsigned long long m_output_frames; //!< Output samples read.
+  unsigned long long m_end; //!< Output samples of the whole input.
+};
+
+unsigned int
+Resampler::get_taps() const
+{
+  return this->m_taps;
+}
+
+bool
+Resampler::is_identity() const
+{
+  return this->m_up == this->m_down && this->m_channels == 1;
+}
+
+#endif /*RESAMPLER_HH_*/
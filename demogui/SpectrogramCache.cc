@@ -0,0 +1,137 @@
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "SpectrogramCache.hh"
+
+SpectrogramCache::SpectrogramCache(unsigned int bins, unsigned long max_bytes)
+  : m_generation(0), m_bins(bins)
+{
+  this->m_max_blocks = max_bytes / (bins * block_columns * sizeof(Level));
+  if (this->m_max_blocks < 2)
+    this->m_max_blocks = 2;
+  pthread_mutex_init(&this->m_lock, NULL);
+}
+
+SpectrogramCache::~SpectrogramCache()
+{
+  pthread_mutex_destroy(&this->m_lock);
+}
+
+SpectrogramCache::Block*
+SpectrogramCache::find_block(unsigned long column, bool create)
+{
+  unsigned long key = column / block_columns;
+  BlockMap::iterator iter = this->m_blocks.find(key);
+
+  if (iter != this->m_blocks.end()) {
+    // Move to the front of the usage list.
+    this->m_usage.splice(this->m_usage.begin(), this->m_usage,
+                         iter->second.usage);
+    return &iter->second;
+  }
+  if (!create)
+    return NULL;
+
+  // Throw away the least recently used block.
+  if (this->m_blocks.size() >= this->m_max_blocks) {
+    this->m_blocks.erase(this->m_usage.back());
+    this->m_usage.pop_back();
+  }
+
+  Block &block = this->m_blocks[key];
+  block.levels.resize(this->m_bins * block_columns);
+  block.ready.resize(block_columns, false);
+  this->m_usage.push_front(key);
+  block.usage = this->m_usage.begin();
+  return &block;
+}
+
+bool
+SpectrogramCache::get(unsigned long column, Level *levels)
+{
+  unsigned int offset = column % block_columns;
+  bool found = false;
+
+  pthread_mutex_lock(&this->m_lock);
+  Block *block = this->find_block(column, false);
+  if (block && block->ready[offset]) {
+    memcpy(levels, &block->levels[offset * this->m_bins],
+           this->m_bins * sizeof(Level));
+    found = true;
+  }
+  pthread_mutex_unlock(&this->m_lock);
+  return found;
+}
+
+bool
+SpectrogramCache::contains(unsigned long column)
+{
+  pthread_mutex_lock(&this->m_lock);
+  BlockMap::const_iterator iter = this->m_blocks.find(column / block_columns);
+  bool found = iter != this->m_blocks.end() &&
+    iter->second.ready[column % block_columns];
+  pthread_mutex_unlock(&this->m_lock);
+  return found;
+}
+
+void
+SpectrogramCache::put(unsigned long column,
+                      const Level *levels,
+                      unsigned long generation)
+{
+  unsigned int offset = column % block_columns;
+
+  pthread_mutex_lock(&this->m_lock);
+  if (generation == this->m_generation) {
+    Block *block = this->find_block(column, true);
+    memcpy(&block->levels[offset * this->m_bins], levels,
+           this->m_bins * sizeof(Level));
+    block->ready[offset] = true;
+  }
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+SpectrogramCache::clear()
+{
+  pthread_mutex_lock(&this->m_lock);
+  this->m_blocks.clear();
+  this->m_usage.clear();
+  this->m_generation++;
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+unsigned long
+SpectrogramCache::get_generation()
+{
+  pthread_mutex_lock(&this->m_lock);
+  unsigned long generation = this->m_generation;
+  pthread_mutex_unlock(&this->m_lock);
+  return generation;
+}
+
+void
+SpectrogramCache::calculate_levels(const double *halfcomplex,
+                                   unsigned int window_width,
+                                   Level *levels)
+{
+  unsigned int range = window_width / 2;
+  double power;
+
+  for (unsigned int ind = 0; ind < range; ind++) {
+    // Real part is at ind and imaginary part at window_width - ind. The
+    // imaginary part of the DC component is zero and not stored.
+    power = halfcomplex[ind] * halfcomplex[ind];
+    if (ind > 0)
+      power += halfcomplex[window_width - ind] * halfcomplex[window_width - ind];
+
+    // Quantize the logarithm of the power.
+    if (power < 1) {
+      levels[ind] = 0;
+    }
+    else {
+      double level = log10(power) * levels_per_decade + 1;
+      levels[ind] = level < power_levels - 1 ? (unsigned int)level : power_levels - 1;
+    }
+  }
+}
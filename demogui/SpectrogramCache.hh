@@ -0,0 +1,107 @@
+#ifndef SPECTROGRAMCACHE_HH_
+#define SPECTROGRAMCACHE_HH_
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <vector>
+
+/** Cache for spectrogram columns. A column is the spectrum of one hop of
+ * audio, stored as quantized levels of the logarithmic power, so that the
+ * mapping into colors can be done with a lookup table. Columns are stored in
+ * blocks, and when the cache grows too big, the least recently used block
+ * is thrown away.
+ *
+ * The cache is shared by the gui and the SpectrogramWorker thread, so the
+ * columns are copied in and out under a lock. Each clear() starts a new
+ * generation, and columns calculated for an older generation are not
+ * stored. */
+class SpectrogramCache
+{
+
+public:
+
+  /** Type of a quantized power level. */
+  typedef unsigned short Level;
+
+  /** Number of power levels. */
+  static const unsigned int power_levels = 4096;
+  /** Power levels per decade of power. 4096 levels of 0.05 dB cover the
+   * whole range of 16 bit audio. */
+  static const unsigned int levels_per_decade = 200;
+
+  /** Constructs an empty cache.
+   * \param bins Number of frequency bins in a column.
+   * \param max_bytes Maximum memory usage of the stored columns. */
+  SpectrogramCache(unsigned int bins, unsigned long max_bytes = 64 << 20);
+  /** Destructs the cache. */
+  ~SpectrogramCache();
+
+  /** Copies a column from the cache.
+   * \param column Index of the column (audio position divided by hop size).
+   * \param levels The levels of the column are written here.
+   * \return false if the column is not cached. */
+  bool get(unsigned long column, Level *levels);
+  /** \param column Index of the column.
+   * \return true if the column is cached. */
+  bool contains(unsigned long column);
+  /** Stores a column to the cache.
+   * \param column Index of the column.
+   * \param levels The levels of the column.
+   * \param generation Generation of the audio the column was calculated
+   *                   from. The column is ignored if the cache has been
+   *                   cleared after get_generation() returned this. */
+  void put(unsigned long column, const Level *levels, unsigned long generation);
+
+  /** Throws away all columns, e.g. when the audio changes. */
+  void clear();
+  /** \return Current generation of the cache. */
+  unsigned long get_generation();
+
+  /** Calculates the quantized power spectrum from an fftw R2HC output.
+   * \param halfcomplex Output of a real to halfcomplex transform.
+   * \param window_width Length of the transform.
+   * \param levels window_width / 2 levels are written here. */
+  static void calculate_levels(const double *halfcomplex,
+                               unsigned int window_width,
+                               Level *levels);
+
+  /** \return Number of frequency bins in a column. */
+  inline unsigned int get_bins() const;
+
+private:
+
+  /** Columns in one block. */
+  static const unsigned int block_columns = 256;
+
+  /** Consecutive columns. */
+  struct Block
+  {
+    std::vector<Level> levels; //!< Levels of all columns in the block.
+    std::vector<bool> ready; //!< Which columns have been calculated.
+    std::list<unsigned long>::iterator usage; //!< Position in usage list.
+  };
+
+  typedef std::map<unsigned long, Block> BlockMap;
+
+  /** Finds the block of the column and marks it used.
+   * \param column Index of the column.
+   * \param create Create the block if it doesn't exist.
+   * \return The block or NULL. */
+  Block* find_block(unsigned long column, bool create);
+
+  pthread_mutex_t m_lock; //!< Lock for the blocks.
+  unsigned long m_generation; //!< Incremented by clear().
+  unsigned int m_bins; //!< Frequency bins in a column.
+  unsigned long m_max_blocks; //!< Maximum number of blocks.
+  BlockMap m_blocks; //!< Blocks by their first column / block_columns.
+  std::list<unsigned long> m_usage; //!< Block keys, most recent first.
+};
+
+unsigned int
+SpectrogramCache::get_bins() const
+{
+  return this->m_bins;
+}
+
+#endif /*SPECTROGRAMCACHE_HH_*/
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "SpectrogramWorker.hh"
+
+/** \return Name of the file where fftw wisdom is kept. */
+static std::string
+wisdom_filename()
+{
+  const char *home = getenv("HOME");
+  if (!home || !*home)
+    home = "/tmp";
+  return std::string(home) + "/.demogui-fftw-wisdom";
+}
+
+SpectrogramWorker::SpectrogramWorker(AudioInputController *audio_input,
+                                     SpectrogramCache *cache,
+                                     unsigned int window_width,
+                                     double samples_per_pixel)
+  : m_audio_input(audio_input),
+    m_cache(cache),
+    m_window_width(window_width),
+    m_samples_per_pixel(samples_per_pixel)
+{
+  int size = window_width;
+  fftw_r2r_kind kind = FFTW_R2HC;
+
+  this->m_data_in =
+    (double*)fftw_malloc(sizeof(double) * window_width * batch_columns);
+  this->m_data_out =
+    (double*)fftw_malloc(sizeof(double) * window_width * batch_columns);
+  this->m_levels = new SpectrogramCache::Level[window_width / 2];
+
+  // Measuring takes a while the first time, later the wisdom is loaded from
+  // the disk.
+  this->m_plan = fftw_plan_many_r2r(1, &size, batch_columns,
+                                    this->m_data_in, NULL, 1, window_width,
+                                    this->m_data_out, NULL, 1, window_width,
+                                    &kind, FFTW_MEASURE);
+  // Planning overwrote the arrays.
+  memset(this->m_data_in, 0, sizeof(double) * window_width * batch_columns);
+
+  pthread_mutex_init(&this->m_lock, NULL);
+  pthread_cond_init(&this->m_condition, NULL);
+  this->m_thread_created = false;
+  this->m_stop = false;
+  this->m_requested = false;
+  this->m_first = 0;
+  this->m_end = 0;
+  this->m_generation = 0;
+}
+
+SpectrogramWorker::~SpectrogramWorker()
+{
+  if (this->m_thread_created)
+    this->stop();
+
+  pthread_cond_destroy(&this->m_condition);
+  pthread_mutex_destroy(&this->m_lock);
+
+  fftw_destroy_plan(this->m_plan);
+  fftw_free(this->m_data_in);
+  fftw_free(this->m_data_out);
+  delete [] this->m_levels;
+}
+
+void
+SpectrogramWorker::load_wisdom()
+{
+  // Missing file is fine, the plans are just measured again.
+  fftw_import_wisdom_from_filename(wisdom_filename().c_str());
+}
+
+void
+SpectrogramWorker::save_wisdom()
+{
+  if (!fftw_export_wisdom_to_filename(wisdom_filename().c_str())) {
+    fprintf(stderr, "Warning: Couldn't save fftw wisdom to %s.\n",
+            wisdom_filename().c_str());
+  }
+}
+
+bool
+SpectrogramWorker::start()
+{
+  if (this->m_thread_created) {
+    fprintf(stderr, "Can't create thread for spectrogram: "
+            "thread already created.\n");
+    return false;
+  }
+
+  this->m_stop = false;
+
+  if (pthread_create(&this->m_thread, NULL,
+                     SpectrogramWorker::callback, this) != 0) {
+    fprintf(stderr, "Couldn't create thread for spectrogram.\n");
+    return false;
+  }
+
+  this->m_thread_created = true;
+  return true;
+}
+
+void
+SpectrogramWorker::stop()
+{
+  if (this->m_thread_created) {
+    pthread_mutex_lock(&this->m_lock);
+    this->m_stop = true;
+    pthread_cond_signal(&this->m_condition);
+    pthread_mutex_unlock(&this->m_lock);
+    pthread_join(this->m_thread, NULL);
+    this->m_thread_created = false;
+  }
+  else {
+    fprintf(stderr, "Warning: Trying to join thread that is not created "
+                    "in SpectrogramWorker::stop.\n");
+  }
+}
+
+void
+SpectrogramWorker::request(unsigned long first, unsigned long count)
+{
+  unsigned long audio_size = this->m_audio_input->get_audio_data_size();
+  unsigned long generation = this->m_cache->get_generation();
+  unsigned long end = first + count * (1 + lookahead_views);
+  unsigned long complete = 0;
+
+  // Columns which have a full window of audio.
+  if (audio_size >= this->m_window_width)
+    complete = (unsigned long)((audio_size - this->m_window_width) /
+                               this->m_samples_per_pixel) + 1;
+  if (end > complete)
+    end = complete;
+
+  pthread_mutex_lock(&this->m_lock);
+  if (first != this->m_first || end != this->m_end ||
+      generation != this->m_generation) {
+    this->m_first = first;
+    this->m_end = end;
+    this->m_generation = generation;
+    this->m_requested = true;
+    pthread_cond_signal(&this->m_condition);
+  }
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void*
+SpectrogramWorker::callback(void *user_data)
+{
+  ((SpectrogramWorker*)user_data)->run();
+  return NULL;
+}
+
+void
+SpectrogramWorker::run()
+{
+  unsigned long first;
+  unsigned long end;
+
+  pthread_mutex_lock(&this->m_lock);
+  while (!this->m_stop) {
+    if (!this->m_requested) {
+      pthread_cond_wait(&this->m_condition, &this->m_lock);
+      continue;
+    }
+    this->m_requested = false;
+    first = this->m_first;
+    end = this->m_end;
+
+    pthread_mutex_unlock(&this->m_lock);
+    this->fill(first, end);
+    pthread_mutex_lock(&this->m_lock);
+  }
+  pthread_mutex_unlock(&this->m_lock);
+}
+
+void
+SpectrogramWorker::fill(unsigned long first, unsigned long end)
+{
+  unsigned long columns[batch_columns];
+  unsigned int count = 0;
+  bool interrupted;
+
+  for (unsigned long column = first; column < end; column++) {
+    if (!this->m_cache->contains(column))
+      columns[count++] = column;
+
+    if (count == batch_columns || (count > 0 && column + 1 == end)) {
+      this->calculate(columns, count);
+      count = 0;
+
+      // Start over if the gui has scrolled or the thread is stopped.
+      pthread_mutex_lock(&this->m_lock);
+      interrupted = this->m_requested || this->m_stop;
+      pthread_mutex_unlock(&this->m_lock);
+      if (interrupted)
+        return;
+    }
+  }
+}
+
+void
+SpectrogramWorker::calculate(const unsigned long *columns, unsigned int count)
+{
+  bool complete[batch_columns];
+  unsigned long generation;
+
+  // Copy the audio under the lock, so the controller can't be reset under us.
+  // Columns calculated from audio that was reset are thrown away by the
+  // cache because it has been cleared after the generation was read.
+  this->m_audio_input->lock();
+  generation = this->m_cache->get_generation();
+  unsigned long audio_size = this->m_audio_input->get_audio_data_size();
+  const AUDIO_FORMAT *audio_data = this->m_audio_input->get_audio_data();
+  for (unsigned int ind = 0; ind < count; ind++) {
+    double *data_in = this->m_data_in + ind * this->m_window_width;
+    unsigned long from = (unsigned long)(columns[ind] * this->m_samples_per_pixel);
+
+    complete[ind] = from + this->m_window_width <= audio_size;
+    if (!complete[ind])
+      continue;
+    for (unsigned int jnd = 0; jnd < this->m_window_width; jnd++)
+      data_in[jnd] = (double)audio_data[from + jnd];
+  }
+  this->m_audio_input->unlock();
+
+  // Columns after count are left over from earlier batches, the transform
+  // is cheap enough that a plan for a partial batch isn't worth it.
+  fftw_execute(this->m_plan);
+
+  for (unsigned int ind = 0; ind < count; ind++) {
+    if (!complete[ind])
+      continue;
+    SpectrogramCache::calculate_levels(this->m_data_out + ind * this->m_window_width,
+                                       this->m_window_width,
+                                       this->m_levels);
+    this->m_cache->put(columns[ind], this->m_levels, generation);
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef SPECTROGRAMWORKER_HH_
+#define SPECTROGRAMWORKER_HH_
+
+#include <pthread.h>
+#include <fftw3.h>
+#include "AudioInputController.hh"
+#include "SpectrogramCache.hh"
+
+/** Calculates spectrogram columns into a SpectrogramCache in an own thread.
+ * The gui tells which columns it is going to draw with request(), and the
+ * thread calculates the missing ones in batches with one fftw plan, first
+ * the requested range and then ahead of it, so the gui seldom has to
+ * calculate columns itself.
+ *
+ * Audio is copied from the controller under its lock, so resetting the
+ * controller is safe while the thread is running. */
+class SpectrogramWorker
+{
+
+public:
+
+  /** Constructs the worker and plans the batched transform. Should be
+   * constructed in the gui thread, because fftw planning is not thread-safe.
+   * \param audio_input Audio source.
+   * \param cache Cache to fill.
+   * \param window_width Length of the transform.
+   * \param samples_per_pixel Audio samples between two columns. */
+  SpectrogramWorker(AudioInputController *audio_input,
+                    SpectrogramCache *cache,
+                    unsigned int window_width,
+                    double samples_per_pixel);
+  /** Stops the thread and destroys the plan. */
+  ~SpectrogramWorker();
+
+  /** Starts a new thread which fills the cache.
+   * \return false if thread already active or thread creation failed. */
+  bool start();
+  /** Stops the thread. When function returns, you can be sure that the
+   * thread has really finished. */
+  void stop();
+
+  /** Tells the thread which columns the gui is drawing. The thread
+   * calculates these columns and the lookahead after them, as far as there
+   * is a full window of audio.
+   * \param first First visible column.
+   * \param count Number of visible columns. */
+  void request(unsigned long first, unsigned long count);
+
+  /** Loads fftw wisdom from the disk so that measured plans are found
+   * quickly. Call before planning. */
+  static void load_wisdom();
+  /** Saves fftw wisdom to the disk. Call after planning. */
+  static void save_wisdom();
+
+private:
+
+  /** Callback function for the pthread.
+   * \param user_data Pointer to the worker.
+   * \return Return value of the thread, we use NULL. */
+  static void* callback(void *user_data);
+  /** Loop of the thread. */
+  void run();
+  /** Calculates the missing columns of a range. Returns early if a new
+   * request comes.
+   * \param first First column.
+   * \param end One past the last column. */
+  void fill(unsigned long first, unsigned long end);
+  /** Calculates a batch of columns and stores them to the cache.
+   * \param columns Columns to calculate.
+   * \param count Number of columns. */
+  void calculate(const unsigned long *columns, unsigned int count);
+
+  /** Columns in one fftw batch. */
+  static const unsigned int batch_columns = 64;
+  /** How many views are calculated ahead of the visible one. */
+  static const unsigned int lookahead_views = 4;
+
+  AudioInputController *m_audio_input; //!< Audio source.
+  SpectrogramCache *m_cache; //!< Cache to fill.
+  const unsigned int m_window_width; //!< Length of the transform.
+  const double m_samples_per_pixel; //!< Audio samples between columns.
+
+  fftw_plan m_plan; //!< Plan for a batch of transforms.
+  double *m_data_in; //!< Input of the batch.
+  double *m_data_out; //!< Output of the batch.
+  SpectrogramCache::Level *m_levels; //!< Levels of one column.
+
+  pthread_mutex_t m_lock; //!< Lock for the request.
+  pthread_cond_t m_condition; //!< Signaled when a request comes.
+  pthread_t m_thread; //!< Thread structure.
+  bool m_thread_created; //!< Flag telling if thread is already active.
+  bool m_stop; //!< Flag telling when to quit the thread.
+  bool m_requested; //!< Set when the request has changed.
+  unsigned long m_first; //!< First requested column.
+  unsigned long m_end; //!< One past the last requested column.
+  unsigned long m_generation; //!< Cache generation of the request.
+};
+
+#endif /*SPECTROGRAMWORKER_HH_*/
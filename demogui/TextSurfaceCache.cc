@@ -0,0 +1,118 @@
+
+#include <pgfont.h>
+#include "TextSurfaceCache.hh"
+
+TextSurfaceCache::TextSurfaceCache(unsigned int max_size)
+  : m_max_size(max_size)
+{
+}
+
+TextSurfaceCache::~TextSurfaceCache()
+{
+  this->clear();
+}
+
+SDL_Surface*
+TextSurfaceCache::get(const std::string &text,
+                      const PG_Color &color,
+                      const PG_Color &background,
+                      PG_Font *font,
+                      const SDL_PixelFormat *format)
+{
+  SDL_Surface *surface;
+  std::string key(text);
+  Entry entry;
+
+  if (text.empty())
+    return NULL;
+
+  // The colors are part of the key.
+  key.push_back('\0');
+  key.push_back(color.r);
+  key.push_back(color.g);
+  key.push_back(color.b);
+  key.push_back(background.r);
+  key.push_back(background.g);
+  key.push_back(background.b);
+
+  EntryMap::iterator iter = this->m_entries.find(key);
+  if (iter != this->m_entries.end()) {
+    // Move to the front of the usage list.
+    this->m_usage.splice(this->m_usage.begin(), this->m_usage,
+                         iter->second.usage);
+    return iter->second.surface;
+  }
+
+  surface = this->render(text, color, background, font, format);
+  if (!surface)
+    return NULL;
+
+  // Free the least recently used surface.
+  if (this->m_entries.size() >= this->m_max_size) {
+    iter = this->m_entries.find(this->m_usage.back());
+    SDL_FreeSurface(iter->second.surface);
+    this->m_entries.erase(iter);
+    this->m_usage.pop_back();
+  }
+
+  this->m_usage.push_front(key);
+  entry.surface = surface;
+  entry.usage = this->m_usage.begin();
+  this->m_entries[key] = entry;
+  return surface;
+}
+
+void
+TextSurfaceCache::clear()
+{
+  for (EntryMap::iterator iter = this->m_entries.begin();
+       iter != this->m_entries.end();
+       iter++) {
+    SDL_FreeSurface(iter->second.surface);
+  }
+  this->m_entries.clear();
+  this->m_usage.clear();
+}
+
+SDL_Surface*
+TextSurfaceCache::render(const std::string &text,
+                         const PG_Color &color,
+                         const PG_Color &background,
+                         PG_Font *font,
+                         const SDL_PixelFormat *format)
+{
+  SDL_Surface *surface;
+  Uint16 width = 0;
+  Uint16 height = font->GetFontHeight();
+
+  PG_FontEngine::GetTextSize(text.c_str(), font, &width);
+  if (width == 0 || height == 0)
+    return NULL;
+
+  surface = SDL_CreateRGBSurface(SDL_SWSURFACE,
+                                 width,
+                                 height,
+                                 format->BitsPerPixel,
+                                 format->Rmask,
+                                 format->Gmask,
+                                 format->Bmask,
+                                 format->Amask);
+  if (!surface) {
+    fprintf(stderr, "TextSurfaceCache: Couldn't create surface.\n");
+    return NULL;
+  }
+  SDL_FillRect(surface, NULL, background.MapRGB(surface->format));
+
+  // The color is a property of the font.
+  PG_Color old_color = font->GetColor();
+  font->SetColor(color);
+  PG_FontEngine::RenderText(surface,
+                            PG_Rect(0, 0, width, height),
+                            0,
+                            font->GetFontAscender(),
+                            text.c_str(),
+                            font);
+  font->SetColor(old_color);
+
+  return surface;
+}
@@ -0,0 +1,68 @@
+#ifndef TEXTSURFACECACHE_HH_
+#define TEXTSURFACECACHE_HH_
+
+#include <list>
+#include <map>
+#include <string>
+#include <pgwidget.h>
+
+class PG_Font;
+
+/** Cache for rendered texts. Rendering a text with FreeType is slow compared
+ * to blitting a surface, and the same morphemes appear in the recognition
+ * over and over again. Texts are rendered once per color combination and
+ * kept until the cache is full, when the least recently used surface is
+ * freed. Surfaces returned by get() are valid only until the next call. */
+class TextSurfaceCache
+{
+
+public:
+
+  /** Constructs an empty cache.
+   * \param max_size Maximum number of surfaces kept in the cache. */
+  TextSurfaceCache(unsigned int max_size = 1000);
+  /** Frees the surfaces. */
+  ~TextSurfaceCache();
+
+  /** Returns a surface with the text rendered on a background color. The
+   * surface is as big as the text. The same font must be used with every
+   * call.
+   * \param text Text to render.
+   * \param color Text color.
+   * \param background Background color.
+   * \param font Font used for rendering.
+   * \param format Pixel format of the surface, e.g. from the widget.
+   * \return The rendered text or NULL if text is empty or rendering failed. */
+  SDL_Surface* get(const std::string &text,
+                   const PG_Color &color,
+                   const PG_Color &background,
+                   PG_Font *font,
+                   const SDL_PixelFormat *format);
+
+  /** Frees all surfaces. */
+  void clear();
+
+private:
+
+  /** Renders a text to a new surface. Parameters as in get(). */
+  SDL_Surface* render(const std::string &text,
+                      const PG_Color &color,
+                      const PG_Color &background,
+                      PG_Font *font,
+                      const SDL_PixelFormat *format);
+
+  /** Cached surface and its position in the usage list. */
+  struct Entry
+  {
+    SDL_Surface *surface;
+    std::list<std::string>::iterator usage;
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+
+  unsigned int m_max_size; //!< Maximum number of surfaces.
+  EntryMap m_entries; //!< Surfaces by text and colors.
+  std::list<std::string> m_usage; //!< Keys, most recently used first.
+};
+
+#endif /*TEXTSURFACECACHE_HH_*/
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include "WaveSummary.hh"
+
+void
+WaveSummary::update(const AUDIO_FORMAT *audio, unsigned long size)
+{
+  for (unsigned int level = 0; level < levels; level++) {
+    unsigned long done = this->get_blocks(level);
+    unsigned long complete;
+
+    // Blocks of the first level come from the audio, the others from the
+    // level below.
+    if (level == 0)
+      complete = size / first_block_size;
+    else
+      complete = this->get_blocks(level - 1) / branching;
+    if (complete <= done)
+      break;
+
+    Block *to = (Block*)this->m_levels[level].reserve((complete - done) * sizeof(Block));
+    if (!to) {
+      fprintf(stderr, "WaveSummary: Out of space.\n");
+      return;
+    }
+
+    for (unsigned long block = done; block < complete; block++, to++) {
+      if (level == 0) {
+        const AUDIO_FORMAT *sample = audio + block * first_block_size;
+        to->min = to->max = sample[0];
+        for (unsigned int ind = 1; ind < first_block_size; ind++) {
+          if (sample[ind] < to->min)
+            to->min = sample[ind];
+          if (sample[ind] > to->max)
+            to->max = sample[ind];
+        }
+      }
+      else {
+        const Block *lower = this->get_level(level - 1) + block * branching;
+        *to = lower[0];
+        for (unsigned int ind = 1; ind < branching; ind++) {
+          if (lower[ind].min < to->min)
+            to->min = lower[ind].min;
+          if (lower[ind].max > to->max)
+            to->max = lower[ind].max;
+        }
+      }
+    }
+
+    // Publish the blocks.
+    this->m_levels[level].commit((complete - done) * sizeof(Block));
+  }
+}
+
+void
+WaveSummary::clear()
+{
+  for (unsigned int level = 0; level < levels; level++)
+    this->m_levels[level].clear();
+}
+
+bool
+WaveSummary::get_min_max(const AUDIO_FORMAT *audio,
+                         unsigned long from,
+                         unsigned long to,
+                         AUDIO_FORMAT &min,
+                         AUDIO_FORMAT &max) const
+{
+  if (from >= to)
+    return false;
+
+  min = max = audio[from];
+  while (from < to) {
+    // Find the largest summary block which starts here and fits the range.
+    int level;
+    for (level = levels - 1; level >= 0; level--) {
+      unsigned long size = block_size(level);
+      if (from % size == 0 && from + size <= to &&
+          from / size < this->get_blocks(level))
+        break;
+    }
+
+    if (level >= 0) {
+      unsigned long size = block_size(level);
+      const Block &block = this->get_level(level)[from / size];
+      if (block.min < min)
+        min = block.min;
+      if (block.max > max)
+        max = block.max;
+      from += size;
+    }
+    else {
+      // Samples up to the next block boundary or the end of the range.
+      unsigned long end = (from / first_block_size + 1) * first_block_size;
+      if (end > to)
+        end = to;
+      for (; from < end; from++) {
+        if (audio[from] < min)
+          min = audio[from];
+        if (audio[from] > max)
+          max = audio[from];
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,95 @@
+#ifndef WAVESUMMARY_HH_
+#define WAVESUMMARY_HH_
+
+#include "AudioStream.hh"
+#include "MappedStore.hh"
+
+/** Minimum and maximum of the audio over blocks of 64, 512 and 4096
+ * samples. The summary is updated as the audio grows, and the extremes of
+ * any range can be found by combining a few summary blocks and the samples
+ * at the ends, so drawing a waveform column doesn't depend on the length of
+ * the column.
+ *
+ * Blocks are stored in MappedStores, so they never move and the size of a
+ * level is published after the blocks have been written. One thread may
+ * update the summary while others read it. */
+class WaveSummary
+{
+
+public:
+
+  /** Summarizes the new complete blocks of the audio.
+   * \param audio The audio samples.
+   * \param size Number of samples in the audio. */
+  void update(const AUDIO_FORMAT *audio, unsigned long size);
+
+  /** Throws away the summary. Call when the audio is cleared. Readers must
+   * not be running. */
+  void clear();
+
+  /** Finds the minimum and maximum of a range of the audio.
+   * \param audio The audio samples.
+   * \param from First sample of the range.
+   * \param to One past the last sample of the range. Must be within the
+   *           audio.
+   * \param min The minimum is stored here.
+   * \param max The maximum is stored here.
+   * \return false if the range is empty. */
+  bool get_min_max(const AUDIO_FORMAT *audio,
+                   unsigned long from,
+                   unsigned long to,
+                   AUDIO_FORMAT &min,
+                   AUDIO_FORMAT &max) const;
+
+private:
+
+  /** Extremes of a block. */
+  struct Block
+  {
+    AUDIO_FORMAT min;
+    AUDIO_FORMAT max;
+  };
+
+  /** Number of levels. */
+  static const unsigned int levels = 3;
+  /** Blocks of a level are combined from this many blocks of the lower
+   * level. */
+  static const unsigned int branching = 8;
+  /** Samples in a block of the lowest level. */
+  static const unsigned int first_block_size = 64;
+
+  /** \param level Summary level.
+   * \return Samples in a block of the level. */
+  static inline unsigned long block_size(unsigned int level);
+  /** \param level Summary level.
+   * \return Number of blocks stored in the level. */
+  inline unsigned long get_blocks(unsigned int level) const;
+  /** \param level Summary level.
+   * \return Blocks of the level. */
+  inline const Block* get_level(unsigned int level) const;
+
+  MappedStore m_levels[levels]; //!< Blocks of each level.
+};
+
+unsigned long
+WaveSummary::block_size(unsigned int level)
+{
+  unsigned long size = first_block_size;
+  for (unsigned int ind = 0; ind < level; ind++)
+    size *= branching;
+  return size;
+}
+
+unsigned long
+WaveSummary::get_blocks(unsigned int level) const
+{
+  return this->m_levels[level].size() / sizeof(Block);
+}
+
+const WaveSummary::Block*
+WaveSummary::get_level(unsigned int level) const
+{
+  return (const Block*)this->m_levels[level].data();
+}
+
+#endif /*WAVESUMMARY_HH_*/
@@ -20,6 +20,7 @@ WidgetAudioView::WidgetAudioView(PG_Widget *parent,
   this->m_scroll_pos = 0;
   this->m_last_scroll_pos = 0;
   this->m_last_audio_data_size = 0;
+  this->m_source_changed = false;
   
   this->m_background_color = 0;
 
@@ -47,7 +48,7 @@ WidgetAudioView::initialize()
                                                     surface->format->Amask);
 
   SDL_FillRect(surface, NULL, this->m_background_color);
-
+  this->m_drawn_cursors.clear();
 }
 
 void
@@ -173,32 +174,91 @@ WidgetAudioView::draw_new(unsigned int x,
   SDL_UnlockSurface(surface);
 }
 
-void
+bool
 WidgetAudioView::update()
 {
-  unsigned int oldview_size = 0;
+  unsigned int oldview_from, oldview_to, oldview_size = 0;
   unsigned long newaudio_from, newaudio_size;
+  bool scrolled = this->m_scroll_pos != this->m_last_scroll_pos;
+  bool audio_grown = this->m_audio_input->get_audio_data_size() !=
+    this->m_last_audio_data_size;
 
   if (!this->m_force_redraw) {
-    // Calculates and blits old view content.
-    oldview_size = this->blit_old();
+    if (scrolled) {
+      // Calculates and blits old view content.
+      oldview_size = this->blit_old();
+    }
+    else {
+      // Old view content is already in place.
+      this->calculate_old(oldview_from, oldview_to, oldview_size);
+    }
   }
   
   // Calculate the new visible audio.
   this->calculate_new(oldview_size, newaudio_from, newaudio_size);
 
+  // Nothing to do if the view and the cursors are as they were. Unfinished
+  // pixels at the end are drawn again only when their data has changed.
+  bool redraw = this->m_force_redraw || scrolled ||
+    (newaudio_size && (audio_grown || this->m_source_changed));
+  this->m_source_changed = false;
+  if (!redraw) {
+    if (this->m_cursors == this->m_drawn_cursors)
+      return false;
+    newaudio_size = 0;
+  }
+
+  // Blitting from the back buffer already removed the cursors.
+  if (!this->m_force_redraw && !scrolled)
+    this->restore_cursors();
+
   // Draw the new parts of the view.
-  if (newaudio_size) {
-    unsigned int x =
-      (this->m_scroll_pos >= this->m_last_scroll_pos ? oldview_size : 0);
-      
+  unsigned int x =
+    (this->m_scroll_pos >= this->m_last_scroll_pos ? oldview_size : 0);
+  if (newaudio_size)
     this->draw_new(x, newaudio_from, newaudio_size);
+
+  // Update the back buffer where the view changed.
+  if (this->m_force_redraw || scrolled) {
+    SDL_BlitSurface(this->GetWidgetSurface(), NULL, this->m_surface_backbuffer, NULL);
+  }
+  else if (newaudio_size) {
+    SDL_Rect rect;
+    rect.x = x;
+    rect.y = 0;
+    rect.w = this->my_width - x;
+    rect.h = this->my_height;
+    SDL_BlitSurface(this->GetWidgetSurface(), &rect, this->m_surface_backbuffer, &rect);
   }
 
-  // Update variables and backbuffer.
   this->m_last_scroll_pos = this->m_scroll_pos;
   this->m_force_redraw = false;
-  SDL_BlitSurface(this->GetWidgetSurface(), NULL, this->m_surface_backbuffer, NULL);
+  this->draw_cursors();
+  return true;
+}
+
+void
+WidgetAudioView::restore_cursors()
+{
+  SDL_Rect rect;
+  rect.y = 0;
+  rect.w = 1;
+  rect.h = this->my_height;
+  for (unsigned int ind = 0; ind < this->m_drawn_cursors.size(); ind++) {
+    rect.x = this->m_drawn_cursors[ind].x;
+    SDL_BlitSurface(this->m_surface_backbuffer, &rect, this->GetWidgetSurface(), &rect);
+  }
+  this->m_drawn_cursors.clear();
+}
+
+void
+WidgetAudioView::draw_cursors()
+{
+  for (unsigned int ind = 0; ind < this->m_cursors.size(); ind++) {
+    this->DrawVLine(this->m_cursors[ind].x, 0, this->my_height,
+                    this->m_cursors[ind].color);
+  }
+  this->m_drawn_cursors = this->m_cursors;
 }
 
 bool
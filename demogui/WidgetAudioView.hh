@@ -2,17 +2,33 @@
 #ifndef WIDGETAUDIOVIEW_HH_
 #define WIDGETAUDIOVIEW_HH_
 
+#include <vector>
 #include <pgwidget.h>
 #include "AudioInputController.hh"
 
 /** Class for a scrolling view of audio. This abstract class doesn't know how
  * the audio is actually drawn, it just handles the scrolling by blitting
  * previously drawn surface and asking to redraw some screen parts when
- * necessary. */
+ * necessary. Cursor lines are drawn over the view, the back buffer holds the
+ * view without them. Update touches the surface only if the view or the
+ * cursors have changed. */
 class WidgetAudioView  :  public PG_Widget
 {
 
 public:
+
+  /** Vertical line drawn over the view. */
+  struct Cursor
+  {
+    int x; //!< Screen x coordinate.
+    PG_Color color; //!< Color of the line.
+
+    bool operator==(const Cursor &other) const
+    {
+      return x == other.x && color.r == other.color.r &&
+        color.g == other.color.g && color.b == other.color.b;
+    }
+  };
   
   /** Constructs a new scrolling audio view.
    * \param parent Parent widget.
@@ -28,8 +44,13 @@ public:
   
   /** Resets the audio view. Clears the view. */
   void reset();
-  /** Updates the view using the audio data source. */
-  void update();
+  /** Updates the view using the audio data source and draws the cursors.
+   * \return true if the surface changed and should be updated to the
+   *         screen. */
+  virtual bool update();
+  /** Sets the cursor lines drawn in the next update.
+   * \param cursors Cursors inside the view. */
+  inline void set_cursors(const std::vector<Cursor> &cursors);
   
   /** \param pos The position of the left side of the view. */
   inline void set_scroll_position(unsigned long pos);
@@ -91,6 +112,12 @@ protected:
   
   inline void set_background_color(Uint32 color);
 
+  /** Removes the drawn cursor lines by blitting the view under them from
+   * the back buffer. */
+  void restore_cursors();
+  /** Draws the cursor lines. */
+  void draw_cursors();
+
   AudioInputController *m_audio_input; //!< Source of audio data.
   /** Updated view is stored here so it can be used in next update if the
    * next view position collides with the previous. */
@@ -104,11 +131,17 @@ protected:
   unsigned long m_last_audio_data_size; //!< Audio data size in last update.
   
   bool m_force_redraw; //!< Force redrawing of the entire view.
+  /** Derived classes set this when the data behind the unfinished part of
+   * the view has changed although the audio hasn't grown. */
+  bool m_source_changed;
   
 private:  
   
   Uint32 m_background_color; //!< Background color.
 
+  std::vector<Cursor> m_cursors; //!< Cursors to draw.
+  std::vector<Cursor> m_drawn_cursors; //!< Cursors on the surface.
+
 };
 
 void
@@ -117,6 +150,12 @@ WidgetAudioView::set_scroll_position(unsigned long pos)
   this->m_scroll_pos = pos;
 }
 
+void
+WidgetAudioView::set_cursors(const std::vector<Cursor> &cursors)
+{
+  this->m_cursors = cursors;
+}
+
 void
 WidgetAudioView::set_background_color(Uint32 color)
 {
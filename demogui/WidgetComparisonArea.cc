@@ -10,10 +10,12 @@
 
 WidgetComparisonArea::WidgetComparisonArea(Window &parent,
                                            const PG_Rect &rect,
-                                           RecognizerStatus *recognition)
+                                           RecognizerStatus *recognition,
+                                           LiveScore *live_score)
   : PG_Widget(parent.get_widget(), rect, false),
     m_parent(parent),
-    m_recognition(recognition)
+    m_recognition(recognition),
+    m_live_score(live_score)
 {
   
   const unsigned int field_space = 30;
@@ -115,6 +117,7 @@ WidgetComparisonArea::handle_openoriginal_button()
     this->m_original_text->SetText(content.data());
     this->m_original_text->SetVPosition(0);
 //    this->m_original_text->Update();
+    this->reference_changed();
   }
   return true;
 }
@@ -135,6 +138,7 @@ WidgetComparisonArea::handle_clearoriginal_button()
   this->m_original_text->SetText("");
 //  this->m_original_text->SetVPosition(0);
   this->m_original_text->Update();
+  this->reference_changed();
   return true;
 }
 
@@ -148,6 +152,7 @@ WidgetComparisonArea::handle_editoriginal_button()
   this->m_parent.run_child_window(&window);
   this->m_original_text->SetText(text.data());
   this->m_original_text->Update();
+  this->reference_changed();
   //*/
   return true;
 }
@@ -168,6 +173,7 @@ WidgetComparisonArea::handle_pasteoriginal_button()
   this->m_original_text->SetText(scrap);
   delete[] scrap;
   this->m_original_text->Update();
+  this->reference_changed();
   return true;
 }
 
@@ -175,9 +181,7 @@ WidgetComparisonArea::handle_pasteoriginal_button()
 bool
 WidgetComparisonArea::handle_updaterecognition_button()
 {
-  this->m_recognition->lock();
   this->m_recognition_text->SetText(this->m_recognition->get_recognition_text().data());
-  this->m_recognition->unlock();
 
   this->m_recognition_text->Update();
 
@@ -204,3 +208,9 @@ WidgetComparisonArea::handle_compare_button()
   this->m_parent.run_child_window(&window);
   return true;
 }
+
+void
+WidgetComparisonArea::reference_changed()
+{
+  this->m_live_score->set_reference(this->m_original_text->GetText());
+}
@@ -5,6 +5,7 @@
 #include <pgwidget.h>
 #include "WidgetMultiLineEdit.hh"
 #include "RecognizerStatus.hh"
+#include "LiveScore.hh"
 #include "Window.hh"
 
 /** A GUI class which contains the two text fields (reference and hypothesis)
@@ -18,10 +19,12 @@ public:
    * \param parent Parent window. Needs the parent as a Window object because
    *               runs some child windows.
    * \param rect Rectangle area of the widget.
-   * \param recognition Source of the recognition information. */
+   * \param recognition Source of the recognition information.
+   * \param live_score Gets the reference text whenever it changes. */
   WidgetComparisonArea(Window &parent,
                        const PG_Rect &rect,
-                       RecognizerStatus *recognition);
+                       RecognizerStatus *recognition,
+                       LiveScore *live_score);
   /** Destructs the widget. */
   virtual ~WidgetComparisonArea();
   
@@ -37,10 +40,14 @@ protected:
   bool handle_saverecognition_button();
   bool handle_compare_button();
 
+  /** Gives the reference text to the live score. */
+  void reference_changed();
+
 private:
 
   Window &m_parent; //!< Parent window. Needed for running child windows.
   RecognizerStatus *m_recognition; //!< Source for recognition.
+  LiveScore *m_live_score; //!< Running score against the reference.
   WidgetMultiLineEdit *m_original_text; //!< Text field for reference.
   WidgetMultiLineEdit *m_recognition_text; //!< Text field for hypothesis.
   
@@ -29,13 +29,13 @@ public:
    * the container but isn't too big.
    * \param item Widget to remove. */
   virtual bool RemoveChild(PG_Widget *item);
+  /** Calculates and resizes the container so that all widgets fit in it but it
+   * isn't oo big. Call if the child widgets have been moved or resized. */
+  void calculate_size();
 
 private:
   /** Resizes the container. */
   void resize(Uint16 width, Uint16 height);
-  /** Calculates and resizes the container so that all widgets fit in it but it
-   * isn't oo big. */
-  void calculate_size();
   Uint32 m_background_color; //!< Background color.
 };
 
@@ -0,0 +1,69 @@
+
+#include "WidgetMorpheme.hh"
+
+WidgetMorpheme::WidgetMorpheme(PG_Widget *parent,
+                               TextSurfaceCache *cache,
+                               const PG_Color &background)
+  : PG_Widget(parent, PG_Rect(0, 0, 0, 0), true),
+    m_cache(cache),
+    m_background(background),
+    m_rect(0, 0, 0, 0)
+{
+  // Use the same font as labels.
+  this->LoadThemeStyle("Label", "Label");
+}
+
+bool
+WidgetMorpheme::set(const std::string &text,
+                    const PG_Color &color,
+                    const PG_Rect &rect)
+{
+  bool moved = rect.x != this->m_rect.x || rect.y != this->m_rect.y;
+  bool resized = rect.w != this->m_rect.w || rect.h != this->m_rect.h;
+  bool changed = text != this->m_text || color.r != this->m_color.r ||
+    color.g != this->m_color.g || color.b != this->m_color.b;
+
+  if (moved)
+    this->MoveWidget(rect.x, rect.y, false);
+  // Resizing creates a new surface, so it must be redrawn.
+  if (resized)
+    this->SizeWidget(rect.w, rect.h, false);
+  if (resized || changed) {
+    this->m_text = text;
+    this->m_color = color;
+    this->redraw();
+  }
+
+  this->m_rect = rect;
+  return moved || resized || changed;
+}
+
+void
+WidgetMorpheme::redraw()
+{
+  SDL_Surface *surface = this->GetWidgetSurface();
+  SDL_Surface *text;
+  SDL_Rect src, dst;
+
+  if (!surface)
+    return;
+
+  SDL_FillRect(surface, NULL, this->m_background.MapRGB(surface->format));
+
+  text = this->m_cache->get(this->m_text,
+                            this->m_color,
+                            this->m_background,
+                            this->GetFont(),
+                            surface->format);
+  if (!text)
+    return;
+
+  // Center the text. If it doesn't fit, the middle part is shown.
+  src.x = text->w > surface->w ? (text->w - surface->w) / 2 : 0;
+  src.y = text->h > surface->h ? (text->h - surface->h) / 2 : 0;
+  src.w = text->w - src.x;
+  src.h = text->h - src.y;
+  dst.x = text->w < surface->w ? (surface->w - text->w) / 2 : 0;
+  dst.y = text->h < surface->h ? (surface->h - text->h) / 2 : 0;
+  SDL_BlitSurface(text, &src, surface, &dst);
+}
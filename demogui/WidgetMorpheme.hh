@@ -0,0 +1,46 @@
+#ifndef WIDGETMORPHEME_HH_
+#define WIDGETMORPHEME_HH_
+
+#include <string>
+#include <pgwidget.h>
+#include "TextSurfaceCache.hh"
+
+/** Widget showing one morpheme in a word container. Works like a centered
+ * PG_Label, but the text is drawn on the widget's own surface only when it
+ * changes and the rendered text comes from a cache, so the widgets can be
+ * reused cheaply for other morphemes. */
+class WidgetMorpheme  :  public PG_Widget
+{
+
+public:
+
+  /** Constructs an empty morpheme widget.
+   * \param parent Parent widget.
+   * \param cache Rendered texts are taken from this cache.
+   * \param background Background color behind the text. */
+  WidgetMorpheme(PG_Widget *parent,
+                 TextSurfaceCache *cache,
+                 const PG_Color &background);
+  virtual ~WidgetMorpheme() { }
+
+  /** Sets the text, color and place of the widget. Does nothing if they
+   * didn't change.
+   * \param text The morpheme.
+   * \param color Text color.
+   * \param rect Place of the widget in the parent.
+   * \return true if something changed. */
+  bool set(const std::string &text, const PG_Color &color, const PG_Rect &rect);
+
+private:
+
+  /** Draws the background and the text on the widget surface. */
+  void redraw();
+
+  TextSurfaceCache *m_cache; //!< Source of the rendered texts.
+  PG_Color m_background; //!< Background color.
+  std::string m_text; //!< Current text.
+  PG_Color m_color; //!< Current text color.
+  PG_Rect m_rect; //!< Current place in the parent.
+};
+
+#endif /*WIDGETMORPHEME_HH_*/
@@ -14,6 +14,7 @@ WidgetRecognitionArea::WidgetRecognitionArea(PG_Widget *parent,
 {
   this->m_audio_input = audio_input;
   this->m_recognition = recognition;
+  this->m_last_scroll_pos = -1;
 
   // Create autoscrolling radio buttons.
   int x = 10;
@@ -82,6 +83,8 @@ WidgetRecognitionArea::WidgetRecognitionArea(PG_Widget *parent,
   // ADJUST: Map the y axis! You may adjust these values to modify the y axis.
   // It is part logarithmic part linear axis.
   this->m_spectrogram->create_y_axis(0.63, 0.21); 
+  if (RecognizerStatus::frontend_spectrum)
+    this->m_spectrogram->set_frontend_spectrum(recognition->get_spectrum());
                                                 
   
   // Create recognition text area.
@@ -122,6 +125,8 @@ WidgetRecognitionArea::reset()
   this->m_spectrogram->reset();
   this->m_text_area->reset();
   this->m_time_axis->reset();
+  // Cleared children are copied to the screen in the next update.
+  this->m_last_scroll_pos = -1;
   // Update scroll.
   this->set_scroll_range();
   this->set_scroll_position(this->m_scroll_bar->GetPosition());
@@ -144,52 +149,66 @@ WidgetRecognitionArea::set_scroll_position(unsigned long page)
 void
 WidgetRecognitionArea::update_cursors()
 {
+  std::vector<WidgetAudioView::Cursor> cursors;
+
   // Draw the line cursors.
-  this->draw_cursor(this->get_audio_cursor(), PG_Color(255, 255, 255));
-  this->draw_cursor(this->get_recognizer_cursor(), PG_Color(255, 0, 255));
+  this->add_cursor(cursors, this->get_audio_cursor(), PG_Color(255, 255, 255));
+  this->add_cursor(cursors, this->get_recognizer_cursor(), PG_Color(255, 0, 255));
   if (this->m_audio_input->is_playbacking())
-    this->draw_cursor(this->get_playback_cursor(), PG_Color(255, 255, 0));
+    this->add_cursor(cursors, this->get_playback_cursor(), PG_Color(255, 255, 0));
+
+  this->m_wave->set_cursors(cursors);
+  this->m_spectrogram->set_cursors(cursors);
 }
 
 void
-WidgetRecognitionArea::draw_cursor(long position, PG_Color color)
+WidgetRecognitionArea::add_cursor(std::vector<WidgetAudioView::Cursor> &cursors,
+                                  long position,
+                                  PG_Color color)
 {
-  // Draw a vertical line to given data position.
+  // Add a vertical line to given data position.
   if (position >= this->m_scroll_bar->GetPosition() &&
-      position <= this->m_scroll_bar->GetPosition() + this->Width()) {
-        
-    this->m_wave->DrawVLine(position - this->m_scroll_bar->GetPosition(),
-                            0,
-                            this->m_wave->Height(),
-                            color);
-
-    this->m_spectrogram->DrawVLine(position - this->m_scroll_bar->GetPosition(),
-                                   0,
-                                   this->m_spectrogram->Height(),
-                                   color);
+      position < this->m_scroll_bar->GetPosition() + this->Width()) {
+    WidgetAudioView::Cursor cursor;
+    cursor.x = position - this->m_scroll_bar->GetPosition();
+    cursor.color = color;
+    cursors.push_back(cursor);
   }
-
 }
 
 void
 WidgetRecognitionArea::update_screen(bool new_data)
 {
-  this->m_wave->update();
-  this->m_spectrogram->update();
-  if (new_data)
-    this->m_text_area->update();
-  this->m_time_axis->update(this->m_audio_input->get_audio_data_size() / audio::audio_sample_rate);
-    
+  bool text_changed = false;
+
   this->update_cursors();
+  bool wave_changed = this->m_wave->update();
+  bool spectrogram_changed = this->m_spectrogram->update();
+  if (new_data)
+    text_changed = this->m_text_area->update();
+  bool time_changed = this->m_time_axis->update(this->m_audio_input->get_audio_data_size() / audio::audio_sample_rate);
 
-  // Update the screen.
-  this->Update(true);
+  // Update the screen. When scrolled everything has moved, otherwise only
+  // the children that changed are copied to the screen.
+  if (this->m_scroll_bar->GetPosition() != this->m_last_scroll_pos) {
+    this->Update(true);
+    this->m_last_scroll_pos = this->m_scroll_bar->GetPosition();
+    return;
+  }
+  if (wave_changed)
+    this->m_wave->Update(true);
+  if (spectrogram_changed)
+    this->m_spectrogram->Update(true);
+  if (text_changed)
+    this->m_text_area->Update(true);
+  if (time_changed)
+    this->m_time_axis->Update(true);
 }
 
 void
 WidgetRecognitionArea::update()
 {
-  this->set_scroll_range();
+  bool range_changed = this->set_scroll_range();
 
   // Autoscroll.
   if (this->m_autoscroll != DISABLE) {
@@ -213,7 +232,7 @@ WidgetRecognitionArea::update()
       }
     }
   }
-  else {
+  else if (range_changed) {
     // This will do redrawing for scroll bar. (Update and Redraw won't work properly..)
     this->m_scroll_bar->SetPosition(this->m_scroll_bar->GetPosition());
   }
@@ -222,15 +241,19 @@ WidgetRecognitionArea::update()
   this->update_screen(true);
 }
 
-void
+bool
 WidgetRecognitionArea::set_scroll_range()
 {
   unsigned long audio_data_pixels = this->get_audio_pixels();
-  // Set the range of the scroll bar.
+  long max = 0;
   if (audio_data_pixels > this->Width())
-    this->m_scroll_bar->SetRange(0, audio_data_pixels - this->Width());
-  else
-    this->m_scroll_bar->SetRange(0, 0);
+    max = audio_data_pixels - this->Width();
+
+  // Set the range of the scroll bar.
+  if (max == this->m_scroll_bar->GetMaxRange())
+    return false;
+  this->m_scroll_bar->SetRange(0, max);
+  return true;
 }
 
 bool
@@ -51,11 +51,19 @@ protected:
   bool handle_scroll(PG_ScrollBar *scroll_bar, long page);
   bool handle_radio(PG_RadioButton *radio, bool status, void *user_data);
   
-  /** Updates the scroll bar by checking the size of the audio data. */
-  void set_scroll_range();
+  /** Updates the scroll bar by checking the size of the audio data.
+   * \return true if the range changed. */
+  bool set_scroll_range();
   
+  /** Sets the cursors of the wave and spectrogram views. */
   void update_cursors();
-  void draw_cursor(long position, PG_Color color);
+  /** Adds a cursor if it is inside the view.
+   * \param cursors The cursor is added here.
+   * \param position Cursor position in pixels from the start of the audio.
+   * \param color Color of the cursor. */
+  void add_cursor(std::vector<WidgetAudioView::Cursor> &cursors,
+                  long position,
+                  PG_Color color);
   
   inline unsigned long get_audio_cursor() const;
   inline unsigned long get_recognizer_cursor() const;
@@ -64,7 +72,7 @@ protected:
   
 private:
 
-  /** Updates the screen areas of the child widgets.
+  /** Updates the child widgets and the screen areas that have changed.
    * \param new_data true if new recognitions should be checked.
    * TODO: The parameter has a very little affect and it could be removed. */
   void update_screen(bool new_data);
@@ -85,6 +93,9 @@ private:
 
   enum Autoscroll { DISABLE, RECOGNIZER, AUDIO };
   Autoscroll m_autoscroll; //!< Auto scrolling status.
+  /** Scroll position on the screen, the whole area is updated when it
+   * changes. */
+  long m_last_scroll_pos;
   
 };
 
@@ -104,11 +115,11 @@ WidgetRecognitionArea::get_audio_cursor() const
 unsigned long
 WidgetRecognitionArea::get_recognizer_cursor() const
 {
-  if (m_recognition->m_message_result_true_called)
+  const RecognitionSnapshot &snapshot = this->m_recognition->get_snapshot();
+  if (snapshot.result_true_called)
     return get_audio_pixels();
   else
-    return (unsigned long)(this->m_pixels_per_second *
-                           this->m_recognition->get_recognition_frame() /
+    return (unsigned long)(this->m_pixels_per_second * snapshot.frame /
                            RecognizerStatus::frames_per_second);
 }
 
@@ -1,8 +1,13 @@
-
+#include <algorithm>
 #include "WidgetRecognitionText.hh"
 #include "WidgetContainer.hh"
+#include "WidgetMorpheme.hh"
 #include "AudioStream.hh"
-#include <pglabel.h>
+
+// Colors of the recognized and hypothesis texts and the word boxes.
+static const PG_Color recognized_color(255, 255, 255);
+static const PG_Color hypothesis_color(255, 255, 0);
+static const PG_Color word_color(90, 90, 90);
 
 WidgetRecognitionText::WidgetRecognitionText(PG_Widget *parent,
                                                const PG_Rect &rect,
@@ -26,29 +31,40 @@ void
 WidgetRecognitionText::initialize()
 {
   this->m_last_recognition_count = 0;
-  this->m_last_recog_word = NULL;
-  this->m_last_recog_morph = NULL;
+  this->m_recognized_items = 0;
+  this->m_last_recog_word = -1;
+  this->m_last_recog_morph = -1;
   this->m_last_recognition_frame = 0;
 }
 
 void
 WidgetRecognitionText::terminate()
 {
+  // Free morphemes are not children of any widget.
+  for (unsigned int i = 0; i < this->m_free_morphemes.size(); i++)
+    delete this->m_free_morphemes.at(i);
+  this->m_free_morphemes.clear();
+
   this->RemoveAllChilds();
-  this->m_hypothesis_widgets.clear();
+  this->m_live_widgets.clear();
+  this->m_free_separators.clear();
+  this->m_free_words.clear();
+  this->m_items.clear();
 }
 
-void
+bool
 WidgetRecognitionText::update()
 {
-  this->m_recognition->lock();
-  unsigned long frame = this->m_recognition->get_recognition_frame();
-  if (frame > this->m_last_recognition_frame || m_recognition->m_message_result_true_called) {
+  // The snapshot doesn't change under us, no need to lock.
+  const RecognitionSnapshot &snapshot = this->m_recognition->get_snapshot();
+  if (snapshot.frame > this->m_last_recognition_frame || snapshot.result_true_called) {
     this->update_recognition();
     this->update_hypothesis();
-    this->m_last_recognition_frame = frame;
+    this->update_widgets();
+    this->m_last_recognition_frame = snapshot.frame;
+    return true;
   }
-  this->m_recognition->unlock();
+  return false;
 }
 
 void
@@ -58,11 +74,18 @@ WidgetRecognitionText::reset()
   this->initialize();
 }
 
-PG_Widget*
-WidgetRecognitionText::add_morpheme_widget(const Morpheme &morpheme,
-                                           const PG_Color &color,
-                                           PG_Widget *&word_widget,
-                                           Sint32 min_x)
+void
+WidgetRecognitionText::set_scroll_position(Sint32 x)
+{
+  WidgetScrollArea::set_scroll_position(x);
+  this->update_widgets();
+}
+
+int
+WidgetRecognitionText::add_morpheme(const Morpheme &morpheme,
+                                    bool hypothesis,
+                                    int &word,
+                                    Sint32 min_x)
 {
   // Calculate recognizer pixels per recognizer frame.
   double multiplier = this->m_pixels_per_second /
@@ -73,7 +96,7 @@ WidgetRecognitionText::add_morpheme_widget(const Morpheme &morpheme,
   
   // Word break.
   if (morpheme.data == " " || morpheme.data == "." || morpheme.data == "")
-    word_widget = NULL;
+    word = -1;
 
   //* min_x is used to force word breaks.
   // These lines may be commented out if forcing is undesired. Note that
@@ -89,158 +112,321 @@ WidgetRecognitionText::add_morpheme_widget(const Morpheme &morpheme,
   }
   //*/
 
-  PG_Rect rect(0, 0, w, this->my_height);
-  PG_Widget *morph_widget = NULL;
+  if (morpheme.data == " " || morpheme.data == "")
+    return -1;
 
-  if (morpheme.data != " " && morpheme.data != "") {
-    if (morpheme.data == ".") {
-      // One pixel wide separator for sentence breaks.
-      rect.w = 1;
-      morph_widget = new PG_Widget(NULL, rect, true);
-      SDL_FillRect(morph_widget->GetWidgetSurface(),
-                   NULL,
-                   color.MapRGB(morph_widget->GetWidgetSurface()->format));
-      // We need to use this for x coordinate. (See WidgetScrollArea for more
-      // information.
-      morph_widget->SetUserData(&x, sizeof(Sint32));
-      this->AddChild(morph_widget);
-      morph_widget->SetVisible(true);
-    }
-    else {
-      if (word_widget == NULL) {
-        word_widget = new WidgetContainer(NULL, 0, 0, PG_Color(90, 90, 90));
-        // We need to use this for x coordinate. (See WidgetScrollArea for more
-        // information.
-        word_widget->SetUserData(&x, sizeof(Sint32));
-        this->AddChild(word_widget);
-        word_widget->SetVisible(true);
-      }
+  TextItem item;
+  item.separator = false;
+  item.hypothesis = hypothesis;
 
-      Sint32 word_x;
-      word_widget->GetUserData(&word_x);
-      rect.x = x - word_x;
-      morph_widget = new PG_Label(word_widget, rect, morpheme.data.data());
+  if (morpheme.data == ".") {
+    // One pixel wide separator for sentence breaks.
+    item.x = x;
+    item.width = 1;
+    item.separator = true;
+    this->m_items.push_back(item);
+    return this->m_items.size() - 1;
+  }
 
-      ((PG_Label*)morph_widget)->SetAlignment(PG_Label::CENTER);
-      morph_widget->SetFontColor(color);
-      morph_widget->sigMouseButtonUp.connect(slot(*this, &WidgetRecognitionText::handle_morpheme_widget), NULL);
-      morph_widget->SetVisible(true);
-      
-    }
-  }  
-  
-  return morph_widget;
+  if (word == -1) {
+    item.x = x;
+    item.width = 0;
+    this->m_items.push_back(item);
+    word = this->m_items.size() - 1;
+  }
+
+  TextMorpheme text_morpheme;
+  text_morpheme.x = x - this->m_items[word].x;
+  text_morpheme.width = w;
+  text_morpheme.hypothesis = hypothesis;
+  text_morpheme.data = morpheme.data;
+  this->m_items[word].morphemes.push_back(text_morpheme);
+
+  // Word box grows to contain the morphemes.
+  if (text_morpheme.x + (Sint32)w > this->m_items[word].width)
+    this->m_items[word].width = text_morpheme.x + w;
+
+  return word;
 }
 
 void
 WidgetRecognitionText::update_recognition()
 {
-  const MorphemeList &morphemes = this->m_recognition->get_recognized();
+  const RecognitionSnapshot &snapshot = this->m_recognition->get_snapshot();
+  unsigned long skip = this->m_last_recognition_count;
   Sint32 min_x = 0;
+  int current_item;
   
   // Update if new morphemes has been recognized.
-  if (morphemes.size() > this->m_last_recognition_count) {
-    MorphemeList::const_iterator iter = morphemes.begin();
-    
-    // Find the position of last recognized morpheme.
-    for (unsigned int ind = 0; ind < this->m_last_recognition_count; ind++)
-      iter++;
-      
-    // Add new recognized morphemes.
-    for (; iter != morphemes.end(); iter++) {
-      
-      // Force at least 2 pixels between words/separators.
-      if (!this->m_last_recog_word && this->m_last_recog_morph) {
-        this->m_last_recog_morph->GetUserData(&min_x);
-        min_x += this->m_last_recog_morph->my_width + 2;
+  if (snapshot.recognized_size > this->m_last_recognition_count) {
+    // Hypothesis comes after the new morphemes.
+    this->remove_hypothesis();
+
+    for (unsigned int part = 0; part < snapshot.recognized.size(); part++) {
+      const MorphemeList &morphemes = *snapshot.recognized[part];
+
+      // Skip the parts which are already in the layout.
+      if (skip >= morphemes.size()) {
+        skip -= morphemes.size();
+        continue;
       }
 
-      PG_Widget *current_morph =
-        this->add_morpheme_widget(*iter,
-                                  PG_Color(255, 255, 255),
-                                  this->m_last_recog_word,
-                                  min_x);
+      // Find the position of last recognized morpheme.
+      MorphemeList::const_iterator iter = morphemes.begin() + skip;
+      skip = 0;
+      
+      // Add new recognized morphemes.
+      for (; iter != morphemes.end(); iter++) {
       
-      // Save latest non-null widget (word/separator).
-      if (this->m_last_recog_word)
-        this->m_last_recog_morph = this->m_last_recog_word;
-      else if (current_morph)
-        this->m_last_recog_morph = current_morph;
-        
+        // Force at least 2 pixels between words/separators.
+        if (this->m_last_recog_word == -1 && this->m_last_recog_morph != -1)
+          min_x = this->get_item_end(this->m_last_recog_morph);
 
+        current_item = this->add_morpheme(*iter,
+                                          false,
+                                          this->m_last_recog_word,
+                                          min_x);
+      
+        // Save latest word/separator.
+        if (this->m_last_recog_word != -1)
+          this->m_last_recog_morph = this->m_last_recog_word;
+        else if (current_item != -1)
+          this->m_last_recog_morph = current_item;
+      }
     }
+    this->m_recognized_items = this->m_items.size();
   }
-  this->m_last_recognition_count = morphemes.size();
+  this->m_last_recognition_count = snapshot.recognized_size;
 }
 
 void
 WidgetRecognitionText::update_hypothesis()
 {
-  PG_Widget *nonnull, *current_morph, *previous_word, *current_word;
-  const MorphemeList &morphemes = this->m_recognition->get_hypothesis();
+  int nonnull, current_item, current_word;
+  const MorphemeList &morphemes = this->m_recognition->get_snapshot().hypothesis;
   Sint32 min_x = 0;
 
   this->remove_hypothesis();
 
   // Start where recognition ends.
-  nonnull = NULL;
-  current_morph = this->m_last_recog_morph;
+  nonnull = -1;
+  current_item = this->m_last_recog_morph;
   current_word = this->m_last_recog_word;
   
   for (MorphemeList::const_iterator iter = morphemes.begin();
        iter != morphemes.end();
        iter++) {
 
-    // Save latest non-null widget (word/separator).
-    if (current_word)
+    // Save latest word/separator.
+    if (current_word != -1)
       nonnull = current_word;
-    else if (current_morph)
-      nonnull = current_morph;
+    else if (current_item != -1)
+      nonnull = current_item;
+
+    if (current_word == -1 && nonnull != -1)
+      min_x = this->get_item_end(nonnull);
+
+    // Add the morpheme. If the current word is recognized, the hypothesis
+    // morpheme continues it.
+    current_item = this->add_morpheme(*iter, true, current_word, min_x);
+  }
+}
+
+void
+WidgetRecognitionText::remove_hypothesis()
+{
+  this->m_items.resize(this->m_recognized_items);
+
+  // Hypothesis may continue the last recognized word.
+  if (this->m_last_recog_word != -1) {
+    TextItem &word = this->m_items[this->m_last_recog_word];
+    while (!word.morphemes.empty() && word.morphemes.back().hypothesis)
+      word.morphemes.pop_back();
+    word.width = 0;
+    for (unsigned int i = 0; i < word.morphemes.size(); i++) {
+      if (word.morphemes[i].x + word.morphemes[i].width > word.width)
+        word.width = word.morphemes[i].x + word.morphemes[i].width;
+    }
+  }
+}
+
+/** Compares the right edge of an item to a coordinate. */
+struct ItemEndsBefore
+{
+  template <class T>
+  bool operator()(const T &item, Sint32 x) const
+  {
+    return item.x + item.width < x;
+  }
+};
 
-    if (!current_word && nonnull) {
-      nonnull->GetUserData(&min_x);
-      min_x += nonnull->my_width + 2;
+void
+WidgetRecognitionText::update_widgets()
+{
+  // Keep widgets for half a view on both sides, so that small scrolls don't
+  // need new widgets.
+  Sint32 left = this->get_scroll_position() - this->my_width / 2;
+  Sint32 right = this->get_scroll_position() + this->my_width * 3 / 2;
+  unsigned int first, last;
+
+  // Items are in the order of their positions and don't overlap.
+  first = std::lower_bound(this->m_items.begin(), this->m_items.end(),
+                           left, ItemEndsBefore()) - this->m_items.begin();
+  for (last = first; last < this->m_items.size(); last++) {
+    if (this->m_items[last].x > right)
+      break;
+  }
+
+  // Release widgets of items which went out of view or disappeared.
+  std::map<unsigned int, ItemWidgets>::iterator iter;
+  for (iter = this->m_live_widgets.begin(); iter != this->m_live_widgets.end();) {
+    if (iter->first < first || iter->first >= last ||
+        iter->second.separator != this->m_items[iter->first].separator) {
+      this->release_item_widgets(iter->second);
+      this->m_live_widgets.erase(iter++);
+    }
+    else {
+      iter++;
     }
+  }
 
-    previous_word = current_word;
-    
-    // Add the morpheme.
-    current_morph = this->add_morpheme_widget(*iter,
-                                              PG_Color(255, 255, 0),
-                                              current_word,
-                                              min_x);
-    
-    // Handle three different possibilities for the hypothesis morpheme.
-    if (current_word == NULL) {
-      // Possible sentence break widget.
-      if (current_morph)
-        this->m_hypothesis_widgets.push_back(current_morph);
+  for (unsigned int index = first; index < last; index++)
+    this->update_item_widgets(this->m_items[index], this->m_live_widgets[index]);
+}
+
+void
+WidgetRecognitionText::update_item_widgets(const TextItem &item,
+                                           ItemWidgets &widgets)
+{
+  WidgetContainer *word;
+  WidgetMorpheme *morpheme;
+  Sint32 x = item.x;
+  bool changed = false;
+
+  // Take free widgets into use.
+  if (!widgets.box) {
+    widgets.separator = item.separator;
+    if (item.separator) {
+      if (this->m_free_separators.empty()) {
+        widgets.box = new PG_Widget(NULL, PG_Rect(0, 0, 1, this->my_height), true);
+        // We need to use this for x coordinate. (See WidgetScrollArea for more
+        // information.
+        widgets.box->SetUserData(&x, sizeof(Sint32));
+        this->AddChild(widgets.box);
+      }
+      else {
+        widgets.box = this->m_free_separators.back();
+        this->m_free_separators.pop_back();
+      }
+      // Force filling the color.
+      widgets.hypothesis = !item.hypothesis;
     }
     else {
-      if (current_word == this->m_last_recog_word) {
-        // Hypothesis morpheme continues recognized word.
-        if (current_morph)
-          this->m_hypothesis_widgets.push_back(current_morph);
+      if (this->m_free_words.empty()) {
+        word = new WidgetContainer(NULL, 0, 0, word_color);
+        // We need to use this for x coordinate.
+        word->SetUserData(&x, sizeof(Sint32));
+        this->AddChild(word);
+      }
+      else {
+        word = this->m_free_words.back();
+        this->m_free_words.pop_back();
+      }
+      widgets.box = word;
+    }
+    this->move_child(widgets.box, item.x);
+    widgets.box->SetVisible(true);
+  }
+  else {
+    this->move_child(widgets.box, item.x);
+  }
+
+  if (item.separator) {
+    if (widgets.hypothesis != item.hypothesis) {
+      widgets.hypothesis = item.hypothesis;
+      const PG_Color &color = item.hypothesis ? hypothesis_color : recognized_color;
+      SDL_FillRect(widgets.box->GetWidgetSurface(),
+                   NULL,
+                   color.MapRGB(widgets.box->GetWidgetSurface()->format));
+    }
+    return;
+  }
+
+  word = (WidgetContainer*)widgets.box;
+
+  // Remove extra morphemes.
+  while (widgets.morphemes.size() > item.morphemes.size()) {
+    morpheme = widgets.morphemes.back();
+    widgets.morphemes.pop_back();
+    // Set visibility to false to fix the destructor bug which otherwise
+    // updates the screen area.
+    morpheme->SetVisible(false);
+    word->RemoveChild(morpheme);
+    this->m_free_morphemes.push_back(morpheme);
+    changed = true;
+  }
+
+  // Update and add morphemes.
+  for (unsigned int i = 0; i < item.morphemes.size(); i++) {
+    const TextMorpheme &text = item.morphemes[i];
+    if (i == widgets.morphemes.size()) {
+      if (this->m_free_morphemes.empty()) {
+        morpheme = new WidgetMorpheme(NULL, &this->m_text_cache, word_color);
+        morpheme->sigMouseButtonUp.connect(slot(*this, &WidgetRecognitionText::handle_morpheme_widget), NULL);
       }
-      else if (current_word != previous_word) {
-        // New word, completely hypothesis.
-        this->m_hypothesis_widgets.push_back(current_word);
+      else {
+        morpheme = this->m_free_morphemes.back();
+        this->m_free_morphemes.pop_back();
       }
+      // Position is relative to the parent, so move after adding.
+      word->AddChild(morpheme);
+      morpheme->MoveWidget(text.x, 0, false);
+      morpheme->set(text.data,
+                    text.hypothesis ? hypothesis_color : recognized_color,
+                    PG_Rect(text.x, 0, text.width, this->my_height));
+      morpheme->SetVisible(true);
+      widgets.morphemes.push_back(morpheme);
+      changed = true;
+    }
+    else {
+      changed |= widgets.morphemes[i]->set(text.data,
+                                           text.hypothesis ? hypothesis_color : recognized_color,
+                                           PG_Rect(text.x, 0, text.width, this->my_height));
     }
   }
+
+  if (changed)
+    word->calculate_size();
 }
 
 void
-WidgetRecognitionText::remove_hypothesis()
+WidgetRecognitionText::release_item_widgets(ItemWidgets &widgets)
 {
-  for (unsigned int i = 0; i < this->m_hypothesis_widgets.size(); i++) {
-    // Set visibility to false to fix the destructor bug which otherwise
-    // updates the screen area.
-    this->m_hypothesis_widgets.at(i)->SetVisible(false);
-    delete this->m_hypothesis_widgets.at(i);
+  // Morphemes are detached, so any word can take them into use.
+  for (unsigned int i = 0; i < widgets.morphemes.size(); i++) {
+    widgets.morphemes[i]->SetVisible(false);
+    widgets.box->RemoveChild(widgets.morphemes[i]);
+    this->m_free_morphemes.push_back(widgets.morphemes[i]);
+  }
+  widgets.morphemes.clear();
+  widgets.box->SetVisible(false);
+
+  if (widgets.separator)
+    this->m_free_separators.push_back(widgets.box);
+  else
+    this->m_free_words.push_back((WidgetContainer*)widgets.box);
+  widgets.box = NULL;
+}
+
+void
+WidgetRecognitionText::move_child(PG_Widget *widget, Sint32 x)
+{
+  Sint32 old_x;
+  widget->GetUserData(&old_x);
+  if (old_x != x) {
+    widget->SetUserData(&x, sizeof(Sint32));
+    this->set_widget_position(widget);
   }
-  this->m_hypothesis_widgets.clear();
-  
 }
 
 bool
@@ -2,14 +2,25 @@
 #ifndef WIDGETRECOGNITIONTEXTS_HH_
 #define WIDGETRECOGNITIONTEXTS_HH_
 
+#include <map>
 #include <vector>
 #include "AudioInputController.hh"
 #include "WidgetScrollArea.hh"
 #include "RecognizerStatus.hh"
+#include "TextSurfaceCache.hh"
+
+class WidgetContainer;
+class WidgetMorpheme;
 
 /** A scrollable view which shows the recognition text. It shows the morphemes
  * separately and wraps a single word into a box. It also forces word breaks.
- * Recognized and hypothesis parts are shown in different colors. */
+ * Recognized and hypothesis parts are shown in different colors.
+ *
+ * The layout of the text is calculated first without any widgets. Widgets
+ * are created only for the words near the visible part of the view, and
+ * they are reused when the words scroll out of the view or the hypothesis
+ * changes. Morpheme widgets redraw themselves only when their text changes,
+ * and the rendered texts are cached. */
 class WidgetRecognitionText  :  public WidgetScrollArea
 {
   
@@ -28,41 +39,49 @@ public:
                          unsigned int pixels_per_second);
   virtual ~WidgetRecognitionText();
   
-  /** Update recognition text and screen. */
-  void update();
+  /** Update recognition text and screen.
+   * \return true if the recognition was checked and the widgets may have
+   *         changed. */
+  bool update();
   /** Clear all word and morpheme widgets. */
   void reset();
+  /** Scrolls the view and creates widgets for the words coming into view.
+   * \param x The scroll position of the widget. */
+  void set_scroll_position(Sint32 x);
   
 protected:
 
   void initialize();
   void terminate();
 
-  /** Updates recognized morphemes to screen widgets. */
+  /** Adds new recognized morphemes to the layout. */
   void update_recognition();
-  /** Clears previous hypothesis and adds widgets according to hypothesis. */
+  /** Replaces the previous hypothesis in the layout. */
   void update_hypothesis();
   
-  /** Removes all hypothesis widgets. */
+  /** Removes the hypothesis from the layout. */
   void remove_hypothesis();
 
-  /** Creates a widget for a morpheme or a sentence break. Morphemes are
-   * put into a word container. The logic between the return value and word
-   * widget is as follows (if read after the function call!):
-   * 1) ret == NULL && word == NULL  ==>  word break (no widget).
-   * 2) ret != NULL && word == NULL  ==>  sentence break widget
-   * 3) ret != NULL && word != NULL  ==>  morpheme widget.
+  /** Adds a morpheme or a sentence break to the layout. Morphemes are put
+   * into a word. The logic between the return value and word is as follows
+   * (if read after the function call!):
+   * 1) ret == -1 && word == -1  ==>  word break (no item).
+   * 2) ret != -1 && word == -1  ==>  sentence break item.
+   * 3) ret != -1 && word != -1  ==>  morpheme was added to the word.
    * \param morpheme The morpheme data.
-   * \param color Text color.
-   * \param word_widget Container widget of the current word. Don't modify it
-   *                    yourself, just give the same variable every time and
-   *                    the function will keep track.
+   * \param hypothesis true if the morpheme is a part of the hypothesis.
+   * \param word Index of the current word. Don't modify it yourself, just
+   *             give the same variable every time and the function will keep
+   *             track.
    * \param min_x Minimum x coordinate for the word. Used to force word breaks.
-   * \return The widget for the morpheme. */
-  PG_Widget* add_morpheme_widget(const Morpheme &morpheme,
-                                 const PG_Color &color,
-                                 PG_Widget *&word_widget,
-                                 Sint32 min_x);
+   * \return Index of the item the morpheme was added to. */
+  int add_morpheme(const Morpheme &morpheme,
+                   bool hypothesis,
+                   int &word,
+                   Sint32 min_x);
+  /** Creates, reuses and releases widgets so that the items near the visible
+   * area have widgets which match the layout. */
+  void update_widgets();
   /** Requests playback when the morphemes are clicked. Callback function for
    * ParaGUI. */
   bool handle_morpheme_widget(PG_MessageObject *widget,
@@ -71,26 +90,84 @@ protected:
 
 private:
 
+  /** A morpheme in a word. */
+  struct TextMorpheme
+  {
+    Sint32 x; //!< Position relative to the word.
+    Uint16 width; //!< Width in pixels.
+    bool hypothesis; //!< Part of the hypothesis.
+    std::string data; //!< The morpheme.
+  };
+
+  /** A word or a sentence break in the layout. */
+  struct TextItem
+  {
+    Sint32 x; //!< Position in the whole text.
+    Sint32 width; //!< Width in pixels.
+    bool separator; //!< true for sentence breaks.
+    bool hypothesis; //!< Color of a sentence break.
+    std::vector<TextMorpheme> morphemes; //!< Morphemes of a word.
+  };
+
+  /** Widgets of an item near the view. */
+  struct ItemWidgets
+  {
+    ItemWidgets() : box(NULL), separator(false), hypothesis(false) { }
+    PG_Widget *box; //!< Word container or sentence break widget.
+    bool separator; //!< box is a sentence break widget.
+    bool hypothesis; //!< Color of a sentence break widget.
+    std::vector<WidgetMorpheme*> morphemes; //!< Morphemes in the container.
+  };
+
+  /** Updates the widgets of an item to match the layout. Takes free widgets
+   * into use if the item doesn't have any yet.
+   * \param item The item in the layout.
+   * \param widgets The widgets of the item. */
+  void update_item_widgets(const TextItem &item, ItemWidgets &widgets);
+  /** Puts the widgets of an item back to free widgets.
+   * \param widgets The widgets to release. */
+  void release_item_widgets(ItemWidgets &widgets);
+  /** Sets the real x coordinate of a child widget and moves it there.
+   * \param widget The child widget.
+   * \param x The x coordinate. */
+  void move_child(PG_Widget *widget, Sint32 x);
+  /** \return The x coordinate just right to the item plus a margin. */
+  inline Sint32 get_item_end(int item) const;
+
   const unsigned int m_pixels_per_second; //!< Time resolution.
   RecognizerStatus *m_recognition; //!< Source of the recognition.
-  /** If a hypothesis morpheme is a part of a recognized word, it is stored
-   * in this list as a morpheme. If a word is completely hypothesis it is stored
-   * here as a word and the morphemes are not stored. This way we can always
-   * destroy the hypothesis widgets and create new ones to make hypothesis
-   * change in real time. */
-  std::vector<PG_Widget*> m_hypothesis_widgets;
+
+  /** Words and sentence breaks, first the recognized and then the
+   * hypothesis ones. If a hypothesis morpheme is a part of a recognized
+   * word, it is in the same word. */
+  std::vector<TextItem> m_items;
+  /** Number of items with recognized morphemes. */
+  unsigned int m_recognized_items;
   /** Number of recognized (not hypothesis) morphemes. */
   unsigned int m_last_recognition_count;
   /** Used to check the recognition process has moved on since last time. */
   unsigned long m_last_recognition_frame;
+
+  /** Widgets of the items near the view by the item index. */
+  std::map<unsigned int, ItemWidgets> m_live_widgets;
+  std::vector<PG_Widget*> m_free_separators; //!< Hidden separator widgets.
+  std::vector<WidgetContainer*> m_free_words; //!< Hidden word containers.
+  std::vector<WidgetMorpheme*> m_free_morphemes; //!< Morphemes without word.
+  TextSurfaceCache m_text_cache; //!< Rendered morphemes.
   
   /** When morphemes are clicked the playback request is sent to this. */
   AudioInputController *m_audio_input;
-  /** Last word which has recognized (not hypothesis) morphemes or NULL if it is
+  /** Last word which has recognized (not hypothesis) morphemes or -1 if it is
    * a word break. */
-  PG_Widget *m_last_recog_word;
-  /** Last recognized (not hypothesis) morpheme. */
-  PG_Widget *m_last_recog_morph;
+  int m_last_recog_word;
+  /** Last recognized (not hypothesis) word or sentence break. */
+  int m_last_recog_morph;
 };
 
+Sint32
+WidgetRecognitionText::get_item_end(int item) const
+{
+  return this->m_items[item].x + this->m_items[item].width + 2;
+}
+
 #endif /*WIDGETRECOGNITIONTEXTS_HH_*/
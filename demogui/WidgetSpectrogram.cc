@@ -1,6 +1,32 @@
 #include <math.h>
+#include <stdio.h>
 #include <algorithm>
 #include "WidgetSpectrogram.hh"
+#include "RecognizerStatus.hh"
+
+// Number of colors in the palette.
+static const unsigned int palette_size = 1024;
+
+/** Writes palette colors to a pixel column of a surface whose pixels are of
+ * type T. Going up from the bottom row one pitch at a time.
+ * \param pixel The pixel of the bottom row.
+ * \param pitch Bytes per row of the surface.
+ * \param colors Palette indexes from the bottom row up.
+ * \param height Number of rows.
+ * \param palette Colors in the pixel format of the surface. */
+template <class T>
+static void
+write_column(Uint8 *pixel,
+             unsigned int pitch,
+             const unsigned short *colors,
+             unsigned int height,
+             const Uint32 *palette)
+{
+  for (unsigned int ynd = 0; ynd < height; ynd++) {
+    *(T*)pixel = (T)palette[colors[ynd]];
+    pixel -= pitch;
+  }
+}
 
 WidgetSpectrogram::WidgetSpectrogram(PG_Widget *parent,
                                      const PG_Rect &rect,
@@ -9,6 +35,9 @@ WidgetSpectrogram::WidgetSpectrogram(PG_Widget *parent,
                                      double magnitude_exponent,
                                      double magnitude_suppressor)
   : WidgetAudioView(parent, rect, audio_input, pixels_per_second),
+    m_cache(128),
+    m_frontend_spectrum(NULL),
+    m_last_frontend_frames(0),
     m_magnitude_exponent(magnitude_exponent),
     m_magnitude_suppressor(magnitude_suppressor)
 {
@@ -16,33 +45,92 @@ WidgetSpectrogram::WidgetSpectrogram(PG_Widget *parent,
   this->m_data_in = new double[this->m_window_width];
   this->m_data_out = new double[this->m_window_width+1];
   this->m_data_out[this->m_window_width] = 0;
+  this->m_column.resize(this->m_window_width / 2);
+  this->create_level_colors();
   
   // Linear y-axis by default.
-  this->m_y_axis = NULL;
   this->create_y_axis(1.0, 1.0);
 
-  // Initialize fast fourier transformation.
+  // Initialize fast fourier transformation. Both plans are measured, the
+  // wisdom on the disk makes it fast after the first run.
+  SpectrogramWorker::load_wisdom();
+  this->m_worker = new SpectrogramWorker(audio_input,
+                                         &this->m_cache,
+                                         this->m_window_width,
+                                         this->m_samples_per_pixel);
   this->m_coeffs = fftw_plan_r2r_1d(this->m_window_width,
                                     this->m_data_in,
                                     this->m_data_out,
                                     FFTW_R2HC,
-                                    FFTW_ESTIMATE);
+                                    FFTW_MEASURE);
+  SpectrogramWorker::save_wisdom();
+  this->m_worker->start();
 }
 
 WidgetSpectrogram::~WidgetSpectrogram()
 {
+  // Stop the worker before the cache is destructed.
+  delete this->m_worker;
+  this->m_worker = NULL;
+
   fftw_destroy_plan(this->m_coeffs);
   delete [] this->m_data_in;
   delete [] this->m_data_out;
+}
+
+void
+WidgetSpectrogram::set_frontend_spectrum(FrontEndSpectrum *spectrum)
+{
+  if (spectrum && spectrum->get_bins() != this->m_window_width / 2) {
+    fprintf(stderr, "Front end spectrum has %u bins instead of %u, "
+            "calculating the spectrum.\n",
+            spectrum->get_bins(), this->m_window_width / 2);
+    spectrum = NULL;
+  }
+  this->m_frontend_spectrum = spectrum;
+  this->m_last_frontend_frames = 0;
+  this->m_force_redraw = true;
+}
 
-  delete [] this->m_y_axis;
-  this->m_y_axis = NULL;
+bool
+WidgetSpectrogram::update()
+{
+  if (this->m_frontend_spectrum) {
+    // Read before drawing, so frames coming while drawing are drawn again.
+    unsigned long frames = this->m_frontend_spectrum->get_frames();
+    if (frames != this->m_last_frontend_frames)
+      this->m_source_changed = true;
+    this->m_last_frontend_frames = frames;
+  }
+  else {
+    this->m_worker->request(this->m_scroll_pos, this->my_width);
+  }
+  return WidgetAudioView::update();
+}
+
+void
+WidgetSpectrogram::initialize()
+{
+  WidgetAudioView::initialize();
+
+  // Colors in the pixel format of the surface.
+  this->m_palette.resize(palette_size);
+  for (unsigned int ind = 0; ind < palette_size; ind++)
+    this->m_palette[ind] = this->get_color_by_value((double)ind / palette_size);
+}
+
+void
+WidgetSpectrogram::terminate()
+{
+  WidgetAudioView::terminate();
+  this->m_cache.clear();
 }
 
 void
 WidgetSpectrogram::set_magnitude_exponent(double exponent)
 {
   this->m_magnitude_exponent = exponent;
+  this->create_level_colors();
   this->m_force_redraw = true;
 }
 
@@ -50,9 +138,34 @@ void
 WidgetSpectrogram::set_magnitude_suppressor(double suppressor)
 {
   this->m_magnitude_suppressor = suppressor;
+  this->create_level_colors();
   this->m_force_redraw = true;
 }
 
+void
+WidgetSpectrogram::create_level_colors()
+{
+  const unsigned int power_levels = SpectrogramCache::power_levels;
+  const double levels_per_decade = SpectrogramCache::levels_per_decade;
+  this->m_level_colors.resize(power_levels);
+
+  // Level 0 means no power at all.
+  this->m_level_colors[0] = 0;
+  for (unsigned int ind = 1; ind < power_levels; ind++) {
+    // ADJUST: The exponent is the FIRST parameter for the spectrogram. You can
+    // adjust it to change the appearance of the spectrogram.
+    double magnitude = pow(10, ind / levels_per_decade * this->m_magnitude_exponent);
+
+    // Do normalization (values into range 0.0-1.0), and use some non-linear
+    // function (e.g. ^0.1) to make spectrogram clearer.
+    // ADJUST: The base number is the SECOND parameter for the spectrogram. You
+    // can adjust it to change the appearance of the spectrogram.
+    double value = 1 - pow(this->m_magnitude_suppressor, magnitude);
+    unsigned int color = (unsigned int)(value * palette_size);
+    this->m_level_colors[ind] = color < palette_size ? color : palette_size - 1;
+  }
+}
+
 void
 WidgetSpectrogram::create_y_axis(double linear_height, double linear_data)
 {
@@ -61,24 +174,25 @@ WidgetSpectrogram::create_y_axis(double linear_height, double linear_data)
   assert(linear_height >= 0.0 && linear_height <= 1.0);
   assert(linear_data > 0.0 && linear_data <= 1.0);
 
-  delete [] this->m_y_axis;
-  this->m_y_axis = new double[this->my_height];
+  std::vector<double> y_axis(this->my_height);
+  this->m_y_axis.resize(this->my_height);
+  this->m_column_colors.resize(this->my_height);
 
   for (unsigned int ind = 0; ind < this->my_height; ind++) {
     // Linear y-axis in range [0,1]. (Also base for the other axises.)
-    this->m_y_axis[ind] = (double)ind / (this->my_height - 1);
+    y_axis[ind] = (double)ind / (this->my_height - 1);
     
     //  Part linear and part logarithmic y-axis.
     // (These code lines may be commented out if linear y-axis is wanted.)
     //*
-    if (this->m_y_axis[ind] < linear_height || linear_height >= 1.0) {
-      this->m_y_axis[ind] = this->m_y_axis[ind] / linear_height * linear_data;
+    if (y_axis[ind] < linear_height || linear_height >= 1.0) {
+      y_axis[ind] = y_axis[ind] / linear_height * linear_data;
     }
     else {
       const double max_value = 1.0;
       const double min_value = linear_data;
-      double exponent = (this->m_y_axis[ind] - linear_height) / (1.0 - linear_height);
-      this->m_y_axis[ind] = min_value * pow(max_value / min_value, exponent);
+      double exponent = (y_axis[ind] - linear_height) / (1.0 - linear_height);
+      y_axis[ind] = min_value * pow(max_value / min_value, exponent);
     }
     //*/
 
@@ -87,11 +201,17 @@ WidgetSpectrogram::create_y_axis(double linear_height, double linear_data)
     /*
     const double max_value = 1.0;
     const double min_value = 0.01;
-    this->m_y_axis[ind] = min_value * pow(max_value / min_value, this->m_y_axis[ind]);
+    y_axis[ind] = min_value * pow(max_value / min_value, y_axis[ind]);
     //*/
     
     // Now scale the axis so that it will point to fftw data_out indexes.
-    this->m_y_axis[ind] = this->m_y_axis[ind] * (this->m_window_width / 2 - 1);
+    y_axis[ind] = y_axis[ind] * (this->m_window_width / 2 - 1);
+
+    // Fixed point interpolation weights.
+    AxisPoint &point = this->m_y_axis[ind];
+    point.low = (unsigned short)y_axis[ind];
+    point.high = point.low + 1 < this->m_window_width / 2 ? point.low + 1 : point.low;
+    point.weight = (unsigned short)((y_axis[ind] - point.low) * 256 + 0.5);
   }
 
   // When axis is modified, we need to redraw the entire view.
@@ -104,6 +224,19 @@ WidgetSpectrogram::fix_oldview_size(unsigned int oldview_from,
 {
   unsigned long first_pixel = this->m_last_scroll_pos + oldview_from;
 
+  // Pixels whose frame had been received from the front end.
+  if (this->m_frontend_spectrum) {
+    unsigned long correct_pixels = this->m_last_frontend_frames *
+      audio::audio_sample_rate / RecognizerStatus::frames_per_second /
+      this->m_samples_per_pixel;
+    while (correct_pixels > 0 &&
+           this->pixel_to_frame(correct_pixels - 1) >= this->m_last_frontend_frames)
+      correct_pixels--;
+    if (first_pixel + oldview_size > correct_pixels)
+      oldview_size = correct_pixels > first_pixel ? correct_pixels - first_pixel : 0;
+    return;
+  }
+
   // Calculate pixels that had enough information when they were drawn.
   // Pixel might be drawn with less than m_window_width information if there
   // was not enough audio data.
@@ -126,10 +259,37 @@ WidgetSpectrogram::fix_oldview_size(unsigned int oldview_from,
 void
 WidgetSpectrogram::draw_screen_vector(SDL_Surface *surface, unsigned int x)
 {
-  this->write_data_in(x + this->m_scroll_pos);
+  this->do_drawing(surface, x, this->get_column(x + this->m_scroll_pos));
+}
+
+const SpectrogramCache::Level*
+WidgetSpectrogram::get_column(unsigned long audio_pixel)
+{
+  SpectrogramCache::Level *levels = &this->m_column[0];
+
+  if (this->m_frontend_spectrum) {
+    // Frames which haven't been received yet are drawn empty.
+    if (!this->m_frontend_spectrum->get(this->pixel_to_frame(audio_pixel), levels))
+      std::fill(this->m_column.begin(), this->m_column.end(), 0);
+    return levels;
+  }
+
+  if (this->m_cache.get(audio_pixel, levels))
+    return levels;
+
+  // The worker hasn't got here yet. Only the gui thread clears the cache,
+  // so the generation can't change while calculating.
+  unsigned long generation = this->m_cache.get_generation();
+  this->write_data_in(audio_pixel);
   fftw_execute(this->m_coeffs);
-  this->calculate_output_values();
-  this->do_drawing(surface, x);
+  SpectrogramCache::calculate_levels(this->m_data_out, this->m_window_width, levels);
+
+  // Columns at the end of the audio will change when more audio comes, so
+  // they are not cached.
+  if (audio_pixel * this->m_samples_per_pixel + this->m_window_width <=
+      this->m_audio_input->get_audio_data_size())
+    this->m_cache.put(audio_pixel, levels, generation);
+  return levels;
 }
 
 void
@@ -152,36 +312,6 @@ WidgetSpectrogram::write_data_in(unsigned int audio_pixel)
   }
 }
 
-void
-WidgetSpectrogram::calculate_output_values()
-{
-  unsigned int range = this->m_window_width / 2;
-  
-  for (unsigned int ind = 0; ind < range; ind++) {
-    this->m_data_out[ind] = this->m_data_out[ind] * this->m_data_out[ind];
-    // Avoid: value = x[i]^2 + x[i]^2 . Should be x[i]^2 + x[j]^2 (i!=j).
-    if (ind != this->m_window_width - ind) {
-      unsigned int index = this->m_window_width - ind;
-      this->m_data_out[ind] += this->m_data_out[index] * this->m_data_out[index];
-    }
-    
-    // Root.
-    // ADJUST: The exponent is the FIRST parameter for the spectrogram. You can
-    // adjust it to change the appearance of the spectrogram.
-    this->m_data_out[ind] = pow(this->m_data_out[ind],
-                                this->m_magnitude_exponent);
-  }
-
-  // Do normalization (values into range 0.0-1.0), and use some non-linear
-  // function (e.g. ^0.1) to make spectrogram clearer.
-  for (unsigned int ind = 0; ind < range; ind++) {
-    // ADJUST: The base number is the SECOND parameter for the spectrogram. You
-    // can adjust it to change the appearance of the spectrogram.
-    this->m_data_out[ind] = 1 - pow(this->m_magnitude_suppressor,
-                                    this->m_data_out[ind]);
-  }
-}
-
 Uint32
 WidgetSpectrogram::get_color_by_value(double value)
 {
@@ -206,46 +336,54 @@ WidgetSpectrogram::get_color_by_value(double value)
 }
 
 void
-WidgetSpectrogram::draw_pixel(SDL_Surface *surface,
+WidgetSpectrogram::do_drawing(SDL_Surface *surface,
                               unsigned int x,
-                              unsigned int y,
-                              Uint32 color)
-{
-  // Draw the pixel.
-  unsigned int bpp = surface->format->BytesPerPixel;
-  for (unsigned int knd = 0; knd < bpp; knd++) {
-    unsigned int index = bpp * (x + y * surface->w) + knd;
-    ((char*)surface->pixels)[index] = ((char*)&color)[knd];
-  }
-}
-
-void
-WidgetSpectrogram::do_drawing(SDL_Surface *surface, unsigned int x)
+                              const SpectrogramCache::Level *levels)
 {
   assert(this->my_height > 1);
-  double value;
-  
-  for (unsigned int ynd = 0; ynd < this->my_height; ynd++) {
-    // Interpolate the value.
-    value = this->interpolate(this->m_data_out, this->m_y_axis[ynd]);
+  const unsigned int height = this->my_height;
+  const unsigned short *level_colors = &this->m_level_colors[0];
+  const AxisPoint *axis = &this->m_y_axis[0];
+  unsigned short *colors = &this->m_column_colors[0];
 
-    // Do color mapping.
-    Uint32 color = this->get_color_by_value(value);
-    
-    // Draw the pixel.
-    this->draw_pixel(surface, x, (this->my_height - 1) - ynd, color);
+  // Interpolate the palette indexes. The indexes are linear in the
+  // magnitude value, so interpolating them equals interpolating the values.
+  for (unsigned int ynd = 0; ynd < height; ynd++) {
+    const AxisPoint &point = axis[ynd];
+    unsigned int low = level_colors[levels[point.low]];
+    unsigned int high = level_colors[levels[point.high]];
+    colors[ynd] = (low * (256 - point.weight) + high * point.weight) >> 8;
+  }
+
+  // Write the column from the bottom row up with the pixel size of the
+  // surface.
+  unsigned int bpp = surface->format->BytesPerPixel;
+  unsigned int pitch = surface->pitch;
+  Uint8 *pixel = (Uint8*)surface->pixels + (height - 1) * pitch + x * bpp;
+  const Uint32 *palette = &this->m_palette[0];
+  switch (bpp) {
+  case 4:
+    write_column<Uint32>(pixel, pitch, colors, height, palette);
+    break;
+  case 2:
+    write_column<Uint16>(pixel, pitch, colors, height, palette);
+    break;
+  case 1:
+    write_column<Uint8>(pixel, pitch, colors, height, palette);
+    break;
+  default:
+    for (unsigned int ynd = 0; ynd < height; ynd++) {
+      memcpy(pixel, &palette[colors[ynd]], bpp);
+      pixel -= pitch;
+    }
+    break;
   }
 }
 
-double
-WidgetSpectrogram::interpolate(double *array, double index)
+unsigned long
+WidgetSpectrogram::pixel_to_frame(unsigned long audio_pixel) const
 {
-  int low = (int)index;
-  int high = (int)ceil(index);
-  if (low == high) {
-    return array[low];
-  }
-  else {
-    return (high - index) * array[low] + (index - low) * array[high];
-  }
+  return (unsigned long)(audio_pixel * this->m_samples_per_pixel *
+                         RecognizerStatus::frames_per_second /
+                         audio::audio_sample_rate);
 }
@@ -2,9 +2,22 @@
 #ifndef WIDGETSPECTROGRAM_HH_
 #define WIDGETSPECTROGRAM_HH_
 
+#include <vector>
 #include <fftw3.h>
 #include "WidgetAudioView.hh"
-
+#include "SpectrogramCache.hh"
+#include "SpectrogramWorker.hh"
+#include "FrontEndSpectrum.hh"
+
+/** Spectrogram view of the audio. The spectrum of each column is calculated
+ * only once and cached as quantized logarithmic power levels. Changing the
+ * magnitude parameters or the y axis only rebuilds the lookup tables which
+ * map the levels to colors. The SpectrogramWorker thread fills the cache
+ * ahead of the view, so the gui seldom has to calculate columns itself.
+ *
+ * Alternatively the spectrogram can show the spectra computed by the front
+ * end of the recognizer. Then no FFTs are done in the gui and the view shows
+ * exactly what the recognizer saw. */
 class WidgetSpectrogram  :  public WidgetAudioView
 {
 
@@ -53,6 +66,19 @@ public:
   void set_magnitude_exponent(double exponent);
   void set_magnitude_suppressor(double suppressor);
 
+  /** Shows the spectra of the recognizer front end instead of calculating
+   * the spectrum of the audio.
+   * \param spectrum Spectra of the front end or NULL to calculate them. */
+  void set_frontend_spectrum(FrontEndSpectrum *spectrum);
+
+  /** Asks the worker for the visible columns and updates the view. */
+  virtual bool update();
+
+  /** Initializes the view and the color palette. */
+  virtual void initialize();
+  /** Terminates the view and throws away the cached spectrum. */
+  virtual void terminate();
+
 protected:
 
   /** Fixes the old blittable area by reducing area that wasn't actually
@@ -68,41 +94,71 @@ protected:
    * \param audio_pixel Starting pixel of the audio data to fftw window. */
   void write_data_in(unsigned int audio_pixel);
 
-  /** Do some transformations to the fftw output. */
-  void calculate_output_values();
+  /** Calculates the spectrum of a column or takes it from the cache.
+   * \param audio_pixel The column.
+   * \return Power levels of the column. */
+  const SpectrogramCache::Level* get_column(unsigned long audio_pixel);
 
-  /** Draws a pixel vector. Writes the fftw input, executes the fftw, calculates
-   * the output values and does the actual drawing. */
+  /** Draws a pixel vector. Gets the spectrum of the column and does the
+   * actual drawing. */
   virtual void draw_screen_vector(SDL_Surface *surface, unsigned int x);
 
-  /** Does the actual drawing according to the fftw output. They should be
-   * transformed before calling this function. */
-  void do_drawing(SDL_Surface *surface, unsigned int x);
+  /** Does the actual drawing according to the power levels.
+   * \param surface Surface to draw on.
+   * \param x The column of the surface.
+   * \param levels Power levels of the column. */
+  void do_drawing(SDL_Surface *surface,
+                  unsigned int x,
+                  const SpectrogramCache::Level *levels);
   
   /** \return The color value for the given magnitude value [0,1]. */
   Uint32 get_color_by_value(double value);
 
-  /** An array index may be a double, so it interpolates the value from the
-   * two integer indexes. */
-  static double interpolate(double *array, double index);
+  /** Maps power levels to palette indexes according to the magnitude
+   * exponent and suppressor. */
+  void create_level_colors();
+
+  /** \param audio_pixel A column.
+   * \return The recognizer frame of the column. */
+  unsigned long pixel_to_frame(unsigned long audio_pixel) const;
 
-  /** Draws a pixel. */
-  static void draw_pixel(SDL_Surface *surface,
-                         unsigned int x,
-                         unsigned int y,
-                         Uint32 color);
-  
-  
 private:
 
+  /** Point of the y axis. The bin index of a screen row is a fraction, so
+   * the row is interpolated from two bins with fixed point weights. */
+  struct AxisPoint
+  {
+    unsigned short low; //!< Lower bin.
+    unsigned short high; //!< Upper bin.
+    unsigned short weight; //!< Weight of the upper bin, 0-256.
+  };
+
   // Variables for fftw.
   fftw_plan m_coeffs;
   double *m_data_in;
   double *m_data_out;
   unsigned int m_window_width;
+
+  /** Spectrum of the columns which had a full window of audio. */
+  SpectrogramCache m_cache;
+  /** Spectra of the front end or NULL if calculated here. */
+  FrontEndSpectrum *m_frontend_spectrum;
+  /** Front end frames received when the view was last updated. */
+  unsigned long m_last_frontend_frames;
+  /** Fills the cache in the background. */
+  SpectrogramWorker *m_worker;
+  /** Spectrum of the column being drawn. */
+  std::vector<SpectrogramCache::Level> m_column;
+  /** Palette index for each power level. */
+  std::vector<unsigned short> m_level_colors;
+  /** Colors for magnitude values in the surface pixel format. */
+  std::vector<Uint32> m_palette;
+  /** Palette indexes of the column being drawn, from the bottom row up. */
+  std::vector<unsigned short> m_column_colors;
   
-  /** Mapping of output indexes to screen y coordinates of the view. */
-  double *m_y_axis;
+  /** Mapping of screen y coordinates of the view to output indexes, from
+   * the bottom row up. */
+  std::vector<AxisPoint> m_y_axis;
 
   /** First transformation: mag = mag ^ exponent. Exponent is in range (0,1].
    * Smaller value reduces the relative differences between magnitudes, compare
@@ -1,5 +1,7 @@
 
+#include <string.h>
 #include "WidgetStatus.hh"
+#include "str.hh"
 
 WidgetStatus::WidgetStatus(PG_Widget *parent,
                            const PG_Rect &rect,
@@ -7,15 +9,51 @@ WidgetStatus::WidgetStatus(PG_Widget *parent,
   : PG_Widget(parent, rect, false),
     m_recog_status(recog_status),
     m_recognition_status(RecognizerStatus::READY),
-    m_adaptation_status(RecognizerStatus::NONE)
+    m_adaptation_status(RecognizerStatus::NONE),
+    m_beam(0),
+    m_token_limit(0),
+    m_frame_time(0)
 {
   this->m_recognition_label = new PG_Label(this,
-                                           PG_Rect(0, 0, rect.w / 2, rect.h));
+                                           PG_Rect(0, 0, rect.w / 4, rect.h));
   this->m_adaptation_label = new PG_Label(this,
-                                          PG_Rect(rect.w / 2, 0, rect.w / 2, rect.h));
+                                          PG_Rect(rect.w / 4, 0, rect.w / 4, rect.h));
+  this->m_audio_label = new PG_Label(this,
+                                     PG_Rect(2 * rect.w / 4, 0, rect.w / 4, rect.h));
+  this->m_score_label = new PG_Label(this,
+                                     PG_Rect(3 * rect.w / 4, 0, rect.w / 4, rect.h));
 
   this->m_recognition_label->SetText("Recognizer status: Ready");
   this->m_adaptation_label->SetText("Adaptation status: None");
+  this->set_audio_input(NULL);
+  this->set_live_score(NULL);
+}
+
+void
+WidgetStatus::set_audio_input(const AudioInputController *audio_input)
+{
+  this->m_audio_input = audio_input;
+  memset(&this->m_audio_statistics, 0, sizeof(this->m_audio_statistics));
+  this->m_audio_label->SetText(audio_input ? "Audio: OK" : "");
+}
+
+void
+WidgetStatus::set_live_score(const LiveScore *live_score)
+{
+  this->m_live_score = live_score;
+  this->m_score_text = "";
+  this->m_score_label->SetText("");
+}
+
+/** \return Error rate of an alignment as text. */
+static std::string
+error_rate(const align::Result &result)
+{
+  unsigned int reference = result.correct + result.substitution + result.deletion;
+  if (reference == 0)
+    return "-";
+  unsigned int errors = result.substitution + result.deletion + result.insertion;
+  return str::fmt(32, "%.1f %%", 100.0 * errors / reference);
 }
   
 void
@@ -25,7 +63,13 @@ WidgetStatus::update()
   RecognizerStatus::RecognitionStatus rec_stat = this->m_recog_status->get_recognition_status();
   RecognizerStatus::AdaptationStatus ada_stat = this->m_recog_status->get_adaptation_status();
 
-  if (rec_stat != this->m_recognition_status) {
+  float beam = this->m_recog_status->get_beam();
+  int token_limit = this->m_recog_status->get_token_limit();
+  float frame_time = this->m_recog_status->get_frame_time();
+
+  if (rec_stat != this->m_recognition_status ||
+      beam != this->m_beam || token_limit != this->m_token_limit ||
+      frame_time != this->m_frame_time) {
     switch (rec_stat) {
     case RecognizerStatus::READY:
       rec_text = "Recognizer status: Ready";
@@ -37,8 +81,16 @@ WidgetStatus::update()
       rec_text = "Recognizer status: Resetting";
       break;
     }
+    if (beam > 0 && frame_time > 0)
+      rec_text += str::fmt(64, " (beam %g, %d tokens, %.1f ms/frame)",
+                           beam, token_limit, frame_time);
+    else if (beam > 0)
+      rec_text += str::fmt(64, " (beam %g, %d tokens)", beam, token_limit);
     this->m_recognition_label->SetText(rec_text.c_str());
     this->m_recognition_status = rec_stat;
+    this->m_beam = beam;
+    this->m_token_limit = token_limit;
+    this->m_frame_time = frame_time;
   }
   
   if (ada_stat != this->m_adaptation_status) {
@@ -56,4 +108,41 @@ WidgetStatus::update()
     this->m_adaptation_label->SetText(ada_text.c_str());
     this->m_adaptation_status = ada_stat;
   }
+
+  if (this->m_audio_input) {
+    AudioStream::Statistics stat;
+    this->m_audio_input->get_statistics(stat);
+    // The callback period changes all the time, it is not shown here.
+    if (stat.dropped_input_frames != this->m_audio_statistics.dropped_input_frames ||
+        stat.input_overflows != this->m_audio_statistics.input_overflows ||
+        stat.output_underruns != this->m_audio_statistics.output_underruns ||
+        stat.max_jitter != this->m_audio_statistics.max_jitter) {
+      // Only lost audio is an error. Jitter is shown when over 10 ms.
+      unsigned long lost = stat.dropped_input_frames + stat.input_overflows;
+      std::string audio_text = "Audio: ";
+      if (lost)
+        audio_text += str::fmt(64, "%lu lost", lost);
+      if (stat.output_underruns)
+        audio_text += str::fmt(64, "%s%lu underruns", lost ? ", " : "",
+                               stat.output_underruns);
+      if (!lost && !stat.output_underruns)
+        audio_text += "OK";
+      if (stat.max_jitter > 10000)
+        audio_text += str::fmt(64, ", jitter %.0f ms", stat.max_jitter / 1000.0);
+      this->m_audio_label->SetText(audio_text.c_str());
+      this->m_audio_statistics = stat;
+    }
+  }
+
+  if (this->m_live_score) {
+    std::string score_text;
+    if (this->m_live_score->has_reference()) {
+      score_text = "WER " + error_rate(this->m_live_score->get_word_result()) +
+        ", CER " + error_rate(this->m_live_score->get_char_result());
+    }
+    if (score_text != this->m_score_text) {
+      this->m_score_label->SetText(score_text.c_str());
+      this->m_score_text = score_text;
+    }
+  }
 }
@@ -3,10 +3,15 @@
 #define WIDGETSTATUS_HH_
 
 #include "RecognizerStatus.hh"
+#include "AudioInputController.hh"
+#include "LiveScore.hh"
 #include <pgwidget.h>
 #include <pglabel.h>
 
-/** A status bar widget. Shows recognition status and adaptation status. */
+/** A status bar widget. Shows recognition status, adaptation status, audio
+ * problems and the running error rates against the reference. The pruning
+ * and the search time of the decoder are shown with the recognition
+ * status. */
 class WidgetStatus  :  public PG_Widget
 {
   
@@ -18,16 +23,32 @@ public:
   
   /** Updates the status texts. */
   void update();
+
+  /** \param audio_input Audio problems of this controller are shown. NULL
+   *                    hides them. */
+  void set_audio_input(const AudioInputController *audio_input);
+  /** \param live_score Error rates of this score are shown. NULL hides
+   *                   them. */
+  void set_live_score(const LiveScore *live_score);
   
 private:
 
   const RecognizerStatus *m_recog_status; //!< Recognizer status.
   PG_Label *m_recognition_label;
   PG_Label *m_adaptation_label;
+  PG_Label *m_audio_label;
+  PG_Label *m_score_label;
+  const AudioInputController *m_audio_input; //!< Source of audio statistics.
+  const LiveScore *m_live_score; //!< Source of error rates.
   
   // These variables are used to check the need for a update.
   RecognizerStatus::RecognitionStatus m_recognition_status;
   RecognizerStatus::AdaptationStatus m_adaptation_status;
+  float m_beam;
+  int m_token_limit;
+  float m_frame_time;
+  AudioStream::Statistics m_audio_statistics;
+  std::string m_score_text;
   
 };
 
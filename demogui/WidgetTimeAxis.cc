@@ -36,7 +36,7 @@ WidgetTimeAxis::reset()
   this->m_last_time = 0;
 }
 
-void
+bool
 WidgetTimeAxis::update(unsigned int time_length)
 {
   if (time_length > this->m_last_time) {
@@ -44,5 +44,7 @@ WidgetTimeAxis::update(unsigned int time_length)
       this->add_time_label(ind);
     }
     this->m_last_time = time_length;
+    return true;
   }
+  return false;
 }
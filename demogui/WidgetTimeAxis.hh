@@ -18,8 +18,9 @@ public:
   /** Removes all time ticks. */
   void reset();
   /** Updates the time axis. Only adds new time ticks, doesn't remove.
-   * \param time_length Current length of the time axis. */
-  void update(unsigned int time_length);
+   * \param time_length Current length of the time axis.
+   * \return true if ticks were added. */
+  bool update(unsigned int time_length);
   
 protected:
 
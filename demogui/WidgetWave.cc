@@ -1,4 +1,3 @@
-#include <algorithm>
 #include <math.h>
 #include "WidgetWave.hh"
 
@@ -26,11 +25,16 @@ WidgetWave::draw_screen_vector(SDL_Surface *surface, unsigned int x)
 {
   const AUDIO_FORMAT *audio_data = this->m_audio_input->get_audio_data();
   SDL_Rect line_rect;
-
-  unsigned int index = (int)((x + this->m_scroll_pos) * this->m_samples_per_pixel);
-  const AUDIO_FORMAT *first = audio_data + index;
-  AUDIO_FORMAT max = *std::max_element(first, first + (int)this->m_samples_per_pixel);
-  AUDIO_FORMAT min = *std::min_element(first, first + (int)this->m_samples_per_pixel);
+  AUDIO_FORMAT min, max;
+
+  // The summary gives the extremes in constant time whatever the zoom.
+  unsigned long index = (unsigned long)((x + this->m_scroll_pos) * this->m_samples_per_pixel);
+  unsigned long end = index + (unsigned long)this->m_samples_per_pixel;
+  if (end > this->m_last_audio_data_size)
+    end = this->m_last_audio_data_size;
+  if (!this->m_audio_input->get_wave_summary().get_min_max(audio_data, index, end,
+                                                           min, max))
+    return;
 
   static double scale = surface->h / pow(256, sizeof(AUDIO_FORMAT));
   int y1 = (int)(max * scale + 0.5 * surface->h);
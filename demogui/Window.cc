@@ -4,6 +4,8 @@
 #include <pgapplication.h>
 #include <unistd.h>  // usleep
 
+unsigned int Window::frames_per_second = 25;
+
 Window::Window()
 {
   this->m_window = NULL;
@@ -26,9 +28,15 @@ int
 Window::run_modal()
 {
   SDL_Event event;
+  Uint32 frame_length = 1000 / (frames_per_second ? frames_per_second : 1);
+  // Over 1000 frames per second would leave no time to sleep.
+  if (frame_length == 0)
+    frame_length = 1;
+  Uint32 next_frame;
 
   // Opening procedures.
   this->open();
+  next_frame = SDL_GetTicks();
 
   // Run until requested to end.
   while(!this->m_end_run) {
@@ -39,11 +47,22 @@ Window::run_modal()
       else
         this->m_window->ProcessEvent(&event, true);
       PG_Application::DrawCursor();
+      continue;
     }
-    else {
-      // When idle, allow window to perform its own operations.
+
+    // When idle, allow window to perform its own operations once per frame.
+    Uint32 now = SDL_GetTicks();
+    if ((Sint32)(now - next_frame) >= 0) {
       this->do_running();
-      usleep(100*1000);
+      next_frame += frame_length;
+      // Don't try to catch up frames lost while busy.
+      if ((Sint32)(now - next_frame) >= 0)
+        next_frame = now + frame_length;
+    }
+    else {
+      // Sleep until the next frame but wake up now and then for events.
+      Uint32 wait = next_frame - now;
+      usleep((wait < 10 ? wait : 10) * 1000);
     }
   }
   
@@ -33,6 +33,9 @@ public:
    * \return Window widget. */
   inline PG_Widget* get_widget() { return this->m_window; }
 
+  /** How many times per second do_running is called at most. */
+  static unsigned int frames_per_second;
+
   /** Tells the action to take on error.
    * ERROR_FATAL exits the application
    * ERROR_CLOSE closes this window
@@ -48,7 +51,8 @@ protected:
 
   /** Does opening procedures. Must be called once before do_running calls. */
   virtual void do_opening() { };
-  /** Does some fast procedures. This function is called repeatedly. */
+  /** Does some fast procedures. This function is called repeatedly, at most
+   * frames_per_second times per second. */
   virtual void do_running() { };
   /** Does closing procedures. Must be called once after do_running calls.
    * \param return_value The value to return from run_modal function. */
@@ -50,20 +50,13 @@ WindowComparison::do_running()
 {
   if (this->m_comparer) {
     if (this->m_comparer->run_comparer()) {
-      bool ok = true;
-      TextComparisonResult result = this->m_comparer->get_result(ok);
-      if (!ok) {
-        this->error("Comparing failed.\nMost probable reason is that SCLite "
-                    "was not found", ERROR_CLOSE);
-      }
-      else {
-        if (this->m_waiting_label) {
-          delete this->m_waiting_label;
-          this->m_waiting_label = NULL;
-        }
-        this->construct_result_array(result);
-        this->m_window->Update(true);
+      TextComparisonResult result = this->m_comparer->get_result();
+      if (this->m_waiting_label) {
+        delete this->m_waiting_label;
+        this->m_waiting_label = NULL;
       }
+      this->construct_result_array(result);
+      this->m_window->Update(true);
       delete this->m_comparer;
       this->m_comparer = NULL;
     }
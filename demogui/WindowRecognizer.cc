@@ -9,7 +9,8 @@
 #include "str.hh"
 
 WindowRecognizer::WindowRecognizer(RecognizerProcess *recognizer)
-  : m_recog_listener(recognizer ? recognizer->get_in_queue() : NULL,
+  : m_latency_trace(&m_recog_status),
+    m_recog_listener(recognizer ? recognizer->get_in_queue() : NULL,
             &m_recog_status)
 {
   m_audio_input = NULL;
@@ -88,6 +89,7 @@ WindowRecognizer::initialize()
 					  m_window->Width() - 20,
 					  20),
 				  &m_recog_status);
+  m_status_bar->set_live_score(&m_live_score);
 }
 
 void
@@ -110,6 +112,16 @@ WindowRecognizer::do_opening()
       return;
     }
   }
+  m_status_bar->set_audio_input(m_audio_input);
+  m_recog_listener.set_audio_input(m_audio_input);
+  if (m_latency_trace.open()) {
+    m_audio_input->set_latency_trace(&m_latency_trace);
+    m_recog_listener.set_latency_trace(&m_latency_trace);
+  }
+  if (!m_audio_input->start_forwarding()) {
+    error("Couldn't start audio thread in WindowRecognizer::open.", ERROR_CLOSE);
+    return;
+  }
 
   // These constants are used to construct the following areas.
   const unsigned int top = 140;
@@ -125,7 +137,8 @@ WindowRecognizer::do_opening()
 						       top,
 						       m_window->Width() - 20,
 						       (int)(text_part * height)),
-					       &m_recog_status);
+					       &m_recog_status,
+					       &m_live_score);
   
   // Create area for wave, spectrogram and recognition text.
   // ADJUST: You may adjust the last parameter (pixels_per_second) to change the
@@ -169,17 +182,21 @@ WindowRecognizer::do_running()
   //*/
 
   // Check broken pipe flags.
-  if (m_broken_pipe || m_recog_listener.is_broken_pipe()) {
+  if (m_broken_pipe || m_recog_listener.is_broken_pipe() ||
+      m_audio_input->is_broken_pipe()) {
     m_recog_listener.stop();
+    m_audio_input->stop_forwarding();
     handle_broken_pipe();
     m_recog_listener.start();
+    m_audio_input->start_forwarding();
   }
   else {
+    // Audio is forwarded to the recognizer in its own thread.
     if (m_audio_input->is_eof() && m_record_button->IsHidden())
       handle_stop_button();
 
-    m_audio_input->operate();
-    flush_out_queue();
+    m_recog_status.update_snapshot();
+    m_live_score.update(m_recog_status.get_snapshot());
     m_recognition_area->update();
     m_status_bar->update();
   }
@@ -203,10 +220,15 @@ WindowRecognizer::do_closing(int return_value)
   }
 
   if (m_audio_input) {
+    m_status_bar->set_audio_input(NULL);
+    m_audio_input->stop_forwarding();
     m_audio_input->terminate();
     delete m_audio_input;
     m_audio_input = NULL;
   }
+  m_recog_listener.set_audio_input(NULL);
+  m_recog_listener.set_latency_trace(NULL);
+  m_latency_trace.close();
 }
 
 bool
@@ -256,6 +278,8 @@ WindowRecognizer::handle_broken_pipe()
 void
 WindowRecognizer::flush_out_queue()
 {
+  // The audio forwarding thread uses the out queue too.
+  m_audio_input->lock();
   try {
     if (m_recog_proc)
       m_recog_proc->get_out_queue()->flush();
@@ -265,6 +289,19 @@ WindowRecognizer::flush_out_queue()
     // Raise flag so we can handle the exception in the do_running function.
     m_broken_pipe = true;
   }
+  m_audio_input->unlock();
+}
+
+void
+WindowRecognizer::send_message(const msg::Message &message)
+{
+  if (!m_recog_proc)
+    return;
+
+  m_audio_input->lock();
+  m_recog_proc->get_out_queue()->add_message(message);
+  flush_out_queue();
+  m_audio_input->unlock();
 }
 
 void
@@ -276,12 +313,15 @@ WindowRecognizer::pause_window_functionality(bool pause)
     m_audio_input->set_mute(true);
     m_audio_input->pause_listening(true);
     enable_recognizer(false);
+    // Child windows may use the out queue without locking.
+    m_audio_input->disable_forwarding();
     // Disable thread reading input pipe (RecognizerListener).
     m_recog_listener.disable();
   }
   else {
     // Enable thread reading input pipe (RecognizerListener).
     m_recog_listener.enable();
+    m_audio_input->enable_forwarding();
     // Set pausing states according to gui button states.
     handle_pauserecog_button();
     handle_pause_button();
@@ -324,9 +364,15 @@ WindowRecognizer::reset(bool reset_audio)
   //* If we don't run reset window, use these lines.
   if (m_recog_proc) {
     msg::Message message(msg::M_RESET, true);
+    m_audio_input->lock();
     m_recog_proc->get_out_queue()->clear_non_urgent();
-    m_recog_proc->get_out_queue()->add_message(message);
-    flush_out_queue();
+    send_message(message);
+    if (RecognizerStatus::frontend_spectrum)
+      send_message(msg::Message(msg::M_SPECTRUM_ON));
+    m_latency_trace.reset();
+    if (m_latency_trace.is_open())
+      send_message(msg::Message(msg::M_TRACE_ON));
+    m_audio_input->unlock();
     m_recog_listener.wait_for_ready();
   }
   pause_window_functionality(false);
@@ -357,8 +403,7 @@ WindowRecognizer::end_of_audio()
   pause_audio_input(true);
   if (m_recog_proc) {
     msg::Message message(msg::M_AUDIO_END, true);
-    m_recog_proc->get_out_queue()->add_message(message);
-    flush_out_queue();
+    send_message(message);
   }
 }
 
@@ -371,8 +416,7 @@ WindowRecognizer::enable_recognizer(bool enable)
     if (enable)
       message.set_type(msg::M_DECODER_UNPAUSE);
 
-    m_recog_proc->get_out_queue()->add_message(message);
-    flush_out_queue();
+    send_message(message);
   }
 }
 
@@ -489,7 +533,8 @@ WindowRecognizer::handle_settings_button()
 {
   WindowSettings window(m_window,
                         m_recog_proc,
-                        m_recognition_area->get_spectrogram());
+                        m_recognition_area->get_spectrogram(),
+                        m_audio_input);
   window.initialize();
   if (run_child_window(&window) == -1) {
     m_broken_pipe = true;
@@ -509,8 +554,7 @@ WindowRecognizer::handle_resetadaptation_button()
 {
   if (m_recog_proc) {
     msg::Message message(msg::M_ADAPT_RESET, true);
-    m_recog_proc->get_out_queue()->add_message(message);
-    flush_out_queue();
+    send_message(message);
   }
   m_recog_status.reset_adaptation();
   
@@ -522,8 +566,7 @@ WindowRecognizer::handle_adaptation_button()
 {
   if (m_recog_proc) {
     msg::Message message(msg::M_ADAPT_CALC, true);
-    m_recog_proc->get_out_queue()->add_message(message);
-    flush_out_queue();
+    send_message(message);
   }
   m_recog_status.start_adapting();
   
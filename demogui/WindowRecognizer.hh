@@ -10,6 +10,8 @@
 #include "RecognizerListener.hh"
 #include "RecognizerProcess.hh"
 #include "RecognizerStatus.hh"
+#include "LiveScore.hh"
+#include "LatencyTrace.hh"
 #include <pgbutton.h>
 #include <pglabel.h>
 #include <pgcheckbutton.h>
@@ -83,8 +85,13 @@ protected:
   void end_of_audio();
   
   /** Flushes the out queue to recognizer. Only this function should be used to
-   * flush the queue, because this has a proper broken pipe handling. */
+   * flush the queue, because this has a proper broken pipe handling. Locks
+   * the audio input controller, because its thread sends audio to the same
+   * queue. */
   void flush_out_queue();
+  /** Adds a message to the out queue and flushes the queue.
+   * \param message Message to send to recognizer. */
+  void send_message(const msg::Message &message);
   
   /** Disables or enables the window, so it won't disturb e.g. child window.
    * \param pause true to disable, false to enable.*/
@@ -97,6 +104,8 @@ protected:
 
   RecognizerProcess *m_recog_proc; //!< Process and pipes to recognizer.
   RecognizerStatus m_recog_status; //!< Recognition and status.
+  LiveScore m_live_score; //!< Running score against the reference.
+  LatencyTrace m_latency_trace; //!< Latency trace of the recognition.
   RecognizerListener m_recog_listener; //!< In queue parser.
 
   /** Widget which contains time axis, wave and spectrogram views, recognition
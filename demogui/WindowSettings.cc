@@ -1,16 +1,22 @@
 
+#include <math.h>
 #include "WindowSettings.hh"
 #include "str.hh"
 
 WindowSettings::WindowSettings(const PG_Widget *parent,
                                RecognizerProcess *recognizer,
-                               WidgetSpectrogram *spectrogram)
-  : WindowChild(parent, "Settings", 350, 300, true, true, "OK", "Cancel")
+                               WidgetSpectrogram *spectrogram,
+                               AudioInputController *audio_input)
+  : WindowChild(parent, "Settings", 350, 460, true, true, "OK", "Cancel")
 {
   this->m_beam_edit = NULL;
   this->m_lmscale_edit = NULL;
+  this->m_latency_edit = NULL;
+  this->m_frames_edit = NULL;
+  this->m_float_check = NULL;
   this->m_recognizer = recognizer;
   this->m_spectrogram = spectrogram;
+  this->m_audio_input = audio_input;
 }
 
 void
@@ -59,6 +65,39 @@ WindowSettings::initialize()
   this->m_exponent_edit->SetText(text.data());
   text = str::fmt(10, "%f", this->m_spectrogram->get_magnitude_suppressor());
   this->m_suppressor_edit->SetText(text.data());
+
+  // Audio settings. Empty latency means the default of the device.
+  new PG_Label(this->m_window, PG_Rect(10, 260, 200, 20), "Input latency (ms):");
+  new PG_Label(this->m_window, PG_Rect(10, 300, 200, 20), "Samples per callback:");
+  this->m_latency_edit = new PG_LineEdit(this->m_window,
+                                         PG_Rect(220, 260, 100, 20),
+                                         "LineEdit",
+                                         5);
+  this->m_frames_edit = new PG_LineEdit(this->m_window,
+                                        PG_Rect(220, 300, 100, 20),
+                                        "LineEdit",
+                                        5);
+  this->m_float_check = new PG_CheckButton(this->m_window,
+                                           PG_Rect(10, 340, 300, 20),
+                                           "Float samples from audio device");
+  if (audio::audio_input_latency >= 0) {
+    text = str::fmt(10, "%.0f", audio::audio_input_latency * 1000);
+    this->m_latency_edit->SetText(text.data());
+  }
+  text = str::fmt(10, "%lu", audio::audio_frames_per_buffer);
+  this->m_frames_edit->SetText(text.data());
+  if (audio::audio_device_format == audio::FLOAT32)
+    this->m_float_check->SetPressed();
+
+  // Show what the audio device really does.
+  if (this->m_audio_input) {
+    AudioStream::Statistics stat;
+    this->m_audio_input->get_statistics(stat);
+    text = str::fmt(100, "Measured: %lu samples every %.1f ms, latency %.0f ms",
+                    stat.callback_frames, stat.callback_period / 1000.0,
+                    this->m_audio_input->get_input_latency() * 1000);
+    new PG_Label(this->m_window, PG_Rect(10, 380, 330, 20), text.data());
+  }
 }
 
 bool
@@ -106,6 +145,9 @@ WindowSettings::do_ok()
     }
   }
 
+  if (!this->set_audio_settings())
+    return false;
+
   // All values were ok, set the values.
   
   this->m_spectrogram->set_magnitude_exponent(exponent);
@@ -128,6 +170,59 @@ WindowSettings::do_ok()
   return true;
 }
 
+bool
+WindowSettings::set_audio_settings()
+{
+  bool ok = true;
+  long latency = -1;
+  unsigned long frames;
+  audio::SampleFormat format;
+  std::string text = this->m_latency_edit->GetText();
+
+  if (!text.empty()) {
+    latency = this->read_long_value(this->m_latency_edit, 1, 2000, &ok);
+    if (!ok) {
+      this->error("Input latency must be empty (default) or an integer "
+                  "between 1-2000 ms.", ERROR_NORMAL);
+      return false;
+    }
+  }
+  frames = this->read_long_value(this->m_frames_edit, 0, 16384, &ok);
+  if (!ok) {
+    this->error("Samples per callback must be an integer between 0-16384 "
+                "(0 = automatic).", ERROR_NORMAL);
+    return false;
+  }
+  format = this->m_float_check->GetPressed() ? audio::FLOAT32 : audio::INT16;
+
+  // The dialog shows the latency in whole milliseconds.
+  float old_latency = audio::audio_input_latency;
+  unsigned long old_frames = audio::audio_frames_per_buffer;
+  audio::SampleFormat old_format = audio::audio_device_format;
+  long old_latency_ms = old_latency < 0 ? -1 : lround(old_latency * 1000);
+  if (latency == old_latency_ms && frames == old_frames &&
+      format == old_format)
+    return true;
+
+  audio::audio_input_latency = latency < 0 ? -1 : latency / 1000.0;
+  audio::audio_frames_per_buffer = frames;
+  audio::audio_device_format = format;
+  if (this->m_audio_input && !this->m_audio_input->restart_stream()) {
+    // Go back to the settings that worked.
+    audio::audio_input_latency = old_latency;
+    audio::audio_frames_per_buffer = old_frames;
+    audio::audio_device_format = old_format;
+    if (this->m_audio_input->restart_stream())
+      this->error("Audio device doesn't support these settings.",
+                  ERROR_NORMAL);
+    else
+      this->error("Audio device doesn't support these settings, and "
+                  "restarting it with the old settings failed.", ERROR_NORMAL);
+    return false;
+  }
+  return true;
+}
+
 float
 WindowSettings::read_float_value(PG_LineEdit *line_edit,
                                  float min,
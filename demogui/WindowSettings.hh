@@ -3,7 +3,9 @@
 #define WINDOWSETTINGS_HH_
 
 #include <pglineedit.h>
+#include <pgcheckbutton.h>
 #include "WindowChild.hh"
+#include "AudioInputController.hh"
 #include "RecognizerProcess.hh"
 #include "WidgetSpectrogram.hh"
 
@@ -14,7 +16,8 @@ public:
 
   WindowSettings(const PG_Widget *parent,
                  RecognizerProcess *recognizer,
-                 WidgetSpectrogram *spectrogram);
+                 WidgetSpectrogram *spectrogram,
+                 AudioInputController *audio_input);
   virtual ~WindowSettings() { }
 
   virtual void initialize();
@@ -30,16 +33,26 @@ protected:
    * fails, closes the window with signal -1. */
   virtual bool do_ok();
 
+  /** Reads the audio settings and restarts the audio stream if they
+   * changed. If the stream doesn't start with the new settings, the old
+   * ones are restored and the stream is restarted with them.
+   * \return false if a value was invalid or restarting failed. */
+  bool set_audio_settings();
+
 private:
 
   RecognizerProcess *m_recognizer;
   WidgetSpectrogram *m_spectrogram;
+  AudioInputController *m_audio_input;
 
   // Some ParaGUI fields for text input.
   PG_LineEdit *m_beam_edit;
   PG_LineEdit *m_lmscale_edit;
   PG_LineEdit *m_exponent_edit;
   PG_LineEdit *m_suppressor_edit;
+  PG_LineEdit *m_latency_edit;
+  PG_LineEdit *m_frames_edit;
+  PG_CheckButton *m_float_check;
 };
 
 #endif /*WINDOWSETTINGS_HH_*/
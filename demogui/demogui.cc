@@ -1,13 +1,34 @@
 #include <iostream>
+#include <fstream>
 #include <cstdio>
 #include <pglog.h>
 #include "Application.hh"
 #include "conf.hh"
 #include "AudioStream.hh"
+#include "AudioInputController.hh"
+#include "LatencyTrace.hh"
 #include "RecognizerStatus.hh"
+#include "Window.hh"
 
 using namespace std;
 
+// Reads the sample rate of the acoustic model from its feature configuration
+// (the sample_rate of the fft module). Returns zero if not found.
+static unsigned int
+read_model_sample_rate(const std::string &filename)
+{
+  ifstream file(filename.c_str());
+  string word;
+  while (file >> word) {
+    if (word == "sample_rate") {
+      unsigned int rate = 0;
+      file >> rate;
+      return rate;
+    }
+  }
+  return 0;
+}
+
 // cluster, beam, lmscale, int16
 int main(int argc, char* argv[])
 {
@@ -25,7 +46,18 @@ int main(int argc, char* argv[])
     ('b', "four-byte", "", "", "Allow less than 4 byte int.")
     ('d', "disable_recog", "", "", "Disables the recognizer.")
     ('s', "sample-rate", "arg", "16000", "sets the sample rate (default 16000)")
+    ('\0', "model-config", "arg", "", "feature configuration of the model, sets the sample rate")
+    ('\0', "device-rate", "arg", "", "sample rate of the audio device if not the model rate (resampled)")
+    ('\0', "audio-buffer", "arg", "3", "initial audio buffer length in seconds (input buffer grows when needed)")
+    ('\0', "input-latency", "arg", "", "suggested audio input latency in ms (default: device default)")
+    ('\0', "frames-per-buffer", "arg", "0", "audio samples per callback (0 = let audio system decide)")
+    ('\0', "audio-period", "arg", "10", "how often audio is sent to the recognizer in ms")
+    ('\0', "sample-format", "arg", "int16", "sample format of the audio device: int16 or float32")
+    ('\0', "fast", "", "", "recognize audio files as fast as the recognizer can, without playing them")
     ('\0', "words", "", "", "word based LM (without word break symbols)")
+    ('\0', "frontend-spectrum", "", "", "show the spectrum computed by the recognizer front end")
+    ('\0', "fps", "arg", "25", "maximum frame rate of the gui (1-1000)")
+    ('\0', "trace", "arg", "", "write the latency of each frame through the recognizer to this file in Chrome trace format")
     ('\0', "connect", "arg", "", "SSH connection command, e.g. \"ssh pyramid.hut.fi ssh itl-cl1\".")
     ;
 
@@ -53,7 +85,49 @@ int main(int argc, char* argv[])
   int ret_val = EXIT_SUCCESS;
   bool ok = false;
   audio::audio_sample_rate = (unsigned)config["sample-rate"].get_int();
+  if (config["model-config"].specified) {
+    unsigned int rate = read_model_sample_rate(config["model-config"].get_str());
+    if (rate == 0) {
+      fprintf(stderr, "No sample_rate in %s.\n",
+              config["model-config"].get_str().c_str());
+      return EXIT_FAILURE;
+    }
+    if (config["sample-rate"].specified && rate != audio::audio_sample_rate) {
+      fprintf(stderr, "Sample rate %u differs from the model rate %u.\n",
+              audio::audio_sample_rate, rate);
+      return EXIT_FAILURE;
+    }
+    audio::audio_sample_rate = rate;
+  }
+  if (config["device-rate"].specified) {
+    if (config["device-rate"].get_int() <= 0) {
+      fprintf(stderr, "Device rate must be positive.\n");
+      return EXIT_FAILURE;
+    }
+    audio::audio_device_rate = config["device-rate"].get_int();
+  }
+  audio::audio_buffer_length = config["audio-buffer"].get_float();
+  if (config["input-latency"].specified)
+    audio::audio_input_latency = config["input-latency"].get_float() / 1000;
+  audio::audio_frames_per_buffer = config["frames-per-buffer"].get_int();
+  audio::audio_forward_period = config["audio-period"].get_float() / 1000;
+  audio::audio_fast_forward = config["fast"].specified;
+  if (config["sample-format"].get_str() == "float32") {
+    audio::audio_device_format = audio::FLOAT32;
+  }
+  else if (config["sample-format"].get_str() != "int16") {
+    fprintf(stderr, "Sample format must be int16 or float32.\n");
+    return EXIT_FAILURE;
+  }
   RecognizerStatus::words = config["words"].specified;
+  RecognizerStatus::frontend_spectrum = config["frontend-spectrum"].specified;
+  if (config["fps"].get_int() <= 0 || config["fps"].get_int() > 1000) {
+    fprintf(stderr, "Frame rate must be between 1 and 1000.\n");
+    return EXIT_FAILURE;
+  }
+  Window::frames_per_second = config["fps"].get_int();
+  if (config["trace"].specified)
+    LatencyTrace::filename = config["trace"].get_str();
   
   if (config['d'].specified) {
     ok = app.initialize(config["width"].get_int(),
@@ -0,0 +1,406 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "conf.hh"
+#include "str.hh"
+#include "align.hh"
+
+aku::conf::Config config;
+
+/** One utterance of the corpus. */
+struct Utterance
+{
+  std::string id; //!< Utterance id or line number.
+  std::string reference; //!< Reference words separated by single spaces.
+  std::string hypothesis; //!< Hypothesis words separated by single spaces.
+};
+
+/** Scores of a range of utterances. Every worker has its own job and writes
+ * only to it, so the workers need no locking. */
+struct Job
+{
+  const std::vector<Utterance> *utterances;
+  unsigned long first; //!< First utterance of the job.
+  unsigned long end; //!< One past the last utterance of the job.
+  bool alignments; //!< Write the alignments to output.
+  bool clean; //!< Clean the texts like the gui before scoring.
+
+  align::Result words; //!< Sum of the word alignments.
+  align::Result chars; //!< Sum of the character alignments.
+  std::string output; //!< Alignments of the utterances.
+  pthread_t thread;
+};
+
+/** Reads a transcript file. Each line has one utterance, optionally ending
+ * with the utterance id in parentheses like in SCLite trn files.
+ * \param filename File to read.
+ * \param texts Texts of the lines are appended here, with words separated
+ *              by single spaces.
+ * \param ids Ids of the lines are appended here, empty if a line has none.
+ * \return false if the file couldn't be read. */
+static bool
+read_transcript(const char *filename,
+                std::vector<std::string> &texts,
+                std::vector<std::string> &ids)
+{
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    perror(str::fmt(256, "evaluator: Couldn't open %s", filename).c_str());
+    return false;
+  }
+
+  std::string content;
+  char buffer[65536];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    content.append(buffer, size);
+  if (ferror(file)) {
+    perror(str::fmt(256, "evaluator: Couldn't read %s", filename).c_str());
+    fclose(file);
+    return false;
+  }
+  fclose(file);
+
+  std::vector<std::string> lines = str::split(content, "\n", false);
+  // The last newline doesn't start an utterance.
+  if (!lines.empty() && str::cleaned(lines.back()).empty())
+    lines.pop_back();
+
+  for (unsigned long ind = 0; ind < lines.size(); ind++) {
+    std::string line = str::cleaned(lines[ind], " \t\r\n");
+    std::string id;
+
+    if (!line.empty() && line[line.size() - 1] == ')') {
+      std::string::size_type open = line.rfind('(');
+      if (open != std::string::npos) {
+        id = line.substr(open + 1, line.size() - open - 2);
+        line.erase(open);
+      }
+    }
+
+    std::vector<std::string> words = str::split(line, " \t\r", true);
+    std::string text;
+    for (unsigned int jnd = 0; jnd < words.size(); jnd++) {
+      if (jnd > 0)
+        text += ' ';
+      text += words[jnd];
+    }
+    texts.push_back(text);
+    ids.push_back(id);
+  }
+  return true;
+}
+
+/** Pairs the references and hypotheses by the utterance ids if all lines
+ * have one, otherwise by the line numbers. With ids, a missing hypothesis
+ * is empty and a hypothesis without a reference gets an empty reference,
+ * so they are scored as deletions and insertions like in SCLite.
+ * \return false if the files can't be paired. */
+static bool
+pair_utterances(const std::vector<std::string> &references,
+                const std::vector<std::string> &reference_ids,
+                const std::vector<std::string> &hypotheses,
+                const std::vector<std::string> &hypothesis_ids,
+                std::vector<Utterance> &utterances)
+{
+  bool use_ids = true;
+  for (unsigned long ind = 0; ind < reference_ids.size() && use_ids; ind++)
+    use_ids = !reference_ids[ind].empty();
+  for (unsigned long ind = 0; ind < hypothesis_ids.size() && use_ids; ind++)
+    use_ids = !hypothesis_ids[ind].empty();
+
+  utterances.resize(references.size());
+  if (!use_ids) {
+    if (references.size() != hypotheses.size()) {
+      fprintf(stderr, "evaluator: Reference has %lu lines and hypothesis "
+              "%lu. Without utterance ids they must be equal.\n",
+              (unsigned long)references.size(),
+              (unsigned long)hypotheses.size());
+      return false;
+    }
+    for (unsigned long ind = 0; ind < references.size(); ind++) {
+      utterances[ind].id = str::fmt(32, "%lu", ind + 1);
+      utterances[ind].reference = references[ind];
+      utterances[ind].hypothesis = hypotheses[ind];
+    }
+    return true;
+  }
+
+  std::map<std::string, unsigned long> hypothesis_index;
+  for (unsigned long ind = 0; ind < hypotheses.size(); ind++) {
+    if (!hypothesis_index.insert(std::make_pair(hypothesis_ids[ind], ind)).second) {
+      fprintf(stderr, "evaluator: Utterance %s is twice in the hypothesis.\n",
+              hypothesis_ids[ind].c_str());
+      return false;
+    }
+  }
+
+  // Missing hypotheses are scored as empty, they are all deletions.
+  unsigned long missing = 0;
+  for (unsigned long ind = 0; ind < references.size(); ind++) {
+    std::map<std::string, unsigned long>::iterator it =
+      hypothesis_index.find(reference_ids[ind]);
+    utterances[ind].id = reference_ids[ind];
+    utterances[ind].reference = references[ind];
+    if (it == hypothesis_index.end()) {
+      missing++;
+    }
+    else {
+      utterances[ind].hypothesis = hypotheses[it->second];
+      hypothesis_index.erase(it);
+    }
+  }
+  if (missing)
+    fprintf(stderr, "Warning: %lu utterances have no hypothesis.\n", missing);
+
+  // Hypotheses without a reference are all insertions. They come after the
+  // reference utterances in the order of the hypothesis file.
+  if (!hypothesis_index.empty()) {
+    fprintf(stderr, "Warning: %lu hypotheses have no reference.\n",
+            (unsigned long)hypothesis_index.size());
+    std::vector<unsigned long> extra;
+    for (std::map<std::string, unsigned long>::iterator it =
+           hypothesis_index.begin(); it != hypothesis_index.end(); it++)
+      extra.push_back(it->second);
+    std::sort(extra.begin(), extra.end());
+    for (unsigned long ind = 0; ind < extra.size(); ind++) {
+      Utterance utterance;
+      utterance.id = hypothesis_ids[extra[ind]];
+      utterance.hypothesis = hypotheses[extra[ind]];
+      utterances.push_back(utterance);
+    }
+  }
+  return true;
+}
+
+/** Adds the counts of an alignment to a sum. */
+static void
+add_result(align::Result &sum, const align::Result &result)
+{
+  sum.correct += result.correct;
+  sum.substitution += result.substitution;
+  sum.deletion += result.deletion;
+  sum.insertion += result.insertion;
+}
+
+/** \return The word in upper case. */
+static std::string
+upper(const std::string &word)
+{
+  std::string result = word;
+  for (unsigned int ind = 0; ind < result.size(); ind++)
+    result[ind] = toupper((unsigned char)result[ind]);
+  return result;
+}
+
+/** Writes an alignment like the pralign output of SCLite. Correct words are
+ * as they are, errors in upper case and missing words as stars. */
+static void
+write_alignment(std::string &output,
+                const Utterance &utterance,
+                const std::vector<std::string> &reference,
+                const std::vector<std::string> &hypothesis,
+                const std::vector<align::Operation> &operations,
+                const align::Result &result)
+{
+  std::string ref_line = "REF:  ";
+  std::string hyp_line = "HYP:  ";
+  std::string eval_line = "Eval: ";
+  unsigned long i = 0, j = 0;
+
+  for (unsigned long ind = 0; ind < operations.size(); ind++) {
+    std::string ref_word, hyp_word, eval;
+    switch (operations[ind]) {
+    case align::CORRECT:
+      ref_word = reference[i++];
+      hyp_word = hypothesis[j++];
+      break;
+    case align::SUBSTITUTION:
+      ref_word = upper(reference[i++]);
+      hyp_word = upper(hypothesis[j++]);
+      eval = "S";
+      break;
+    case align::DELETION:
+      ref_word = upper(reference[i++]);
+      hyp_word = std::string(ref_word.size() < 3 ? 3 : ref_word.size(), '*');
+      eval = "D";
+      break;
+    case align::INSERTION:
+      hyp_word = upper(hypothesis[j++]);
+      ref_word = std::string(hyp_word.size() < 3 ? 3 : hyp_word.size(), '*');
+      eval = "I";
+      break;
+    }
+
+    std::string::size_type width =
+      ref_word.size() > hyp_word.size() ? ref_word.size() : hyp_word.size();
+    ref_line += ref_word + std::string(width - ref_word.size() + 1, ' ');
+    hyp_line += hyp_word + std::string(width - hyp_word.size() + 1, ' ');
+    eval_line += eval + std::string(width - eval.size() + 1, ' ');
+  }
+
+  output += "id: (" + utterance.id + ")\n";
+  output += str::fmt(128, "Scores: (#C #S #D #I) %u %u %u %u\n",
+                     result.correct, result.substitution,
+                     result.deletion, result.insertion);
+  output += str::cleaned(ref_line) + "\n";
+  output += str::cleaned(hyp_line) + "\n";
+  output += str::cleaned(eval_line) + "\n\n";
+}
+
+/** Scores the utterances of a job. */
+static void*
+run_job(void *data)
+{
+  Job *job = (Job*)data;
+  std::map<std::string, int> words;
+  std::vector<int> reference_ids, hypothesis_ids;
+  std::vector<align::Operation> operations;
+
+  for (unsigned long ind = job->first; ind < job->end; ind++) {
+    const Utterance &utterance = (*job->utterances)[ind];
+    std::string reference = utterance.reference;
+    std::string hypothesis = utterance.hypothesis;
+    std::string reference_chars = utterance.reference;
+    std::string hypothesis_chars = utterance.hypothesis;
+
+    // The same cleaning as in the comparison of the gui. Character
+    // comparison sees the word breaks as '_' characters.
+    if (job->clean) {
+      align::clean(reference, ' ');
+      align::clean(hypothesis, ' ');
+      align::clean(reference_chars, '_');
+      align::clean(hypothesis_chars, '_');
+    }
+
+    // Word numbers are only compared within an utterance.
+    words.clear();
+    reference_ids.clear();
+    hypothesis_ids.clear();
+    align::number_words(reference, words, reference_ids);
+    align::number_words(hypothesis, words, hypothesis_ids);
+
+    align::Result result =
+      align::align_tokens(reference_ids, hypothesis_ids,
+                          job->alignments ? &operations : NULL);
+    add_result(job->words, result);
+    add_result(job->chars, align::align_chars(reference_chars,
+                                              hypothesis_chars));
+
+    if (job->alignments) {
+      write_alignment(job->output, utterance,
+                      str::split(reference, " ", true),
+                      str::split(hypothesis, " ", true),
+                      operations, result);
+    }
+  }
+  return NULL;
+}
+
+/** Prints the summary of a sum of alignments. */
+static void
+print_summary(const char *name, const align::Result &result)
+{
+  unsigned long reference = result.correct + result.substitution + result.deletion;
+  unsigned long errors = result.substitution + result.deletion + result.insertion;
+  printf("%-11s %8lu  C %8u  S %7u  D %7u  I %7u  Err %6.2f %%\n",
+         name, reference, result.correct, result.substitution,
+         result.deletion, result.insertion,
+         reference ? 100.0 * errors / reference : 0.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  try {
+    config("usage: evaluator [OPTION...] REFERENCE HYPOTHESIS\n"
+           "Lines of the files are utterances, optionally ending with the "
+           "utterance id in parentheses. The texts are cleaned like in the "
+           "comparison of the gui: only letters and word breaks are "
+           "scored. With ids, hypotheses without a reference are scored as "
+           "insertions.\n")
+      ('h', "help", "", "", "display help")
+      ('j', "jobs=INT", "arg", "0",
+       "number of worker threads (default: number of processors)")
+      ('a', "alignments=FILE", "arg", "",
+       "write the word alignments of the utterances to FILE, - for stdout")
+      ('\0', "raw", "", "",
+       "score the texts as they are, without cleaning")
+      ;
+
+    config.default_parse(argc, argv);
+    if (config.arguments.size() != 2)
+      config.print_help(stderr, 1);
+
+    std::vector<std::string> references, reference_ids;
+    std::vector<std::string> hypotheses, hypothesis_ids;
+    std::vector<Utterance> utterances;
+    if (!read_transcript(config.arguments[0].c_str(), references, reference_ids) ||
+        !read_transcript(config.arguments[1].c_str(), hypotheses, hypothesis_ids) ||
+        !pair_utterances(references, reference_ids, hypotheses, hypothesis_ids,
+                         utterances))
+      exit(1);
+
+    long jobs = config["jobs"].get_int();
+    if (jobs <= 0)
+      jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+      jobs = 1;
+    if ((unsigned long)jobs > utterances.size())
+      jobs = utterances.size() ? utterances.size() : 1;
+
+    // Every job gets a contiguous range of utterances, so the alignments
+    // can be written in the order of the reference.
+    std::vector<Job> job(jobs);
+    for (long ind = 0; ind < jobs; ind++) {
+      job[ind].utterances = &utterances;
+      job[ind].first = utterances.size() * ind / jobs;
+      job[ind].end = utterances.size() * (ind + 1) / jobs;
+      job[ind].alignments = config["alignments"].specified;
+      job[ind].clean = !config["raw"].specified;
+      if (pthread_create(&job[ind].thread, NULL, run_job, &job[ind]) != 0) {
+        fprintf(stderr, "evaluator: Couldn't create thread.\n");
+        exit(1);
+      }
+    }
+
+    align::Result words, chars;
+    for (long ind = 0; ind < jobs; ind++) {
+      pthread_join(job[ind].thread, NULL);
+      add_result(words, job[ind].words);
+      add_result(chars, job[ind].chars);
+    }
+
+    if (config["alignments"].specified) {
+      std::string filename = config["alignments"].get_str();
+      FILE *file = filename == "-" ? stdout : fopen(filename.c_str(), "w");
+      if (!file) {
+        perror(str::fmt(256, "evaluator: Couldn't open %s",
+                        filename.c_str()).c_str());
+        exit(1);
+      }
+      for (long ind = 0; ind < jobs; ind++)
+        fwrite(job[ind].output.data(), 1, job[ind].output.size(), file);
+      if (file != stdout)
+        fclose(file);
+    }
+
+    printf("Utterances: %lu\n", (unsigned long)utterances.size());
+    print_summary("Words:", words);
+    print_summary("Characters:", chars);
+  }
+  catch (std::string &str) {
+    fprintf(stderr, "evaluator: exception: %s\n", str.c_str());
+    exit(1);
+  }
+  catch (std::exception &e) {
+    fprintf(stderr, "evaluator: exception: %s\n", e.what());
+    exit(1);
+  }
+}
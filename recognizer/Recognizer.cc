@@ -1,8 +1,10 @@
 #include <errno.h>
+#include <math.h>
 #include "Recognizer.hh"
 #include "conf.hh"
 #include "msg.hh"
 #include "str.hh"
+#include "trace.hh"
 
 using namespace aku;
 
@@ -24,6 +26,62 @@ static const char *dec_state_str[] = {
   "D_NULL" 
 };
 
+// Makes a SPECTRUM message of the fft module output. The bins are
+// decimated to msg::spectrum_bins by taking the maximum and the power is
+// quantized logarithmically.
+static msg::Message
+spectrum_message(int frame, const FeatureVec &fft)
+{
+  int dim = fft.dim();
+  int bins = msg::spectrum_bins;
+  msg::Message message(msg::M_SPECTRUM);
+  std::string buf(8 + 2 * bins, 0);
+
+  endian::put4(frame, &buf[0]);
+  endian::put4(bins, &buf[4]);
+  for (int i = 0; i < bins; i++) {
+    int begin = i * dim / bins;
+    int end = (i + 1) * dim / bins;
+    if (end <= begin)
+      end = begin + 1;
+
+    double power = 0;
+    for (int j = begin; j < end && j < dim; j++) {
+      if (fft[j] > power)
+        power = fft[j];
+    }
+
+    int level = 0;
+    if (power >= 1) {
+      level = 1 + (int)(200 * log10(power));
+      if (level > msg::spectrum_max_level)
+        level = msg::spectrum_max_level;
+    }
+    buf[8 + 2 * i] = level & 0xff;
+    buf[8 + 2 * i + 1] = level >> 8;
+  }
+  message.append(buf);
+  return message;
+}
+
+// Makes a TRACE message of the time a stage finished a frame.
+static msg::Message
+trace_message(const char *stage, int frame, long long time)
+{
+  msg::Message message(msg::M_TRACE);
+  message.append(str::fmt(64, "%s %d %lld", stage, frame, time));
+  return message;
+}
+
+// Bytes of the messages waiting in a queue.
+static size_t
+queued_bytes(const msg::OutQueue &queue)
+{
+  size_t bytes = 0;
+  for (size_t i = 0; i < queue.queue.size(); i++)
+    bytes += queue.queue[i].buf.size();
+  return bytes;
+}
 
 static void*
 acoustic_thread(void *data)
@@ -62,10 +120,13 @@ acoustic_thread(void *data)
   retry:
     try {
       const FeatureVec vec = rec->gen.generate(frame);
+      long long features_time = trace::now();
       
       // Check if recognizer has raised the reset flag
       //
       bool got_reset = false;
+      bool send_spectrum = false;
+      bool send_trace = false;
       pthread_mutex_lock(&rec->ac_thread.lock);
       
       if (frame == 0)
@@ -78,6 +139,8 @@ acoustic_thread(void *data)
         got_reset = true;
         rec->ac_thread.reset_flag = false;
       }
+      send_spectrum = rec->ac_thread.spectrum_flag;
+      send_trace = rec->ac_thread.trace_flag;
       
       pthread_mutex_unlock(&rec->ac_thread.lock);
       
@@ -103,6 +166,20 @@ acoustic_thread(void *data)
       message.append(buf);
       
       out_queue.queue.push_back(message);
+
+      if (send_trace) {
+        out_queue.queue.push_back(trace_message("features", frame,
+                                                features_time));
+        out_queue.queue.push_back(trace_message("scored", frame,
+                                                trace::now()));
+      }
+
+      // The fft module has already computed this frame, so the spectrum
+      // for the gui costs only the quantization.
+      if (send_spectrum) {
+        FeatureModule *fft = rec->gen.module("fft");
+        out_queue.queue.push_back(spectrum_message(frame, fft->at(frame)));
+      }
       out_queue.flush();
       
       frame++;
@@ -132,8 +209,25 @@ Recognizer::Recognizer()
 {
   ac_state = A_CLOSED;
   dec_state = D_CLOSED;
+  ac_thread.reset_flag = false;
+  ac_thread.spectrum_flag = false;
+  ac_thread.trace_flag = false;
   adaptation = false;
   adapter = NULL;
+  flow.max_lag = 250;
+  flow.max_audio = 64000;
+  flow.policy = O_BLOCK;
+  flow.beam_scale = 0.5;
+  flow.probs_sent = 0;
+  flow.frames_decoded = 0;
+  flow.beam = 0;
+  flow.beam_narrowed = false;
+  flow.dropped_bytes = 0;
+  flow.paused = false;
+  flow.pending_bytes = 0;
+  flow.samples_forwarded = 0;
+  flow.max_pending = 128000;
+  flow.gui_held = false;
 }
 
 Recognizer::~Recognizer()
@@ -196,6 +290,14 @@ Recognizer::create_ac_thread()
 
   ac_in_queue.enable(ac_thread.fd_pr);
   ac_out_queue.enable(ac_thread.fd_pw);
+
+  // The decoder starts from frame zero unpaused after the reset that
+  // follows.
+  flow.probs_sent = 0;
+  flow.frames_decoded = 0;
+  flow.paused = false;
+  flow.samples_forwarded = 0;
+  clear_pending_audio();
 }
 
 void
@@ -251,8 +353,9 @@ Recognizer::process_stdin_queue()
         // ac_thread wants raw audio data without header, because
         // FeatureGenerator reads it directly from FILE* 
         message.raw = true;
-        ac_out_queue.queue.push_back(message);
-        ac_out_queue.flush();
+        flow.pending_audio.push_back(message);
+        flow.pending_bytes += message.data_length();
+        forward_pending_audio();
 
         if (verbosity > 0)
           fprintf(stderr, "rec: sending audio to ac (len %d)\n", 
@@ -287,6 +390,7 @@ Recognizer::process_stdin_queue()
         ac_thread.reset_flag = true;
         pthread_mutex_unlock(&ac_thread.lock);
         ac_out_queue.queue.clear();
+        clear_pending_audio();
         ac_out_queue.disable();
         if (::close(ac_thread.fd_pw) < 0) {
           perror("ERROR: process_stdin_queue(): close() failed");
@@ -361,9 +465,44 @@ Recognizer::process_stdin_queue()
              message.type() == msg::M_DECODER_PAUSE ||
              message.type() == msg::M_DECODER_UNPAUSE)
     {
+      if (message.type() == msg::M_DECODER_PAUSE)
+        flow.paused = true;
+      else if (message.type() == msg::M_DECODER_UNPAUSE)
+        flow.paused = false;
+
+      // Remember the beam, the overload policy may narrow it.
+      if (message.type() == msg::M_DECODER_SETTING) {
+        std::vector<std::string> fields =
+          str::split(message.data_str(), " \t", true);
+        if (fields.size() == 2 && fields[0] == "beam") {
+          flow.beam = str::str2float(fields[1]);
+          flow.beam_narrowed = false;
+        }
+      }
       dec_out_queue.queue.push_back(message);
     }
 
+    else if (message.type() == msg::M_TRACE_ON) {
+      pthread_mutex_lock(&ac_thread.lock);
+      ac_thread.trace_flag = true;
+      pthread_mutex_unlock(&ac_thread.lock);
+      dec_out_queue.queue.push_back(message);
+    }
+
+    else if (message.type() == msg::M_SPECTRUM_ON ||
+             message.type() == msg::M_SPECTRUM_OFF)
+    {
+      try {
+        // Throws if the front end has no fft module.
+        gen.module("fft");
+        pthread_mutex_lock(&ac_thread.lock);
+        ac_thread.spectrum_flag = message.type() == msg::M_SPECTRUM_ON;
+        pthread_mutex_unlock(&ac_thread.lock);
+      } catch (std::string &str) {
+        fprintf(stderr, "rec: ignoring SPECTRUM_ON: %s\n", str.c_str());
+      }
+    }
+
     else if (message.type() == msg::M_DEBUG) {
       std::string str = message.data_str();
       if (str == "conf") {
@@ -431,6 +570,7 @@ Recognizer::process_ac_in_queue()
         }
         dec_out_queue.queue.push_back(message);
         dec_out_queue.flush();
+        flow.probs_sent++;
       }
       else {
         fprintf(stderr, "rec: ignoring AUDIO in ac_state %d dec_state %d\n", 
@@ -438,6 +578,14 @@ Recognizer::process_ac_in_queue()
       }
     }
 
+    else if (message.type() == msg::M_SPECTRUM ||
+             message.type() == msg::M_TRACE)
+    {
+      // Spectra and traces are only for display, forward them in any state.
+      stdout_queue.queue.push_back(message);
+      stdout_queue.flush();
+    }
+
     else if (message.type() == msg::M_READY) {
       if ((ac_state == A_STARTING && dec_state == D_STARTING) ||
           (ac_state == A_STARTING && dec_state == D_READY)) 
@@ -485,6 +633,12 @@ Recognizer::process_dec_in_queue()
           (ac_state == A_CLOSING && dec_state == D_READY) ||
           (ac_state == A_CLOSED && dec_state == D_EOP_PENDING))
       {
+        // The last field is the number of decoded frames.
+        std::string data = message.data_str();
+        std::string::size_type pos = data.find_last_of(' ');
+        flow.frames_decoded =
+          atoi(data.c_str() + (pos == std::string::npos ? 0 : pos + 1));
+
         stdout_queue.queue.push_back(message);
         stdout_queue.flush();
       }
@@ -508,7 +662,28 @@ Recognizer::process_dec_in_queue()
       dec_out_queue.flush();
     }
 
-    else if (message.type() == msg::M_MESSAGE) {
+    else if (message.type() == msg::M_MESSAGE ||
+             message.type() == msg::M_DECODER_STATUS ||
+             message.type() == msg::M_TRACE)
+    {
+      stdout_queue.queue.push_back(message);
+      stdout_queue.flush();
+    }
+
+    else if (message.type() == msg::M_DECODER_STATS) {
+      if (verbosity > 0 && message.data_length() >= msg::decoder_stats_size) {
+        const char *data = message.data_ptr();
+        int frames = endian::get4<int>(data + 4);
+        fprintf(stderr, "rec: decoder frames %d-%d: %.2f ms per frame, "
+                "max %.2f ms, %d waiting, beam %g, token limit %d\n",
+                endian::get4<int>(data),
+                endian::get4<int>(data) + frames - 1,
+                endian::get4<int>(data + 8) / 1000.0 / (frames ? frames : 1),
+                endian::get4<int>(data + 12) / 1000.0,
+                endian::get4<int>(data + 16),
+                endian::get4<float>(data + 20),
+                endian::get4<int>(data + 24));
+      }
       stdout_queue.queue.push_back(message);
       stdout_queue.flush();
     }
@@ -551,6 +726,118 @@ Recognizer::process_dec_in_queue()
   }
 }
 
+void
+Recognizer::send_beam(float beam)
+{
+  msg::Message message(msg::M_DECODER_SETTING, true);
+  message.append(str::fmt(64, "beam %g", beam));
+  dec_out_queue.queue.push_back(message);
+  dec_out_queue.flush();
+}
+
+void
+Recognizer::forward_pending_audio()
+{
+  if (ac_state != A_READY && ac_state != A_EOA_PENDING)
+    return;
+
+  while (!flow.pending_audio.empty() &&
+         queued_bytes(ac_out_queue) < flow.max_audio)
+  {
+    flow.pending_bytes -= flow.pending_audio.front().data_length();
+    flow.samples_forwarded += flow.pending_audio.front().data_length() / 2;
+    ac_out_queue.queue.push_back(flow.pending_audio.front());
+    flow.pending_audio.pop_front();
+  }
+  ac_out_queue.flush();
+}
+
+void
+Recognizer::clear_pending_audio()
+{
+  flow.pending_audio.clear();
+  flow.pending_bytes = 0;
+}
+
+void
+Recognizer::hold_gui(bool hold)
+{
+  if (hold == flow.gui_held)
+    return;
+  stdout_queue.queue.push_back(
+    msg::Message(hold ? msg::M_AUDIO_HOLD : msg::M_AUDIO_RESUME, true));
+  stdout_queue.flush();
+  flow.gui_held = hold;
+}
+
+void
+Recognizer::update_flow_control()
+{
+  int lag = flow.probs_sent - flow.frames_decoded;
+  // A paused decoder decodes nothing, it isn't behind.
+  bool decoding = dec_state == D_READY && !flow.paused;
+
+  // Let the acoustics thread block while the decoder is behind.
+  ac_in_queue.mux_throttle(decoding && lag >= flow.max_lag);
+
+  if (flow.policy == O_BEAM && flow.beam > 0 && decoding) {
+    if (!flow.beam_narrowed && lag >= flow.max_lag / 2) {
+      fprintf(stderr, "rec: decoder %d frames behind, narrowing beam\n", lag);
+      send_beam(flow.beam * flow.beam_scale);
+      flow.beam_narrowed = true;
+    }
+    else if (flow.beam_narrowed && lag < flow.max_lag / 4) {
+      send_beam(flow.beam);
+      flow.beam_narrowed = false;
+    }
+  }
+
+  // Audio waits here when too much is queued for the acoustics. The gui
+  // is read all the time, so pause and reset always get through.
+  forward_pending_audio();
+
+  if (flow.pending_bytes > flow.max_pending) {
+    if (flow.policy == O_DROP) {
+      // Keep only the newest audio if the acoustics can't keep up.
+      unsigned long dropped = 0;
+      while (flow.pending_bytes > flow.max_pending &&
+             flow.pending_audio.size() > 1)
+      {
+        dropped += flow.pending_audio.front().data_length();
+        flow.pending_bytes -= flow.pending_audio.front().data_length();
+        flow.pending_audio.pop_front();
+      }
+      flow.dropped_bytes += dropped;
+
+      // The audio is 16-bit, the gui counts samples.
+      if (dropped > 0) {
+        msg::Message message(msg::M_AUDIO_DROPPED);
+        message.append(str::fmt(64, "%lu %lu", flow.samples_forwarded,
+                                dropped / 2));
+        stdout_queue.queue.push_back(message);
+        stdout_queue.flush();
+      }
+    }
+    else if (!flow.gui_held) {
+      fprintf(stderr, "rec: decoder overloaded, %lu bytes of audio pending, "
+              "holding the audio in the gui\n",
+              (unsigned long)flow.pending_bytes);
+      hold_gui(true);
+    }
+  }
+  else if (flow.gui_held && flow.pending_bytes <= flow.max_pending / 2) {
+    if (verbosity > 0)
+      fprintf(stderr, "rec: resuming the audio from the gui\n");
+    hold_gui(false);
+  }
+
+  if (flow.dropped_bytes > 0) {
+    fprintf(stderr, "rec: WARNING: decoder overloaded, dropped %lu bytes "
+            "of audio\n", flow.dropped_bytes);
+    flow.dropped_bytes = 0;
+  }
+}
+
 void
 Recognizer::run()
 {
@@ -605,12 +892,15 @@ Recognizer::run()
       fprintf(stderr, "rec: eof in input\n");
       stdin_queue.disable();
       ac_out_queue.disable();
+      clear_pending_audio();
       ::close(ac_thread.fd_pw);
       quit_pending = true;
       change_state(A_CLOSING, D_STALLED);
     }
 
-    if (ac_state == A_EOA_PENDING && ac_out_queue.queue.empty()) {
+    if (ac_state == A_EOA_PENDING && ac_out_queue.queue.empty() &&
+        flow.pending_audio.empty())
+    {
       
       assert(dec_state == D_READY);
       change_state(A_CLOSING, D_NULL);
@@ -621,6 +911,7 @@ Recognizer::run()
       }
     }
 
+    update_flow_control();
     mux.wait_and_flush();
 
     process_ac_in_queue();
@@ -27,10 +27,46 @@ public:
                   D_CLOSED, 
                   D_NULL };
   
+  /** What to do when the decoder can't keep up with the audio. */
+  enum OverloadPolicy { O_BLOCK, ///< Hold the audio in the gui.
+                        O_DROP, ///< Drop the oldest queued audio.
+                        O_BEAM }; ///< Narrow the beam, then block.
+
   AcState ac_state;
   DecState dec_state;
   bool quit_pending;
 
+  /** Flow control between the gui, the acoustics thread and the decoder.
+   * The decoder reports the frames it has decoded in RECOG messages. When
+   * it falls max_lag frames behind, probabilities aren't read from the
+   * acoustics thread, so the thread blocks and the audio queues up for
+   * it. A paused decoder isn't behind. The gui is always read, so its
+   * control messages get through; audio waits in pending_audio until there
+   * are less than max_audio bytes queued for the acoustics thread. When
+   * pending_audio grows over max_pending bytes, the policy decides: the
+   * oldest pending audio is dropped, or the gui is told to hold its audio
+   * until half of the pending audio has been forwarded. The gui is told
+   * where audio was dropped, so it can align the frames with its audio. */
+  struct {
+    int max_lag; //!< Frames the decoder may be behind.
+    size_t max_audio; //!< Bytes of audio queued for the acoustics thread.
+    OverloadPolicy policy;
+    float beam_scale; //!< Beam is multiplied by this in O_BEAM.
+    int probs_sent; //!< Frames sent to the decoder.
+    int frames_decoded; //!< Frames decoded by the decoder.
+    float beam; //!< Beam set by the gui, zero if not known.
+    bool beam_narrowed; //!< The decoder runs with the narrow beam.
+    unsigned long dropped_bytes; //!< Audio dropped in O_DROP.
+    bool paused; //!< The decoder has been paused by the gui.
+    /** Audio from the gui waiting for room in ac_out_queue. */
+    std::deque<msg::Message> pending_audio;
+    size_t pending_bytes; //!< Bytes of audio in pending_audio.
+    /** Samples forwarded to the acoustics thread since it was created. */
+    unsigned long samples_forwarded;
+    size_t max_pending; //!< Bytes in pending_audio before the policy acts.
+    bool gui_held; //!< The gui has been told to hold its audio.
+  } flow;
+
   struct {
     pthread_t t;
     int fd_pr;
@@ -39,6 +75,8 @@ public:
     int fd_tw;
     pthread_mutex_t lock;
     bool reset_flag;
+    bool spectrum_flag;
+    bool trace_flag; //!< Send the trace timestamps of the frames.
   } ac_thread;
 
   int verbosity;
@@ -75,6 +113,11 @@ private:
   void process_stdin_queue();
   void process_ac_in_queue();
   void process_dec_in_queue();
+  void update_flow_control();
+  void forward_pending_audio();
+  void clear_pending_audio();
+  void hold_gui(bool hold);
+  void send_beam(float beam);
 };
 
 #endif /* RECOGNIZER_HH */
@@ -17,6 +17,11 @@ main(int argc, char *argv[])
       ('\0', "eval-minc=FLOAT", "arg", "0", "minimum ratio of top clusters to evaluate")
       ('\0', "eval-ming=FLOAT", "arg", "0", "minimum ratio of Gaussians to evaluate")
       ('v', "verbosity=INT", "arg", "0", "verbosity level")
+      ('\0', "max-lag=INT", "arg", "250", "frames the decoder may fall behind before the acoustics wait (default 250)")
+      ('\0', "max-queued-audio=INT", "arg", "64000", "bytes of audio queued for the acoustics before overload (default 64000)")
+      ('\0', "max-pending-audio=INT", "arg", "128000", "bytes of audio waiting for the acoustics before the overload policy acts (default 128000)")
+      ('\0', "overload=POLICY", "arg", "block", "on overload: block (hold the audio in the gui), drop (oldest audio) or beam (narrow the beam, then block)")
+      ('\0', "overload-beam=FLOAT", "arg", "0.5", "beam scale for --overload=beam (default 0.5)")
       ;
 
     rec.dec_command.clear();
@@ -40,6 +45,26 @@ main(int argc, char *argv[])
       rec.dec_command = config["decoder"].get_str();
     rec.verbosity = config["verbosity"].get_int();
 
+    rec.flow.max_lag = config["max-lag"].get_int();
+    rec.flow.max_audio = config["max-queued-audio"].get_int();
+    rec.flow.max_pending = config["max-pending-audio"].get_int();
+    rec.flow.beam_scale = config["overload-beam"].get_float();
+    std::string policy = config["overload"].get_str();
+    if (policy == "block")
+      rec.flow.policy = Recognizer::O_BLOCK;
+    else if (policy == "drop")
+      rec.flow.policy = Recognizer::O_DROP;
+    else if (policy == "beam")
+      rec.flow.policy = Recognizer::O_BEAM;
+    else {
+      fprintf(stderr, "rec: unknown overload policy %s\n", policy.c_str());
+      exit(1);
+    }
+    if (rec.flow.max_lag <= 0) {
+      fprintf(stderr, "rec: max-lag must be positive\n");
+      exit(1);
+    }
+
     fprintf(stderr, "rec: reading HMM model\n");
     rec.hmms.read_all(config["hmms-base"].get_str());
 